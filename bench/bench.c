@@ -0,0 +1,543 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "io.h"
+#include "lmc.h"
+#include "perf.h"
+#include "util.h"
+
+// Throughput benchmark for the execution engines. Every workload is assembled and then run
+// on every engine for a fixed amount of time, and the results are printed as CSV (or JSON
+// with --json) so that they can be compared across builds. Where the host has performance
+// counters, each result also gives what the engine cost per LMC instruction in cycles, host
+// instructions, branch misses and cache misses (see perf.h). The process_peak_rss_kb column is
+// the peak resident set size of the whole benchmark process up to the end of that result, so
+// it only grows from one result to the next; it is not a per-engine measurement.
+
+// Multiplication by repeated addition.
+static const char mul_source[] =
+    "        INP\n"
+    "        STA a\n"
+    "        INP\n"
+    "        STA b\n"
+    "loop    LDA b\n"
+    "        BRZ done\n"
+    "        SUB one\n"
+    "        STA b\n"
+    "        LDA res\n"
+    "        ADD a\n"
+    "        STA res\n"
+    "        BRA loop\n"
+    "done    LDA res\n"
+    "        OUT\n"
+    "        HLT\n"
+    "a       DAT\n"
+    "b       DAT\n"
+    "res     DAT 0\n"
+    "one     DAT 1\n";
+
+// Fibonacci numbers below 1000, 50 times over.
+static const char fib_source[] =
+    "        INP\n"
+    "        STA rounds\n"
+    "round   LDA zero\n"
+    "        STA a\n"
+    "        LDA one\n"
+    "        STA b\n"
+    "loop    LDA a\n"
+    "        OUT\n"
+    "        ADD b\n"
+    "        STA c\n"
+    "        SUB b\n"
+    "        BRP next\n"
+    "        LDA rounds\n"
+    "        SUB one\n"
+    "        STA rounds\n"
+    "        BRZ done\n"
+    "        BRA round\n"
+    "next    LDA b\n"
+    "        STA a\n"
+    "        LDA c\n"
+    "        STA b\n"
+    "        BRA loop\n"
+    "done    HLT\n"
+    "rounds  DAT 0\n"
+    "a       DAT 0\n"
+    "b       DAT 0\n"
+    "c       DAT 0\n"
+    "zero    DAT 0\n"
+    "one     DAT 1\n";
+
+// Sieve of Eratosthenes below 60.
+static const char sieve_source[] =
+    "        LDA two\n"
+    "        STA i\n"
+    "outer   LDA i\n"
+    "        SUB limit\n"
+    "        BRP done\n"
+    "        LDA ldab\n"
+    "        ADD i\n"
+    "        STA rdi\n"
+    "rdi     DAT 0\n"
+    "        BRZ prime\n"
+    "        BRA next\n"
+    "prime   LDA i\n"
+    "        OUT\n"
+    "        ADD i\n"
+    "        STA j\n"
+    "inner   LDA j\n"
+    "        SUB limit\n"
+    "        BRP next\n"
+    "        LDA stab\n"
+    "        ADD j\n"
+    "        STA wrj\n"
+    "        LDA one\n"
+    "wrj     DAT 0\n"
+    "        LDA j\n"
+    "        ADD i\n"
+    "        STA j\n"
+    "        BRA inner\n"
+    "next    LDA i\n"
+    "        ADD one\n"
+    "        STA i\n"
+    "        BRA outer\n"
+    "done    HLT\n"
+    "i       DAT 0\n"
+    "j       DAT 0\n"
+    "two     DAT 2\n"
+    "one     DAT 1\n"
+    "limit   DAT 60\n"
+    "ldab    LDA flags\n"
+    "stab    STA flags\n"
+    "flags   DAT 0\n";
+
+// Bubble sort of 20 values.
+static const char bubble_source[] =
+    "        INP\n"
+    "        STA n\n"
+    "        LDA zero\n"
+    "        STA k\n"
+    "read    LDA k\n"
+    "        SUB n\n"
+    "        BRP sort\n"
+    "        LDA stab\n"
+    "        ADD k\n"
+    "        STA store\n"
+    "        INP\n"
+    "store   DAT 0\n"
+    "        LDA k\n"
+    "        ADD one\n"
+    "        STA k\n"
+    "        BRA read\n"
+    "sort    LDA n\n"
+    "        SUB one\n"
+    "        STA p\n"
+    "pass    LDA p\n"
+    "        BRZ print\n"
+    "        LDA zero\n"
+    "        STA k\n"
+    "cmp     LDA k\n"
+    "        ADD one\n"
+    "        SUB n\n"
+    "        BRP endpass\n"
+    "        LDA ldab\n"
+    "        ADD k\n"
+    "        STA load1\n"
+    "        ADD one\n"
+    "        STA load2\n"
+    "        LDA stab\n"
+    "        ADD k\n"
+    "        STA store1\n"
+    "        ADD one\n"
+    "        STA store2\n"
+    "load1   DAT 0\n"
+    "        STA x\n"
+    "load2   DAT 0\n"
+    "        STA y\n"
+    "        SUB x\n"
+    "        BRP noswap\n"
+    "        LDA y\n"
+    "store1  DAT 0\n"
+    "        LDA x\n"
+    "store2  DAT 0\n"
+    "noswap  LDA k\n"
+    "        ADD one\n"
+    "        STA k\n"
+    "        BRA cmp\n"
+    "endpass LDA p\n"
+    "        SUB one\n"
+    "        STA p\n"
+    "        BRA pass\n"
+    "print   LDA zero\n"
+    "        STA k\n"
+    "ploop   LDA k\n"
+    "        SUB n\n"
+    "        BRP fin\n"
+    "        LDA ldab\n"
+    "        ADD k\n"
+    "        STA pload\n"
+    "pload   DAT 0\n"
+    "        OUT\n"
+    "        LDA k\n"
+    "        ADD one\n"
+    "        STA k\n"
+    "        BRA ploop\n"
+    "fin     HLT\n"
+    "n       DAT 0\n"
+    "k       DAT 0\n"
+    "p       DAT 0\n"
+    "x       DAT 0\n"
+    "y       DAT 0\n"
+    "zero    DAT 0\n"
+    "one     DAT 1\n"
+    "ldab    LDA arr\n"
+    "stab    STA arr\n"
+    "arr     DAT 0\n";
+
+// Countdown loop from 999.
+static const char countdown_source[] =
+    "        INP\n"
+    "loop    SUB one\n"
+    "        BRP loop\n"
+    "        OUT\n"
+    "        HLT\n"
+    "one     DAT 1\n";
+
+// Self-modifying array walker.
+static const char walk_source[] =
+    "loop    LDA sum\n"
+    "walk    ADD arr\n"
+    "        STA sum\n"
+    "        LDA walk\n"
+    "        ADD one\n"
+    "        STA walk\n"
+    "        LDA cnt\n"
+    "        SUB one\n"
+    "        STA cnt\n"
+    "        BRZ done\n"
+    "        BRA loop\n"
+    "done    LDA sum\n"
+    "        OUT\n"
+    "        HLT\n"
+    "sum     DAT 0\n"
+    "one     DAT 1\n"
+    "cnt     DAT 40\n"
+    "arr     DAT 7\n"
+    "        DAT 14\n"
+    "        DAT 21\n"
+    "        DAT 5\n"
+    "        DAT 12\n"
+    "        DAT 19\n"
+    "        DAT 3\n"
+    "        DAT 10\n"
+    "        DAT 17\n"
+    "        DAT 1\n"
+    "        DAT 8\n"
+    "        DAT 15\n"
+    "        DAT 22\n"
+    "        DAT 6\n"
+    "        DAT 13\n"
+    "        DAT 20\n"
+    "        DAT 4\n"
+    "        DAT 11\n"
+    "        DAT 18\n"
+    "        DAT 2\n"
+    "        DAT 9\n"
+    "        DAT 16\n"
+    "        DAT 0\n"
+    "        DAT 7\n"
+    "        DAT 14\n"
+    "        DAT 21\n"
+    "        DAT 5\n"
+    "        DAT 12\n"
+    "        DAT 19\n"
+    "        DAT 3\n"
+    "        DAT 10\n"
+    "        DAT 17\n"
+    "        DAT 1\n"
+    "        DAT 8\n"
+    "        DAT 15\n"
+    "        DAT 22\n"
+    "        DAT 6\n"
+    "        DAT 13\n"
+    "        DAT 20\n"
+    "        DAT 4\n";
+
+struct workload
+{
+    const char* name;
+    const char* source;
+    const char* input;
+};
+
+static const struct workload workloads[] =
+{
+    { "mul",        mul_source,         "37\n27\n" },
+    { "fib",        fib_source,         "50\n" },
+    { "sieve",      sieve_source,       "" },
+    { "bubble",     bubble_source,      "20\n512\n3\n999\n87\n250\n1\n640\n77\n300\n12\n845\n5\n"
+                                        "410\n66\n123\n9\n700\n42\n18\n333\n" },
+    { "countdown",  countdown_source,   "999\n" },
+    { "walk",       walk_source,        "" },
+};
+
+#define NUM_WORKLOADS       (sizeof(workloads) / sizeof(workloads[0]))
+#define BENCH_OUTPUT_SIZE   4096
+
+struct result
+{
+    const char* workload;
+    const char* engine;
+    unsigned long long runs;
+    unsigned long long instructions;
+    double seconds;
+    double assembly_ns;
+    size_t process_peak_rss_kb;
+    struct lmc_perf_sample counters;
+};
+
+// Peak resident set size of the process so far, in KiB. This covers every workload and engine
+// already run, so a result only learns the cumulative peak at the time it finished.
+static size_t bench_peak_rss(void)
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return counters.PeakWorkingSetSize / 1024;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#ifdef __APPLE__
+    return (size_t)usage.ru_maxrss / 1024;     // Bytes rather than KiB.
+#else
+    return (size_t)usage.ru_maxrss;
+#endif
+#endif
+}
+
+// Run a program once from its pristine image, returning whether it halted. Repeated runs of
+// the same program share what the fused engine builds for it, as a long-lived caller would.
+static bool bench_run(const struct mailboxes* image, bool immutable, const char* input,
+                      enum lmc_engine engine, struct lmc_fused* fused, char* output,
+                      size_t* output_length, unsigned long long* steps)
+{
+    static struct lmc_io io;
+    struct mailboxes mailboxes = *image;
+    lmc_io_init_memory(&io, input, strlen(input), output, BENCH_OUTPUT_SIZE);
+    struct lmc_exec exec = { .engine = engine, .io = &io };
+    exec.code_immutable = immutable;
+    exec.fused = fused;
+    bool result = lmc_execute_ex(&mailboxes, &exec);
+    *output_length = io.out_length;
+    *steps = exec.steps;
+    return result;
+}
+
+static bool bench_workload(const struct workload* workload, double budget, int only_engine,
+                           struct lmc_perf* perf, struct result* results, size_t* count)
+{
+    struct mailboxes image;
+    size_t length = strlen(workload->source);
+    if (!lmc_assemble(workload->source, length, &image))
+    {
+        fprintf(stderr, "%s: %s\n", workload->name, image.error_msg);
+        return false;
+    }
+    bool immutable = lmc_code_immutable(&image);
+
+    // Assembly is quick, so time it over a batch of repetitions.
+    static struct lmc_assembler assembler;
+    struct mailboxes scratch;
+    unsigned long long assemblies = 0;
+    double start = lmc_perf_now();
+    double elapsed;
+    do
+    {
+        for (int i = 0; i < 64; i++)
+            lmc_assemble_ex(&assembler, workload->source, length, &scratch);
+        assemblies += 64;
+    } while ((elapsed = lmc_perf_now() - start) < budget / 4);
+    double assembly_ns = elapsed * 1e9 / assemblies;
+
+    // The reference interpreter's output is what every engine has to reproduce.
+    char expected[BENCH_OUTPUT_SIZE], output[BENCH_OUTPUT_SIZE];
+    size_t expected_length, output_length;
+    unsigned long long steps;
+    if (!bench_run(&image, immutable, workload->input, LMC_ENGINE_SWITCH, NULL, expected,
+                   &expected_length, &steps))
+    {
+        fprintf(stderr, "%s: did not halt\n", workload->name);
+        return false;
+    }
+
+    bool ok = true;
+    struct lmc_fused* fused = lmc_fused_create();
+    for (int engine = 0; engine < LMC_ENGINE_COUNT; engine++)
+    {
+        if (only_engine >= 0 && engine != only_engine)
+            continue;
+
+        struct result* result = &results[(*count)++];
+        result->workload = workload->name;
+        result->engine = lmc_engine_name((enum lmc_engine)engine);
+        result->assembly_ns = assembly_ns;
+        result->runs = 0;
+        result->instructions = 0;
+        lmc_perf_start(perf);
+        start = lmc_perf_now();
+        do
+        {
+            unsigned long long run_steps;
+            bench_run(&image, immutable, workload->input, (enum lmc_engine)engine, fused, output,
+                      &output_length, &run_steps);
+            if (output_length != expected_length || memcmp(output, expected, output_length) != 0)
+            {
+                fprintf(stderr, "%s: %s engine output differs from the reference interpreter\n",
+                        workload->name, result->engine);
+                ok = false;
+                break;
+            }
+            result->runs++;
+            result->instructions += run_steps;
+        } while ((elapsed = lmc_perf_now() - start) < budget);
+        lmc_perf_stop(perf, &result->counters);
+        result->seconds = elapsed;
+        result->process_peak_rss_kb = bench_peak_rss();
+    }
+    lmc_fused_destroy(fused);
+    return ok;
+}
+
+static void print_csv(const struct result* results, size_t count)
+{
+    fputs("workload,engine,runs,instructions,seconds,instructions_per_second,ns_per_instruction,"
+          "assembly_ns,process_peak_rss_kb", stdout);
+    for (int c = 0; c < LMC_PERF_COUNTER_COUNT; c++)
+        printf(",%s_per_instruction", lmc_perf_counter_name((enum lmc_perf_counter)c));
+    putchar('\n');
+    for (size_t i = 0; i < count; i++)
+    {
+        const struct result* r = &results[i];
+        printf("%s,%s,%llu,%llu,%.6f,%.0f,%.3f,%.1f,%zu", r->workload, r->engine, r->runs,
+               r->instructions, r->seconds, r->instructions / r->seconds,
+               r->seconds * 1e9 / max(r->instructions, 1), r->assembly_ns,
+               r->process_peak_rss_kb);
+
+        // Counters the host does not have are left empty.
+        for (int c = 0; c < LMC_PERF_COUNTER_COUNT; c++)
+        {
+            if (r->counters.available[c])
+                printf(",%.3f", (double)r->counters.counts[c] / max(r->instructions, 1));
+            else
+                putchar(',');
+        }
+        putchar('\n');
+    }
+}
+
+static void print_json(const struct result* results, size_t count)
+{
+    puts("[");
+    for (size_t i = 0; i < count; i++)
+    {
+        const struct result* r = &results[i];
+        printf("  {\"workload\": \"%s\", \"engine\": \"%s\", \"runs\": %llu, \"instructions\": %llu, "
+               "\"seconds\": %.6f, \"instructions_per_second\": %.0f, \"ns_per_instruction\": %.3f, "
+               "\"assembly_ns\": %.1f, \"process_peak_rss_kb\": %zu", r->workload, r->engine,
+               r->runs, r->instructions, r->seconds, r->instructions / r->seconds,
+               r->seconds * 1e9 / max(r->instructions, 1), r->assembly_ns,
+               r->process_peak_rss_kb);
+        for (int c = 0; c < LMC_PERF_COUNTER_COUNT; c++)
+        {
+            const char* name = lmc_perf_counter_name((enum lmc_perf_counter)c);
+            if (r->counters.available[c])
+                printf(", \"%s_per_instruction\": %.3f", name,
+                       (double)r->counters.counts[c] / max(r->instructions, 1));
+            else
+                printf(", \"%s_per_instruction\": null", name);
+        }
+        printf("}%s\n", (i + 1 < count) ? "," : "");
+    }
+    puts("]");
+}
+
+int main(int argc, char** argv)
+{
+    bool json = false;
+    double budget = 0.5;
+    int only_engine = -1;
+    const char* only_workload = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--json") == 0)
+            json = true;
+        else if (strcmp(argv[i], "--time") == 0 && i + 1 < argc)
+            budget = atof(argv[++i]);
+        else if (strcmp(argv[i], "--engine") == 0 && i + 1 < argc)
+        {
+            enum lmc_engine engine;
+            if (!lmc_engine_from_name(argv[++i], &engine))
+            {
+                fprintf(stderr, "Unknown engine \"%s\"\n", argv[i]);
+                return 1;
+            }
+            only_engine = engine;
+        }
+        else if (strcmp(argv[i], "--workload") == 0 && i + 1 < argc)
+            only_workload = argv[++i];
+        else
+        {
+            puts("usage: lmcvm_bench [--json] [--time seconds] [--engine name] [--workload name]");
+            fputs("workloads:", stdout);
+            for (size_t w = 0; w < NUM_WORKLOADS; w++)
+                printf(" %s", workloads[w].name);
+            putchar('\n');
+            return strcmp(argv[i], "--help") != 0;
+        }
+    }
+
+    if (only_workload)
+    {
+        size_t w = 0;
+        while (w < NUM_WORKLOADS && strcmp(only_workload, workloads[w].name) != 0)
+            w++;
+        if (w == NUM_WORKLOADS)
+        {
+            fprintf(stderr, "Unknown workload \"%s\"\n", only_workload);
+            return 1;
+        }
+    }
+
+    struct result results[NUM_WORKLOADS * LMC_ENGINE_COUNT];
+    size_t count = 0;
+    bool ok = true;
+    struct lmc_perf perf;
+    lmc_perf_open(&perf);
+    for (size_t w = 0; w < NUM_WORKLOADS; w++)
+    {
+        if (!only_workload || strcmp(only_workload, workloads[w].name) == 0)
+            ok &= bench_workload(&workloads[w], budget, only_engine, &perf, results, &count);
+    }
+    lmc_perf_close(&perf);
+
+    if (json)
+        print_json(results, count);
+    else
+        print_csv(results, count);
+    return !ok;
+}
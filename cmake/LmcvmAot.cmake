@@ -0,0 +1,18 @@
+# floason (C) 2025
+# Licensed under the MIT License.
+
+# lmcvm_add_aot_executable(<target> <source.lmc>)
+#
+# Build an LMC program into a native executable, by having lmcvm translate it to C (see
+# src/aot.h) and compiling that with the host compiler. The program is translated again
+# whenever its source or lmcvm changes.
+function(lmcvm_add_aot_executable target source)
+    get_filename_component(source_path "${source}" ABSOLUTE)
+    set(generated "${CMAKE_CURRENT_BINARY_DIR}/${target}.c")
+    add_custom_command(OUTPUT "${generated}"
+                       COMMAND lmcvm --emit-c "${generated}" "${source_path}"
+                       DEPENDS lmcvm "${source_path}"
+                       COMMENT "Translating ${source} to C"
+                       VERBATIM)
+    add_executable(${target} "${generated}")
+endfunction()
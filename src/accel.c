@@ -0,0 +1,499 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "io.h"
+#include "lmc.h"
+#include "lmc_internal.h"
+#include "util.h"
+
+// The accelerated mode watches every loop the program goes around. At the head of a loop it
+// works out symbolically what one more trip around will do, and when every mailbox (and the
+// accumulator) the loop touches moves by a fixed amount per trip, it jumps straight to the
+// last trip that is certain to take the same path, with no wrapping around at 1000. Loops
+// that cannot be skipped like this are also checked for exact repetition of the whole state
+// of the program, which, without any I/O in between, means that the program will never end.
+
+// The longest a loop head is left alone after failing to be skipped, counted in visits.
+#define ACCEL_MAX_PENALTY   1023
+
+// The state that the engine and the loop analysis share. The pool hash is kept up to date
+// by every store, so that comparing two states is cheap until they turn out to be equal.
+struct accel_state
+{
+    short* pool;
+    unsigned char pc;
+    short acc;
+    bool negative;
+    unsigned long long steps;
+    unsigned long long hash;
+
+    // The snapshot that later states are compared against (Brent's cycle detection).
+    bool snapshot_valid;
+    unsigned long long power;
+    unsigned long long distance;
+    unsigned char snapshot_pc;
+    short snapshot_acc;
+    bool snapshot_negative;
+    unsigned long long snapshot_hash;
+    short snapshot_pool[NUM_MAILBOXES];
+
+    // How many more visits each loop head waits before being analysed again.
+    unsigned short wait[NUM_MAILBOXES];
+    unsigned short penalty[NUM_MAILBOXES];
+};
+
+static inline unsigned long long accel_weight(int address)
+{
+    return (unsigned long long)(address + 1) * 0x9E3779B97F4A7C15ull;
+}
+
+static inline void accel_store(struct accel_state* state, int address, short value)
+{
+    state->hash += accel_weight(address) * (unsigned long long)((long long)value - state->pool[address]);
+    state->pool[address] = value;
+}
+
+static void expr_var(struct accel_expr* expr, int var)
+{
+    expr->constant = 0;
+    expr->count = 1;
+    expr->vars[0] = (unsigned char)var;
+    expr->coefs[0] = 1;
+}
+
+// Add sign * rhs to lhs, returning false if the result has too many terms.
+static bool expr_add(struct accel_expr* lhs, const struct accel_expr* rhs, int sign)
+{
+    struct accel_expr result = *lhs;
+    result.constant += sign * rhs->constant;
+    for (int i = 0; i < rhs->count; ++i)
+    {
+        int j = 0;
+        while (j < result.count && result.vars[j] != rhs->vars[i])
+            j++;
+        if (j == result.count)
+        {
+            if (result.count == ACCEL_TERMS)
+                return false;
+            result.vars[j] = rhs->vars[i];
+            result.coefs[j] = 0;
+            result.count++;
+        }
+        result.coefs[j] += sign * rhs->coefs[i];
+        if (result.coefs[j] == 0)
+        {
+            result.count--;
+            result.vars[j] = result.vars[result.count];
+            result.coefs[j] = result.coefs[result.count];
+        }
+    }
+    *lhs = result;
+    return true;
+}
+
+// Evaluate an expression against a set of variables, i.e. where the trip starts from or
+// how far each variable moves per trip.
+static long long expr_eval(const struct accel_expr* expr, const long long* values, bool constant)
+{
+    long long result = constant ? expr->constant : 0;
+    for (int i = 0; i < expr->count; ++i)
+        result += expr->coefs[i] * values[expr->vars[i]];
+    return result;
+}
+
+// The number of trips after the first one that a condition is certain to hold for, given its
+// value on the first trip and how far its value moves per trip, or -1 if there is no limit.
+static long long check_trips(enum accel_condition condition, long long start, long long delta)
+{
+    if (delta == 0)
+        return -1;
+    switch (condition)
+    {
+        case ACCEL_IN_RANGE:
+            return (delta > 0) ? (999 - start) / delta : (start + 999) / -delta;
+        case ACCEL_ZERO:
+            return 0;
+        case ACCEL_NONZERO:
+            return (-start % delta == 0 && -start / delta > 0) ? -start / delta - 1 : -1;
+        case ACCEL_NEGATIVE:
+            return (delta > 0) ? (-1 - start) / delta : -1;
+        case ACCEL_NOT_NEGATIVE:
+            return (delta < 0) ? start / -delta : -1;
+    }
+    return 0;
+}
+
+static bool trip_check(struct lmc_accel* trip, enum accel_condition condition,
+                       const struct accel_expr* value)
+{
+    if (trip->check_count == ACCEL_CONDITIONS)
+        return false;
+    trip->checks[trip->check_count].condition = condition;
+    trip->checks[trip->check_count++].value = *value;
+    return true;
+}
+
+// Try to skip ahead through the loop whose head the program is at. Returns true if the
+// loop was skipped, or was found never to end, in which case *endless is set.
+static bool accel_skip(struct accel_state* state, struct lmc_exec* exec, const bool limited,
+                       struct lmc_accel* trip, bool* endless)
+{
+    const short* pool = state->pool;
+    for (int i = 0; i < NUM_MAILBOXES; ++i)
+    {
+        expr_var(&trip->values[i], i);
+        trip->start[i] = pool[i];
+        trip->written[i] = false;
+        trip->executed[i] = false;
+    }
+    expr_var(&trip->values[ACCEL_ACC], ACCEL_ACC);
+    trip->start[ACCEL_ACC] = state->acc;
+    trip->written[ACCEL_ACC] = false;
+    trip->check_count = 0;
+
+    // Go around the loop once symbolically. Branches go whichever way they would go now,
+    // and are then made conditions of every later trip.
+    enum { FLAG_START, FLAG_SET, FLAG_CLEAR } flag = FLAG_START;
+    bool reads_start_flag = false;
+    struct accel_expr* acc = &trip->values[ACCEL_ACC];
+    unsigned char pc = state->pc;
+    int length = 0;
+    do
+    {
+        if (length == ACCEL_BODY)
+            return false;
+        length++;
+        trip->executed[pc] = true;
+        struct lmc_insn insn = lmc_decode(pool[pc]);
+        pc = (pc == NUM_MAILBOXES - 1) ? 0 : pc + 1;
+        switch (insn.op)
+        {
+            case ADD:
+            case SUB:
+            {
+                // The trip is only worth modelling if this one does not wrap around.
+                int sign = (insn.op == ADD) ? 1 : -1;
+                if (!expr_add(acc, &trip->values[insn.ar], sign))
+                    return false;
+                long long value = expr_eval(acc, trip->start, true);
+                if (value < -999 || value > 999 || !trip_check(trip, ACCEL_IN_RANGE, acc))
+                    return false;
+                trip->written[ACCEL_ACC] = true;
+                flag = (insn.op == SUB && value < 0) ? FLAG_SET : FLAG_CLEAR;
+                if (insn.op == SUB && !trip_check(trip, (flag == FLAG_SET) ? ACCEL_NEGATIVE : ACCEL_NOT_NEGATIVE, acc))
+                    return false;
+                break;
+            }
+            case STA:
+            {
+                trip->values[insn.ar] = *acc;
+                trip->written[insn.ar] = true;
+                break;
+            }
+            case LDA:
+            {
+                *acc = trip->values[insn.ar];
+                trip->written[ACCEL_ACC] = true;
+                flag = FLAG_CLEAR;
+                break;
+            }
+            case BRA:
+            {
+                pc = insn.ar;
+                break;
+            }
+            case BRZ:
+            {
+                bool zero = (expr_eval(acc, trip->start, true) == 0);
+                if (!trip_check(trip, zero ? ACCEL_ZERO : ACCEL_NONZERO, acc))
+                    return false;
+                if (zero)
+                    pc = insn.ar;
+                break;
+            }
+            case BRP:
+            {
+                if (flag == FLAG_START)
+                    reads_start_flag = true;
+                bool negative = (flag == FLAG_START) ? state->negative : (flag == FLAG_SET);
+                if (!negative)
+                    pc = insn.ar;
+                break;
+            }
+            default:
+                // Anything else either ends the run or does I/O, neither of which can be
+                // skipped.
+                return false;
+        }
+    } while (pc != state->pc);
+
+    // The code being run must stay the same on every trip.
+    for (int i = 0; i < NUM_MAILBOXES; ++i)
+    {
+        if (trip->executed[i] && trip->written[i])
+            return false;
+    }
+    bool final_negative = (flag == FLAG_START) ? state->negative : (flag == FLAG_SET);
+    if (reads_start_flag && final_negative != state->negative)
+        return false;
+
+    // Work out how far every variable moves per trip. A variable that is not written, or
+    // only ever has a constant added to it, moves by a fixed amount. One that is set from
+    // variables that do only depends on where they were a trip ago, which is the same as
+    // moving by a fixed amount too as long as it is already where that puts it.
+    bool changed = true;
+    for (int i = 0; i < ACCEL_VARS; ++i)
+    {
+        trip->known[i] = !trip->written[i];
+        trip->delta[i] = 0;
+    }
+    for (int i = 0; i < ACCEL_VARS; ++i)
+    {
+        const struct accel_expr* value = &trip->values[i];
+        if (!trip->written[i])
+            continue;
+        bool translated = false;
+        for (int j = 0; j < value->count; ++j)
+            translated |= (value->vars[j] == i && value->coefs[j] == 1);
+        if (!translated)
+            continue;
+        bool fixed = true;
+        for (int j = 0; j < value->count; ++j)
+            fixed &= (value->vars[j] == i || !trip->written[value->vars[j]]);
+        if (fixed)
+        {
+            trip->delta[i] = expr_eval(value, trip->start, true) - trip->start[i];
+            trip->known[i] = true;
+        }
+    }
+    while (changed)
+    {
+        changed = false;
+        for (int i = 0; i < ACCEL_VARS; ++i)
+        {
+            const struct accel_expr* value = &trip->values[i];
+            if (trip->known[i])
+                continue;
+            bool ready = true;
+            for (int j = 0; j < value->count; ++j)
+                ready &= (value->vars[j] != i && trip->known[value->vars[j]]);
+            if (!ready)
+                continue;
+            long long delta = expr_eval(value, trip->delta, false);
+            if (expr_eval(value, trip->start, true) - delta != trip->start[i])
+                return false;
+            trip->delta[i] = delta;
+            trip->known[i] = changed = true;
+        }
+    }
+    for (int i = 0; i < ACCEL_VARS; ++i)
+    {
+        if (!trip->known[i])
+            return false;
+    }
+
+    // Find the first trip that could go differently, and stop just short of it.
+    long long trips = -1;
+    for (int i = 0; i < trip->check_count; ++i)
+    {
+        const struct accel_expr* value = &trip->checks[i].value;
+        long long limit = check_trips(trip->checks[i].condition, expr_eval(value, trip->start, true),
+                                      expr_eval(value, trip->delta, false));
+        if (limit >= 0 && (trips < 0 || limit < trips))
+            trips = limit;
+    }
+    if (trips < 0)
+    {
+        // Every trip goes exactly like this one, forever.
+        *endless = true;
+        return true;
+    }
+    trips += 1;
+    if (limited)
+        trips = min(trips, (long long)((exec->max_steps - state->steps) / length));
+    if (trips < 2)
+        return false;
+
+    for (int i = 0; i < NUM_MAILBOXES; ++i)
+    {
+        if (trip->delta[i] != 0)
+            accel_store(state, i, (short)(trip->start[i] + trips * trip->delta[i]));
+    }
+    state->acc = (short)(trip->start[ACCEL_ACC] + trips * trip->delta[ACCEL_ACC]);
+    state->negative = final_negative;
+    state->steps += trips * length;
+    return true;
+}
+
+// The program has just gone around a loop back to its head. Returns false if the program
+// has been found to never end.
+static bool accel_loop(struct accel_state* state, struct lmc_exec* exec, const bool limited,
+                       struct lmc_accel* trip)
+{
+    if (state->snapshot_valid && state->hash == state->snapshot_hash && state->pc == state->snapshot_pc &&
+        state->acc == state->snapshot_acc && state->negative == state->snapshot_negative &&
+        memcmp(state->pool, state->snapshot_pool, sizeof(state->snapshot_pool)) == 0)
+        return false;
+    if (!state->snapshot_valid || ++state->distance == state->power)
+    {
+        state->power = state->snapshot_valid ? state->power * 2 : 1;
+        state->distance = 0;
+        state->snapshot_valid = true;
+        state->snapshot_pc = state->pc;
+        state->snapshot_acc = state->acc;
+        state->snapshot_negative = state->negative;
+        state->snapshot_hash = state->hash;
+        memcpy(state->snapshot_pool, state->pool, sizeof(state->snapshot_pool));
+    }
+
+    // Loops that cannot be skipped are only analysed again every so often, backing off
+    // further each time.
+    unsigned char head = state->pc;
+    if (state->wait[head] > 0)
+    {
+        state->wait[head]--;
+        return true;
+    }
+    bool endless = false;
+    if (accel_skip(state, exec, limited, trip, &endless))
+        state->penalty[head] = 0;
+    else
+    {
+        state->penalty[head] = min(state->penalty[head] * 2 + 1, ACCEL_MAX_PENALTY);
+        state->wait[head] = state->penalty[head];
+    }
+    return !endless;
+}
+
+static LMC_FORCEINLINE bool execute_accelerated(struct mailboxes* mailboxes, struct lmc_exec* exec,
+                                                const struct lmc_regs* start, const bool limited)
+{
+    struct accel_state local = { 0 };
+    struct accel_state* state = &local;
+    struct lmc_accel* trip = exec->accel;
+    if (trip == NULL)
+        trip = lmc_accel_create();
+    state->pool = mailboxes->pool;
+    state->pc = start->pc;
+    state->acc = start->acc;
+    state->negative = start->negative;
+    state->steps = start->steps;
+    for (int i = 0; i < NUM_MAILBOXES; ++i)
+        state->hash += accel_weight(i) * (unsigned long long)(long long)mailboxes->pool[i];
+
+    bool result;
+    for (;;)
+    {
+        if (limited && state->steps == exec->max_steps)
+        {
+            result = lmc_fail_step_limit(mailboxes, exec);
+            break;
+        }
+        state->steps++;
+
+        unsigned char at = state->pc;
+        struct lmc_insn insn = lmc_decode(mailboxes->pool[at]);
+        state->pc = (at == NUM_MAILBOXES - 1) ? 0 : at + 1;
+        bool looped = (at == NUM_MAILBOXES - 1);
+        switch (insn.op)
+        {
+            case HLT:
+                result = lmc_halt(exec, state->steps);
+                goto done;
+            case ADD:
+                state->negative = false;
+                state->acc = (state->acc + mailboxes->pool[insn.ar]) % 1000;
+                break;
+            case SUB:
+                state->negative = (state->acc < mailboxes->pool[insn.ar]);
+                state->acc = (state->acc - mailboxes->pool[insn.ar]) % 1000;
+                break;
+            case STA:
+                accel_store(state, insn.ar, state->acc);
+                break;
+            case LDA:
+                state->negative = false;
+                state->acc = mailboxes->pool[insn.ar];
+                break;
+            case BRA:
+                state->pc = insn.ar;
+                looped = (insn.ar <= at);
+                break;
+            case BRZ:
+                if (state->acc == 0)
+                {
+                    state->pc = insn.ar;
+                    looped = (insn.ar <= at);
+                }
+                break;
+            case BRP:
+                if (!state->negative)
+                {
+                    state->pc = insn.ar;
+                    looped = (insn.ar <= at);
+                }
+                break;
+            case INP:
+                if (lmc_input_blocked(exec))
+                {
+                    result = lmc_suspend(exec, at, state->acc, state->negative, state->steps - 1);
+                    goto done;
+                }
+                lmc_io_read(exec->io, &state->acc, &state->negative);
+                state->snapshot_valid = false;
+                break;
+            case OUT:
+                if (!lmc_io_write(exec->io, state->acc))
+                {
+                    result = lmc_mismatch(mailboxes, exec, state->steps);
+                    goto done;
+                }
+                state->snapshot_valid = false;
+                break;
+            default:
+                result = lmc_fail_opcode(mailboxes, exec, state->steps,
+                                         lmc_decode_ir(mailboxes->pool[at]));
+                goto done;
+        }
+
+        if (looped && !accel_loop(state, exec, limited, trip))
+        {
+            lmc_io_flush(exec->io);
+            exec->steps = state->steps;
+            exec->status = LMC_STATUS_LOOP;
+            sprintf_s(mailboxes->error_msg, sizeof(mailboxes->error_msg),
+                      "Infinite loop at mailbox %d after %llu instructions", state->pc,
+                      state->steps);
+            result = false;
+            break;
+        }
+    }
+
+done:
+    if (trip != exec->accel)
+        lmc_accel_destroy(trip);
+    return result;
+}
+
+struct lmc_accel* lmc_accel_create(void)
+{
+    return (struct lmc_accel*)quick_malloc(sizeof(struct lmc_accel));
+}
+
+void lmc_accel_destroy(struct lmc_accel* accel)
+{
+    free(accel);
+}
+
+LMC_ENGINE_VARIANTS(execute_accelerated)
+
+// Execute an assembled LMC program, skipping ahead through simple loops.
+bool lmc_execute_accelerated(struct mailboxes* mailboxes, struct lmc_exec* exec,
+                             const struct lmc_regs* start)
+{
+    return LMC_ENGINE_RUN(execute_accelerated, mailboxes, exec, start);
+}
@@ -0,0 +1,72 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#include <stdbool.h>
+
+#include "lmc.h"
+#include "lmc_internal.h"
+
+// Find out whether a program can ever store into its own code. Every path through the
+// program is followed from address 0, collecting the mailboxes that can be executed and the
+// mailboxes that any STA on the way stores into. STA is the only thing that can change the
+// pool, so as long as the two sets never meet, the code executed is the code the program
+// started out with however the run goes, and the paths followed are the only ones there are.
+bool lmc_code_immutable(const struct mailboxes* mailboxes)
+{
+    bool reachable[NUM_MAILBOXES] = { false };
+    bool stored[NUM_MAILBOXES] = { false };
+    unsigned char worklist[NUM_MAILBOXES];
+    int count = 0;
+    reachable[0] = true;
+    worklist[count++] = 0;
+
+#define VISIT(target)                           \
+    do                                          \
+    {                                           \
+        int visit = (target);                   \
+        if (!reachable[visit])                  \
+        {                                       \
+            reachable[visit] = true;            \
+            worklist[count++] = visit;          \
+        }                                       \
+    } while (0)
+
+    while (count > 0)
+    {
+        int pc = worklist[--count];
+        int next = (pc == NUM_MAILBOXES - 1) ? 0 : pc + 1;
+        struct lmc_insn insn = lmc_decode(mailboxes->pool[pc]);
+        switch (insn.op)
+        {
+            case HLT:
+            case DAT:
+            case OP_COUNT:
+                // The run ends here, either way.
+                break;
+            case STA:
+                stored[insn.ar] = true;
+                VISIT(next);
+                break;
+            case BRA:
+                VISIT(insn.ar);
+                break;
+            case BRZ:
+            case BRP:
+                VISIT(insn.ar);
+                VISIT(next);
+                break;
+            default:
+                VISIT(next);
+                break;
+        }
+    }
+
+#undef VISIT
+
+    for (int i = 0; i < NUM_MAILBOXES; ++i)
+    {
+        if (reachable[i] && stored[i])
+            return false;
+    }
+    return true;
+}
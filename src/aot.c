@@ -0,0 +1,216 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+
+#include "aot.h"
+#include "lmc.h"
+#include "lmc_internal.h"
+#include "util.h"
+
+static const char* const aot_op_names[] =
+{
+#define X(name) #name,
+    OPCODE_LIST
+#undef X
+};
+
+// Everything the generated code needs besides main(): INP and OUT with exactly the semantics
+// of lmc_io_read() and lmc_io_write(), and the way a run ends on an unknown opcode.
+static const char aot_runtime[] =
+    "#include <stdio.h>\n"
+    "\n"
+    "// Not every mailbox's label is a branch target, and not every program does I/O.\n"
+    "#if defined(_MSC_VER)\n"
+    "#pragma warning(disable: 4102 4505)\n"
+    "#elif defined(__GNUC__)\n"
+    "#pragma GCC diagnostic ignored \"-Wunused-label\"\n"
+    "#pragma GCC diagnostic ignored \"-Wunused-function\"\n"
+    "#endif\n"
+    "\n"
+    "// Read the first four characters of a line, skip the rest of it, and parse them the way\n"
+    "// atoi() would after a leading '-' has set the negative flag. This is what the\n"
+    "// interpreter's INP does, rather than the original fgets() into a 5-byte buffer.\n"
+    "static void lmc_read(short* acc, unsigned char* negative)\n"
+    "{\n"
+    "    char line[4];\n"
+    "    int length = 0;\n"
+    "    int c = EOF;\n"
+    "    fflush(stdout);\n"
+    "    while (length < (int)sizeof(line) && (c = getchar()) != EOF)\n"
+    "    {\n"
+    "        line[length++] = (char)c;\n"
+    "        if (c == '\\n')\n"
+    "            break;\n"
+    "    }\n"
+    "    while (c != '\\n' && c != EOF)\n"
+    "        c = getchar();\n"
+    "\n"
+    "    int i = 0;\n"
+    "    *negative = (length > 0 && line[0] == '-');\n"
+    "    i += *negative;\n"
+    "    while (i < length && (line[i] == ' ' || (line[i] >= '\\t' && line[i] <= '\\r')))\n"
+    "        i++;\n"
+    "    int minus = 0;\n"
+    "    if (i < length && (line[i] == '-' || line[i] == '+'))\n"
+    "        minus = (line[i++] == '-');\n"
+    "    int value = 0;\n"
+    "    for (; i < length && line[i] >= '0' && line[i] <= '9'; ++i)\n"
+    "        value = value * 10 + (line[i] - '0');\n"
+    "    *acc = (short)((minus) ? -value : value);\n"
+    "}\n"
+    "\n"
+    "static void lmc_write(short acc)\n"
+    "{\n"
+    "    printf(\"%d\\n\", acc);\n"
+    "}\n"
+    "\n"
+    "static int lmc_fail(int ir)\n"
+    "{\n"
+    "    printf(\"Unknown opcode %d\\n\", ir);\n"
+    "    return 1;\n"
+    "}\n"
+    "\n";
+
+// The reference interpreter, for programs that might modify their own code.
+static const char aot_interpreter[] =
+    "int main(void)\n"
+    "{\n"
+    "    unsigned char pc = 0;\n"
+    "    short acc = 0;\n"
+    "    unsigned char negative = 0;\n"
+    "    for (;;)\n"
+    "    {\n"
+    "        short data = pool[pc];\n"
+    "        pc = (pc + 1) % 100;\n"
+    "        int ir = data / 100 + ((data / 100 == 9) ? data % 100 - 1 : 0);\n"
+    "        unsigned char ar = (unsigned char)(data % 100);\n"
+    "        switch (ir)\n"
+    "        {\n"
+    "            case 0: return 0;\n"
+    "            case 1: negative = 0; acc = (short)((acc + pool[ar]) % 1000); break;\n"
+    "            case 2: negative = (acc < pool[ar]); acc = (short)((acc - pool[ar]) % 1000); break;\n"
+    "            case 3: pool[ar] = acc; break;\n"
+    "            case 5: negative = 0; acc = pool[ar]; break;\n"
+    "            case 6: pc = ar; break;\n"
+    "            case 7: if (acc == 0) pc = ar; break;\n"
+    "            case 8: if (!negative) pc = ar; break;\n"
+    "            case 9: lmc_read(&acc, &negative); break;\n"
+    "            case 10: lmc_write(acc); break;\n"
+    "            default: return lmc_fail(ir);\n"
+    "        }\n"
+    "    }\n"
+    "}\n";
+
+// Find the label defined at an address, if there is one.
+static const char* aot_label(const struct lmc_symbols* symbols, unsigned char address)
+{
+    for (size_t i = 0; symbols && i < symbols->count; ++i)
+    {
+        if (symbols->symbols[i].address == address)
+            return symbols->symbols[i].name;
+    }
+    return NULL;
+}
+
+// Write the C for the instruction in one mailbox, which falls through to the next mailbox's.
+static void aot_write_mailbox(FILE* out, const struct mailboxes* mailboxes,
+                              const struct lmc_symbols* symbols, unsigned char address)
+{
+    short data = mailboxes->pool[address];
+    struct lmc_insn insn = lmc_decode(data);
+    const char* label = aot_label(symbols, address);
+    if (insn.op == OP_COUNT || insn.op == DAT)
+        fprintf(out, "m%d: // %d%s%s\n", address, data, label ? ", " : "", label ? label : "");
+    else
+    {
+        fprintf(out, "m%d: // %s", address, aot_op_names[insn.op]);
+        if (insn.op != HLT && insn.op != INP && insn.op != OUT)
+            fprintf(out, " %d", insn.ar);
+        fprintf(out, "%s%s\n", label ? ", " : "", label ? label : "");
+    }
+
+    switch (insn.op)
+    {
+        case HLT:
+            fputs("    return 0;\n", out);
+            break;
+        case ADD:
+            fprintf(out, "    negative = 0;\n    acc = (short)((acc + pool[%d]) %% 1000);\n", insn.ar);
+            break;
+        case SUB:
+            fprintf(out, "    negative = (acc < pool[%d]);\n    acc = (short)((acc - pool[%d]) %% 1000);\n",
+                    insn.ar, insn.ar);
+            break;
+        case STA:
+            fprintf(out, "    pool[%d] = acc;\n", insn.ar);
+            break;
+        case LDA:
+            fprintf(out, "    negative = 0;\n    acc = pool[%d];\n", insn.ar);
+            break;
+        case BRA:
+            fprintf(out, "    goto m%d;\n", insn.ar);
+            break;
+        case BRZ:
+            fprintf(out, "    if (acc == 0)\n        goto m%d;\n", insn.ar);
+            break;
+        case BRP:
+            fprintf(out, "    if (!negative)\n        goto m%d;\n", insn.ar);
+            break;
+        case INP:
+            fputs("    lmc_read(&acc, &negative);\n", out);
+            break;
+        case OUT:
+            fputs("    lmc_write(acc);\n", out);
+            break;
+        default:
+            fprintf(out, "    return lmc_fail(%d);\n", lmc_decode_ir(data));
+            break;
+    }
+}
+
+// Write an assembled program as a C translation unit.
+void lmc_aot_write(FILE* out, const struct mailboxes* mailboxes, const struct lmc_symbols* symbols)
+{
+    bool immutable = lmc_code_immutable(mailboxes);
+    fprintf(out, "// Generated by lmcvm from an assembled LMC program%s.\n\n",
+            immutable ? "" : ", which may modify its own code and so is interpreted");
+    fputs(aot_runtime, out);
+
+    fputs("static short pool[100] =\n{", out);
+    for (int i = 0; i < NUM_MAILBOXES; ++i)
+        fprintf(out, "%s%d,", (i % 10 == 0) ? "\n    " : " ", mailboxes->pool[i]);
+    fputs("\n};\n\n", out);
+
+    if (!immutable)
+    {
+        fputs(aot_interpreter, out);
+        return;
+    }
+
+    // The program never stores into anything it executes, so every mailbox it can reach
+    // decodes the same way for the whole run.
+    fputs("int main(void)\n{\n    short acc = 0;\n    unsigned char negative = 0;\n\n", out);
+    for (int i = 0; i < NUM_MAILBOXES; ++i)
+        aot_write_mailbox(out, mailboxes, symbols, (unsigned char)i);
+    fputs("    goto m0;\n}\n", out);
+}
+
+// Write a program's C translation unit to a file.
+int lmc_aot_save(const char* path, const struct mailboxes* mailboxes,
+                 const struct lmc_symbols* symbols)
+{
+    FILE* file;
+    errno_t err = fopen_s(&file, path, "w");
+    if (err)
+        return err;
+    lmc_aot_write(file, mailboxes, symbols);
+    if (ferror(file))
+        err = errno ? errno : EIO;
+    if (fclose(file) != 0 && !err)
+        err = errno ? errno : EIO;
+    return err;
+}
@@ -0,0 +1,23 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <stdio.h>
+
+#include "lmc.h"
+
+// Ahead-of-time compilation of an assembled program to a standalone C translation unit,
+// which needs nothing beyond the C standard library and reads and writes stdin and stdout
+// the same way lmcvm does. A program that lmc_code_immutable() clears becomes straight-line
+// C with a label per mailbox, a goto per branch and the registers in locals, for the host
+// compiler to optimise as it sees fit. Any other program could rewrite its own code, so it
+// is embedded in a copy of the reference interpreter instead. Either way the result has no
+// step limit, like lmcvm without --max-steps. Symbols (which can be NULL) are only used to
+// annotate the generated code.
+void lmc_aot_write(FILE* out, const struct mailboxes* mailboxes, const struct lmc_symbols* symbols);
+
+// Write a program's C translation unit to a file, returning 0 or the errno value that caused
+// it to fail.
+int lmc_aot_save(const char* path, const struct mailboxes* mailboxes,
+                 const struct lmc_symbols* symbols);
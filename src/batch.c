@@ -0,0 +1,65 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "batch.h"
+#include "lmc.h"
+#include "thread.h"
+
+struct batch_context
+{
+    struct lmc_batch_job* jobs;
+    const struct lmc_exec* exec;
+};
+
+// Neither the assembler nor the engines keep any state outside of the mailboxes and the
+// execution settings they are handed, so each job only needs its own copy of both.
+static void batch_task(void* context, size_t index)
+{
+    struct batch_context* batch = (struct batch_context*)context;
+    struct lmc_batch_job* job = &batch->jobs[index];
+    struct lmc_exec exec = *batch->exec;
+
+    struct mailboxes mailboxes;
+    mailboxes.instream = job->instream;
+    mailboxes.outstream = job->outstream;
+
+    exec.steps = 0;
+    exec.status = LMC_STATUS_ERROR;
+    exec.io = NULL;         // Every job reads and writes its own streams.
+    exec.profile = NULL;    // A profile, a trace and the engines' scratch space can only
+    exec.trace = NULL;      // be used by one run at a time.
+    exec.fused = NULL;
+    exec.accel = NULL;
+    exec.suspend = NULL;    // Reading past the end of a job's input reads 0.
+    job->result = lmc_assemble(job->buffer, job->length, &mailboxes);
+    if (job->result)
+    {
+        exec.code_immutable = lmc_code_immutable(&mailboxes);
+        job->result = lmc_execute_ex(&mailboxes, &exec);
+    }
+    job->status = exec.status;
+    job->steps = exec.steps;
+    if (job->result)
+        job->error_msg[0] = '\0';
+    else
+        memcpy(job->error_msg, mailboxes.error_msg, sizeof(job->error_msg));
+    fflush(job->outstream);
+}
+
+// Assemble and execute every job in a batch on a pool of worker threads (one per hardware
+// thread if threads is 0), returning the number of jobs that failed.
+size_t lmc_batch_run(struct lmc_batch_job* jobs, size_t count, const struct lmc_exec* exec,
+                     unsigned int threads)
+{
+    struct batch_context batch = { jobs, exec };
+    thread_pool_run(count, threads, batch_task, &batch);
+
+    size_t failed = 0;
+    for (size_t i = 0; i < count; ++i)
+        failed += !jobs[i].result;
+    return failed;
+}
@@ -0,0 +1,31 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "lmc.h"
+
+// A single program in a batch. Every job has its own source buffer and I/O streams, and
+// receives its own result.
+struct lmc_batch_job
+{
+    const char* buffer;
+    size_t length;
+    FILE* instream;
+    FILE* outstream;
+
+    bool result;
+    enum lmc_status status;
+    unsigned long long steps;
+    char error_msg[NUM_MAILBOXES * 2];
+};
+
+// Assemble and execute every job in a batch on a pool of worker threads (one per hardware
+// thread if threads is 0), returning the number of jobs that failed. The jobs run with the
+// given settings, apart from the ones that only a single run can use: the I/O, profile,
+// trace, suspended registers and engine scratch space are left out.
+size_t lmc_batch_run(struct lmc_batch_job* jobs, size_t count, const struct lmc_exec* exec,
+                     unsigned int threads);
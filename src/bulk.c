@@ -0,0 +1,200 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bulk.h"
+#include "lmc.h"
+#include "object.h"
+#include "perf.h"
+#include "source.h"
+#include "thread.h"
+#include "util.h"
+
+struct bulk_file
+{
+    const char* path;
+    bool readable;
+    struct lmc_object_source identity;
+
+    // Files whose source has the same hash and length as this one, if this is the first of
+    // them. They are only written this one's image once their bytes are found to match.
+    struct bulk_file* next_copy;
+
+    bool assembled;     // Whether this file's source was assembled, rather than copied.
+    bool result;
+    char error_msg[NUM_MAILBOXES * 2];
+};
+
+struct bulk_context
+{
+    struct bulk_file* files;
+    struct bulk_file** uniques;
+    struct lmc_assembler* assemblers;   // One for each worker.
+};
+
+// Where the image for a source file goes.
+static void bulk_image_path(char* out, size_t size, const char* path)
+{
+    size_t length = strlen(path);
+    if (length >= 4 && util_strncasecmp(&path[length - 4], ".lmc", 4) == 0)
+        snprintf(out, size, "%.*s.lmo", (int)(length - 4), path);
+    else
+        snprintf(out, size, "%s.lmo", path);
+}
+
+// Hash a file's source. Files are only mapped for as long as a task needs them, so that a
+// bulk assembly never holds more than one mapping per worker.
+static void bulk_hash_task(void* context, size_t index)
+{
+    struct bulk_file* file = &((struct bulk_context*)context)->files[index];
+    struct source source;
+    file->readable = source_open(&source, file->path);
+    if (!file->readable)
+    {
+        strcpy_s(file->error_msg, sizeof(file->error_msg), "Could not read file");
+        return;
+    }
+    file->identity.hash = lmc_source_hash(source.buffer, source.length);
+    file->identity.length = source.length;
+    source_close(&source);
+}
+
+// Write the image of a source for one file, or say why it could not be.
+static void bulk_write(struct bulk_file* file, const struct mailboxes* mailboxes,
+                       const struct lmc_symbols* symbols, const struct lmc_object_source* identity)
+{
+    char image_path[4096];
+    bulk_image_path(image_path, sizeof(image_path), file->path);
+    int err = lmc_object_save(image_path, mailboxes, symbols, identity);
+    file->result = (err == 0);
+    if (err)
+    {
+        // Paths can be longer than the message, so only as much of one as fits is kept.
+        snprintf(file->error_msg, sizeof(file->error_msg), "Could not write \"%.*s\": %s",
+                 (int)min(strlen(image_path), sizeof(file->error_msg) / 2), image_path,
+                 strerror(err));
+    }
+}
+
+// Assemble a unique source, and write its image for it and every copy of it. Every file that
+// was grouped with it is mapped and compared with it byte for byte first, since a matching
+// hash and length does not prove that two sources are the same: any that differ are grouped
+// again, and assembled in turn once this group is done.
+static void bulk_assemble_task(void* context, size_t index, unsigned int worker)
+{
+    struct bulk_context* bulk = (struct bulk_context*)context;
+    struct lmc_assembler* assembler = &bulk->assemblers[worker];
+    for (struct bulk_file* first = bulk->uniques[index]; first;)
+    {
+        struct source source;
+        struct mailboxes mailboxes;
+        bool opened = source_open(&source, first->path);
+        first->assembled = true;
+        bool result = opened && lmc_assemble_ex(assembler, source.buffer, source.length, &mailboxes);
+        if (!opened)
+            strcpy_s(mailboxes.error_msg, sizeof(mailboxes.error_msg), "Could not read file");
+
+        struct bulk_file* rest = NULL;
+        struct bulk_file** rest_tail = &rest;
+        struct bulk_file* next;
+        for (struct bulk_file* file = first; file; file = next)
+        {
+            next = file->next_copy;
+            file->next_copy = NULL;
+            if (file != first)
+            {
+                struct source copy;
+                bool same = opened && source_open(&copy, file->path);
+                if (same)
+                {
+                    same = copy.length == source.length &&
+                           memcmp(copy.buffer, source.buffer, source.length) == 0;
+                    source_close(&copy);
+                }
+                if (!same)
+                {
+                    *rest_tail = file;
+                    rest_tail = &file->next_copy;
+                    continue;
+                }
+            }
+
+            if (result)
+                bulk_write(file, &mailboxes, &assembler->symbols, &first->identity);
+            else
+            {
+                file->result = false;
+                memcpy(file->error_msg, mailboxes.error_msg, sizeof(file->error_msg));
+            }
+        }
+        source_close(&source);
+        first = rest;
+    }
+}
+
+size_t lmc_bulk_assemble(char** paths, size_t count, unsigned int threads)
+{
+    double start = lmc_perf_now();
+    struct bulk_file* files = (struct bulk_file*)quick_calloc(max(count, 1), sizeof(struct bulk_file));
+    for (size_t i = 0; i < count; ++i)
+        files[i].path = paths[i];
+    struct bulk_context context = { files, NULL, NULL };
+    thread_pool_run(count, threads, bulk_hash_task, &context);
+
+    // Group the files by their source's hash and length, the same identity that the object
+    // cache trusts, in an open-addressed table of the first file with each. The groups are
+    // only candidates: each file's source is compared with the first's before it shares its
+    // image.
+    size_t capacity = 16;
+    while (capacity < count * 2)
+        capacity *= 2;
+    struct bulk_file** table = (struct bulk_file**)quick_calloc(capacity, sizeof(struct bulk_file*));
+    context.uniques = (struct bulk_file**)quick_calloc(max(count, 1), sizeof(struct bulk_file*));
+    size_t unique = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        struct bulk_file* file = &files[i];
+        if (!file->readable)
+            continue;
+
+        size_t slot = (size_t)(file->identity.hash ^ (file->identity.hash >> 32)) & (capacity - 1);
+        while (table[slot] && (table[slot]->identity.hash != file->identity.hash ||
+                               table[slot]->identity.length != file->identity.length))
+            slot = (slot + 1) & (capacity - 1);
+        if (table[slot])
+        {
+            file->next_copy = table[slot]->next_copy;
+            table[slot]->next_copy = file;
+        }
+        else
+            table[slot] = context.uniques[unique++] = file;
+    }
+    free(table);
+
+    unsigned int workers = thread_pool_size(unique, threads);
+    context.assemblers = (struct lmc_assembler*)quick_malloc(workers * sizeof(struct lmc_assembler));
+    thread_pool_run_indexed(unique, threads, bulk_assemble_task, &context);
+    free(context.assemblers);
+    double seconds = lmc_perf_now() - start;
+
+    size_t failed = 0;
+    unique = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        unique += files[i].assembled;
+        if (files[i].result)
+            continue;
+        printf("%s: %s\n", files[i].path, files[i].error_msg);
+        failed++;
+    }
+    printf("%zu files (%zu unique), %zu failed, in %.3f s (%.0f files/s)\n", count, unique, failed,
+           seconds, (seconds > 0) ? count / seconds : 0.0);
+
+    free(context.uniques);
+    free(files);
+    return failed;
+}
@@ -0,0 +1,14 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <stddef.h>
+
+// Assemble a whole directory's worth of programs at once, writing an object image next to
+// each one ("prog.lmc" becomes "prog.lmo", and anything else gets ".lmo" added) and printing
+// the error for every program that fails to assemble. Sources are hashed first, so that
+// byte-identical copies of a program are only assembled once, and both the hashing and the
+// assembly are spread over a pool of worker threads (one per hardware thread if threads is
+// 0). Returns the number of programs that could not be read or assembled.
+size_t lmc_bulk_assemble(char** paths, size_t count, unsigned int threads);
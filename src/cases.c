@@ -0,0 +1,71 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "cases.h"
+#include "io.h"
+#include "lmc.h"
+#include "thread.h"
+#include "util.h"
+
+struct cases_context
+{
+    const struct mailboxes* image;
+    struct lmc_case* cases;
+    const struct lmc_exec* exec;
+};
+
+// Output is checked as it is written rather than kept, so the output buffer only has to be
+// big enough for lmc_io to have somewhere to put it.
+#define CASES_OUTPUT_SIZE   64
+
+static void cases_task(void* context, size_t index)
+{
+    struct cases_context* run = (struct cases_context*)context;
+    struct lmc_case* test = &run->cases[index];
+    struct lmc_exec exec = *run->exec;
+    struct mailboxes mailboxes = *run->image;
+
+    char output[CASES_OUTPUT_SIZE];
+    struct lmc_io io;
+    lmc_io_init_memory(&io, test->input, test->input_length, output, sizeof(output));
+    lmc_io_expect(&io, test->expected, test->expected_count);
+    exec.io = &io;
+    exec.profile = NULL;    // A profile, a trace and the engines' scratch space can only
+    exec.trace = NULL;      // be used by one run at a time.
+    exec.fused = NULL;
+    exec.accel = NULL;
+    exec.suspend = NULL;    // Reading past the end of a case's input reads 0.
+
+    bool result = lmc_execute_ex(&mailboxes, &exec);
+    test->status = exec.status;
+    test->steps = exec.steps;
+    test->matched = io.out_values;
+    test->passed = result && exec.status == LMC_STATUS_HALTED &&
+                   io.out_values == test->expected_count;
+    if (test->passed)
+        test->error_msg[0] = '\0';
+    else if (!result)
+        memcpy(test->error_msg, mailboxes.error_msg, sizeof(test->error_msg));
+    else if (exec.status == LMC_STATUS_HALTED)
+        sprintf_s(test->error_msg, sizeof(test->error_msg),
+                  "Halted after %zu of %zu outputs", io.out_values, test->expected_count);
+    else
+        strcpy_s(test->error_msg, sizeof(test->error_msg), "Did not halt");
+}
+
+// Run one assembled program against every test case.
+size_t lmc_cases_run(const struct mailboxes* image, struct lmc_case* cases, size_t count,
+                     const struct lmc_exec* exec, unsigned int threads)
+{
+    struct cases_context run = { image, cases, exec };
+    thread_pool_run(count, threads, cases_task, &run);
+
+    size_t failed = 0;
+    for (size_t i = 0; i < count; ++i)
+        failed += !cases[i].passed;
+    return failed;
+}
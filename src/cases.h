@@ -0,0 +1,34 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "lmc.h"
+
+// One test case for a program: the input for INP, the values OUT is expected to write, and
+// what running the program on them came to. A case passes when the program halts having
+// written exactly the expected values, in order.
+struct lmc_case
+{
+    const char* input;          // One value per line, as read from a stream.
+    size_t input_length;
+    const short* expected;
+    size_t expected_count;
+
+    bool passed;
+    enum lmc_status status;
+    unsigned long long steps;
+    size_t matched;             // How many of the expected values were written.
+    char error_msg[NUM_MAILBOXES * 2];
+};
+
+// Run one assembled program against every test case on a pool of worker threads (one per
+// hardware thread if threads is 0), returning the number of cases that failed. Every case
+// starts from its own copy of the image, and ends as soon as the program writes a value it
+// should not have, rather than running to completion. As with lmc_batch_run(), the settings
+// that only a single run can use are left out.
+size_t lmc_cases_run(const struct mailboxes* image, struct lmc_case* cases, size_t count,
+                     const struct lmc_exec* exec, unsigned int threads);
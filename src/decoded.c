@@ -0,0 +1,141 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "io.h"
+#include "lmc.h"
+#include "lmc_internal.h"
+#include "util.h"
+
+// Execute an assembled LMC program from a pre-decoded copy of the pool. Every mailbox is
+// decoded once up front into an (opcode, operand) record, so the hot loop never has to
+// divide. STA only marks the record of the mailbox it overwrites as stale, which is then
+// decoded again the next time it is fetched, so self-modifying programs behave exactly
+// like they do under lmc_execute(). Code-immutable programs skip even that. Every variant is
+// instantiated once per accumulator convention, too.
+static LMC_FORCEINLINE bool execute_decoded(struct mailboxes* mailboxes, struct lmc_exec* exec,
+                                            const struct lmc_regs* start, const bool limited,
+                                            const bool immutable, const enum lmc_arith arith)
+{
+    struct lmc_insn code[NUM_MAILBOXES];
+    for (int i = 0; i < NUM_MAILBOXES; ++i)
+        code[i] = lmc_decode(mailboxes->pool[i]);
+
+    // LMC registers. See lmc_execute() for why there is a negative flag.
+    unsigned char pc = start->pc;
+    short acc = start->acc;
+    bool negative = start->negative;
+
+    unsigned long long steps = start->steps;
+    for (;;)
+    {
+        if (limited && steps == exec->max_steps)
+            return lmc_fail_step_limit(mailboxes, exec);
+        steps++;
+
+        // Fetch the pre-decoded opcode from the current mailbox.
+        unsigned char at = pc;
+        struct lmc_insn insn = code[at];
+        pc = (at == NUM_MAILBOXES - 1) ? 0 : at + 1;
+
+    dispatch:
+        switch (insn.op)
+        {
+            case HLT:
+                return lmc_halt(exec, steps);
+            case ADD:
+            {
+                lmc_arith_add(arith, &acc, &negative, mailboxes->pool[insn.ar]);
+                break;
+            }
+            case SUB:
+            {
+                lmc_arith_sub(arith, &acc, &negative, mailboxes->pool[insn.ar]);
+                break;
+            }
+            case STA:
+            {
+                mailboxes->pool[insn.ar] = acc;
+                if (!immutable)
+                    code[insn.ar].op = OP_NULL;
+                break;
+            }
+            case LDA:
+            {
+                negative = false;
+                acc = mailboxes->pool[insn.ar];
+                break;
+            }
+            case BRA:
+            {
+                pc = insn.ar;
+                break;
+            }
+            case BRZ:
+            {
+                if (acc == 0)
+                    pc = insn.ar;
+                break;
+            }
+            case BRP:
+            {
+                if (lmc_arith_positive(arith, acc, negative))
+                    pc = insn.ar;
+                break;
+            }
+            case INP:
+            {
+                if (lmc_input_blocked(exec))
+                    return lmc_suspend(exec, at, acc, negative, steps - 1);
+                lmc_io_read(exec->io, &acc, &negative);
+                lmc_arith_input(arith, &acc, &negative);
+                break;
+            }
+            case OUT:
+            {
+                if (!lmc_io_write(exec->io, acc))
+                    return lmc_mismatch(mailboxes, exec, steps);
+                break;
+            }
+            case OP_NULL:
+            {
+                // The mailbox has been overwritten since it was decoded, so decode it
+                // again and retry.
+                insn = code[at] = lmc_decode(mailboxes->pool[at]);
+                goto dispatch;
+            }
+            default:
+                return lmc_fail_opcode(mailboxes, exec, steps, lmc_decode_ir(mailboxes->pool[at]));
+        }
+    }
+}
+
+#define X(name, string)                                                                         \
+    static LMC_FORCEINLINE bool execute_decoded_##name(struct mailboxes* mailboxes,             \
+                                                       struct lmc_exec* exec,                   \
+                                                       const struct lmc_regs* start,            \
+                                                       const bool limited, const bool immutable) \
+    {                                                                                           \
+        return execute_decoded(mailboxes, exec, start, limited, immutable, LMC_ARITH_##name);   \
+    }                                                                                           \
+    LMC_ENGINE_GUARDED_VARIANTS(execute_decoded_##name)
+LMC_ARITH_LIST
+#undef X
+
+bool lmc_execute_decoded(struct mailboxes* mailboxes, struct lmc_exec* exec,
+                         const struct lmc_regs* start)
+{
+    switch (exec->arith)
+    {
+#define X(name, string)                                                                     \
+        case LMC_ARITH_##name:                                                              \
+            return LMC_ENGINE_GUARDED_RUN(execute_decoded_##name, mailboxes, exec, start);
+        LMC_ARITH_LIST
+#undef X
+        default:
+            return LMC_ENGINE_GUARDED_RUN(execute_decoded_FLAG, mailboxes, exec, start);
+    }
+}
@@ -0,0 +1,421 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+
+#include "extended.h"
+#include "io.h"
+#include "lmc.h"
+#include "lmc_internal.h"
+#include "util.h"
+
+// A pre-decoded cell, the same as struct lmc_insn but with room for a wider address.
+struct lmc_ext_insn
+{
+    unsigned char op;
+    unsigned int ar;
+};
+
+// Decode the instruction register from a cell, the same way as lmc_decode_ir() does for a
+// mailbox.
+static inline int ext_decode_ir(const struct lmc_ext* ext, int data)
+{
+    int cells = (int)ext->cells;
+    return data / cells + ((data / cells == INP) ? data % cells - 1 : 0);
+}
+
+static inline struct lmc_ext_insn ext_decode(const struct lmc_ext* ext, int data)
+{
+    int ir = ext_decode_ir(ext, data);
+    struct lmc_ext_insn insn;
+    insn.op = (ir >= HLT && ir <= OUT) ? ir : OP_COUNT;
+    insn.ar = (data < 0) ? 0 : (unsigned int)data % ext->cells;
+    return insn;
+}
+
+// Create a machine with the given number of cells.
+struct lmc_ext* lmc_ext_create(unsigned int cells)
+{
+    // A line of input holds a sign and one digit more than an address.
+    unsigned int width = 4;
+    unsigned int power = LMC_EXT_MIN_CELLS;
+    while (power < cells && power < LMC_EXT_MAX_CELLS)
+    {
+        power *= 10;
+        width++;
+    }
+    if (power != cells)
+        return NULL;
+
+    struct lmc_ext* ext = (struct lmc_ext*)quick_malloc(sizeof(struct lmc_ext));
+    ext->cells = cells;
+    ext->width = width;
+    ext->pool = (int*)quick_calloc(cells, sizeof(int));
+    ext->code = (struct lmc_ext_insn*)quick_calloc(cells, sizeof(struct lmc_ext_insn));
+    ext->instream = stdin;
+    ext->outstream = stdout;
+    return ext;
+}
+
+// Free a machine.
+void lmc_ext_destroy(struct lmc_ext* ext)
+{
+    free(ext->code);
+    free(ext->pool);
+    free(ext);
+}
+
+// A token of the source, along with where it is for error messages.
+struct ext_token
+{
+    const char* string;
+    size_t length;
+    size_t line;
+    size_t column;
+};
+
+// An instruction from the first pass, whose operand may still be a label.
+struct ext_node
+{
+    int op;                     // The opcode, or the first digit of a DAT.
+    long operand;               // The address (or rest of a DAT), or -1 for none.
+    struct ext_token label;     // The label used as the operand, if there is one.
+};
+
+// Labels are kept in an open-addressed hash table keyed case-insensitively on their name,
+// which has at least twice as many slots as the source has lines so that it never fills up.
+struct ext_label
+{
+    struct ext_token name;
+    unsigned int address;
+};
+
+static unsigned int ext_label_hash(const struct ext_token* name)
+{
+    // FNV-1a over the upper-cased name.
+    unsigned int hash = 2166136261u;
+    for (size_t i = 0; i < name->length; i++)
+        hash = (hash ^ (unsigned char)toupper(name->string[i])) * 16777619u;
+    return hash;
+}
+
+// Find the slot holding a label, or the empty slot where it would go.
+static struct ext_label* ext_label_lookup(struct ext_label* table, size_t mask,
+                                          const struct ext_token* name)
+{
+    size_t slot = ext_label_hash(name) & mask;
+    for (;;)
+    {
+        struct ext_label* entry = &table[slot];
+        if (entry->name.string == NULL)
+            return entry;
+        if (entry->name.length == name->length &&
+            util_strncasecmp(entry->name.string, name->string, name->length) == 0)
+            return entry;
+        slot = (slot + 1) & mask;
+    }
+}
+
+// Parse the leading digits of a token, saturating rather than overflowing.
+static long ext_token_number(const struct ext_token* token)
+{
+    long value = 0;
+    for (size_t i = 0; i < token->length && isdigit(token->string[i]); i++)
+    {
+        int digit = token->string[i] - '0';
+        if (value > (LONG_MAX - digit) / 10)
+            return LONG_MAX;
+        value = value * 10 + digit;
+    }
+    return value;
+}
+
+// Assemble a program into the machine. The first pass goes through the source a line at a
+// time, defining labels as it goes, and the second resolves the labels used as operands with
+// one lookup each.
+bool lmc_ext_assemble(struct lmc_ext* ext, const char* buffer, size_t length)
+{
+    memset(ext->pool, 0, ext->cells * sizeof(int));
+    const char* end = buffer + length;
+
+    // There can be no more instructions than lines, or than cells.
+    size_t lines = 1;
+    for (const char* cursor = buffer; (cursor = memchr(cursor, '\n', end - cursor)) != NULL; cursor++)
+        lines++;
+    size_t capacity = min(lines, (size_t)ext->cells);
+    size_t table_size = 1;
+    while (table_size < capacity * 2)
+        table_size <<= 1;
+    struct ext_node* nodes = (struct ext_node*)quick_calloc(capacity, sizeof(struct ext_node));
+    struct ext_label* labels = (struct ext_label*)quick_calloc(table_size, sizeof(struct ext_label));
+
+    struct ext_token erroneous_token;
+    size_t count = 0;
+    size_t line = 1;
+    for (const char* cursor = buffer; cursor < end; line++)
+    {
+        // The rest of a line after a semicolon is a comment.
+        const char* eol = memchr(cursor, '\n', end - cursor);
+        if (eol == NULL)
+            eol = end;
+        const char* stop = memchr(cursor, ';', eol - cursor);
+        if (stop == NULL)
+            stop = eol;
+
+        struct ext_node node = { .op = OP_NULL, .operand = -1 };
+        struct ext_token label = { NULL };
+        for (const char* p = cursor; p < stop;)
+        {
+            while (p < stop && lmc_lex_isspace(*p))
+                p++;
+            if (p == stop)
+                break;
+            struct ext_token token = { p, 0, line, (size_t)(p - cursor) + 1 };
+            p = buffer + lmc_lex_token_end(buffer, p - buffer, stop - buffer);
+            token.length = p - token.string;
+
+            // An opcode?
+            enum opcode op = (node.op == OP_NULL && token.length == 3)
+                           ? lmc_lex_opcode(token.string)
+                           : OP_COUNT;
+            if (op != OP_COUNT)
+            {
+                // INP and OUT share the opcode 9, and are told apart by their address.
+                node.op = min(op, INP);
+                if (node.op == INP)
+                    node.operand = op - BRP;
+                continue;
+            }
+
+            // A label being defined?
+            if (label.string == NULL && node.op == OP_NULL && isalpha(token.string[0]))
+            {
+                struct ext_label* entry = ext_label_lookup(labels, table_size - 1, &token);
+                if (entry->name.string != NULL)
+                {
+                    sprintf_s(ext->error_msg, sizeof(ext->error_msg),
+                              "Duplicate label on line %d:%d: ", (int)token.line, (int)token.column);
+                    strncat_s(ext->error_msg, sizeof(ext->error_msg), token.string, token.length);
+                    goto compiler_fail;
+                }
+                entry->name = token;
+                entry->address = (unsigned int)count;
+                label = token;
+                continue;
+            }
+
+            // The operand?
+            if (node.op != OP_NULL && node.operand == -1 && node.label.string == NULL)
+            {
+                if (isdigit(token.string[0]))
+                {
+                    long number = ext_token_number(&token);
+                    if (node.op == DAT)
+                        node.op = (int)((number / ext->cells) % 10);
+                    node.operand = number % ext->cells;
+                }
+                else
+                    node.label = token;
+                continue;
+            }
+
+            // Something went wrong.
+            erroneous_token = token;
+            goto lexer_fail;
+        }
+
+        if (node.op != OP_NULL)
+        {
+            if (count == ext->cells)
+            {
+                strcpy_s(ext->error_msg, sizeof(ext->error_msg), "Program is too large");
+                goto compiler_fail;
+            }
+            nodes[count++] = node;
+        }
+        else if (label.string != NULL)
+        {
+            erroneous_token = label;
+            goto lexer_fail;
+        }
+        cursor = eol + 1;
+    }
+
+    // Fill in the cells, resolving any labels.
+    for (size_t address = 0; address < count; address++)
+    {
+        const struct ext_node* node = &nodes[address];
+        long operand = node->operand;
+        if (node->label.string != NULL)
+        {
+            const struct ext_label* entry = ext_label_lookup(labels, table_size - 1, &node->label);
+            if (entry->name.string == NULL)
+            {
+                erroneous_token = node->label;
+                goto lexer_fail;
+            }
+            operand = entry->address;
+        }
+        ext->pool[address] = node->op * (int)ext->cells + (int)max(operand, 0);
+    }
+
+    free(labels);
+    free(nodes);
+    return true;
+
+lexer_fail:
+    sprintf_s(ext->error_msg, sizeof(ext->error_msg), "Unknown token on line %d:%d: ",
+              (int)erroneous_token.line, (int)erroneous_token.column);
+    strncat_s(ext->error_msg, sizeof(ext->error_msg), erroneous_token.string,
+              erroneous_token.length);
+compiler_fail:
+    free(labels);
+    free(nodes);
+    return false;
+}
+
+// Execute the program in the machine, from a pre-decoded copy of its cells in the same way as
+// the decoded engine does, so that no instruction has to divide, however wide the words are.
+static LMC_FORCEINLINE bool ext_execute(struct lmc_ext* ext, struct lmc_exec* exec,
+                                        const bool limited)
+{
+    int* pool = ext->pool;
+    struct lmc_ext_insn* code = ext->code;
+    const unsigned int last = ext->cells - 1;
+    const int modulus = 10 * (int)ext->cells;
+    for (unsigned int i = 0; i <= last; ++i)
+        code[i] = ext_decode(ext, pool[i]);
+
+    // LMC registers. See lmc_execute() for why there is a negative flag.
+    unsigned int pc = 0;
+    int acc = 0;
+    bool negative = false;
+
+    unsigned long long steps = 0;
+    for (;;)
+    {
+        if (limited && steps == exec->max_steps)
+        {
+            lmc_io_flush(exec->io);
+            exec->steps = steps;
+            exec->status = LMC_STATUS_STEP_LIMIT;
+            sprintf_s(ext->error_msg, sizeof(ext->error_msg),
+                      "Step limit of %llu instructions exceeded", exec->max_steps);
+            return false;
+        }
+        steps++;
+
+        // Fetch the pre-decoded opcode from the current cell.
+        unsigned int at = pc;
+        struct lmc_ext_insn insn = code[at];
+        pc = (at == last) ? 0 : at + 1;
+
+    dispatch:
+        switch (insn.op)
+        {
+            case HLT:
+                return lmc_halt(exec, steps);
+            case ADD:
+            {
+                negative = false;
+                acc = (acc + pool[insn.ar]) % modulus;
+                break;
+            }
+            case SUB:
+            {
+                negative = (acc < pool[insn.ar]);
+                acc = (acc - pool[insn.ar]) % modulus;
+                break;
+            }
+            case STA:
+            {
+                pool[insn.ar] = acc;
+                code[insn.ar].op = OP_NULL;
+                break;
+            }
+            case LDA:
+            {
+                negative = false;
+                acc = pool[insn.ar];
+                break;
+            }
+            case BRA:
+            {
+                pc = insn.ar;
+                break;
+            }
+            case BRZ:
+            {
+                if (acc == 0)
+                    pc = insn.ar;
+                break;
+            }
+            case BRP:
+            {
+                if (!negative)
+                    pc = insn.ar;
+                break;
+            }
+            case INP:
+            {
+                lmc_io_read_wide(exec->io, &acc, &negative, ext->width);
+                break;
+            }
+            case OUT:
+            {
+                lmc_io_write_wide(exec->io, acc);
+                break;
+            }
+            case OP_NULL:
+            {
+                // The cell has been overwritten since it was decoded, so decode it again
+                // and retry.
+                insn = code[at] = ext_decode(ext, pool[at]);
+                goto dispatch;
+            }
+            default:
+            {
+                lmc_io_flush(exec->io);
+                exec->steps = steps;
+                exec->status = LMC_STATUS_ERROR;
+                sprintf_s(ext->error_msg, sizeof(ext->error_msg), "Unknown opcode %d",
+                          ext_decode_ir(ext, pool[at]));
+                return false;
+            }
+        }
+    }
+}
+
+static bool ext_execute_unlimited(struct lmc_ext* ext, struct lmc_exec* exec)
+{
+    return ext_execute(ext, exec, false);
+}
+
+static bool ext_execute_limited(struct lmc_ext* ext, struct lmc_exec* exec)
+{
+    return ext_execute(ext, exec, true);
+}
+
+// Execute the program in the machine.
+bool lmc_ext_execute(struct lmc_ext* ext, struct lmc_exec* exec)
+{
+    // Without any I/O to use, buffer the machine's own streams for the length of the run.
+    struct lmc_io stream_io;
+    bool own_io = (exec->io == NULL);
+    if (own_io)
+    {
+        lmc_io_init_streams(&stream_io, ext->instream, ext->outstream);
+        exec->io = &stream_io;
+    }
+
+    bool result = (exec->max_steps) ? ext_execute_limited(ext, exec) : ext_execute_unlimited(ext, exec);
+
+    if (own_io)
+        exec->io = NULL;
+    return result;
+}
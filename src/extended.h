@@ -0,0 +1,52 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "lmc.h"
+
+// An extended-memory LMC, for programs that need more than NUM_MAILBOXES mailboxes. Its
+// memory holds a power of ten from LMC_EXT_MIN_CELLS to LMC_EXT_MAX_CELLS cells, and is
+// allocated to that size. Words are one digit wider than an address: each is the opcode times
+// the number of cells plus the address, so with 1,000 cells 1234 is ADD 234, and INP and OUT
+// are 9001 and 9002. The accumulator wraps at ten times the number of cells, and keeps the
+// same negative flag as lmc_execute() does. With 100 cells, the machine behaves exactly like
+// the standard one.
+#define LMC_EXT_MIN_CELLS   100
+#define LMC_EXT_MAX_CELLS   1000000
+
+struct lmc_ext_insn;
+
+struct lmc_ext
+{
+    unsigned int cells;
+    unsigned int width;         // Characters in a line of input: the digits of a word, and a sign.
+    int* pool;
+    struct lmc_ext_insn* code;  // Each cell pre-decoded, for lmc_ext_execute().
+    char error_msg[NUM_MAILBOXES * 2];
+
+    FILE* instream;
+    FILE* outstream;
+};
+
+// Create a machine with the given number of cells, which is cleared to zero. Returns NULL if
+// the number of cells is not a power of ten within range.
+struct lmc_ext* lmc_ext_create(unsigned int cells);
+
+// Free a machine.
+void lmc_ext_destroy(struct lmc_ext* ext);
+
+// Assemble a program into the machine, with the same syntax as lmc_assemble(). Both passes
+// take time linear in the length of the source, however many cells there are. On failure,
+// error_msg says why, with the line and column within the source.
+bool lmc_ext_assemble(struct lmc_ext* ext, const char* buffer, size_t length);
+
+// Execute the program in the machine. Every instruction takes constant time, whatever the
+// size of the memory. Of the execution settings, only the I/O and the step limit apply;
+// extended runs always use their own interpreter, with the flag arithmetic of
+// LMC_ARITH_FLAG, and are never profiled, traced, accelerated or suspended.
+bool lmc_ext_execute(struct lmc_ext* ext, struct lmc_exec* exec);
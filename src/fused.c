@@ -0,0 +1,404 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "io.h"
+#include "lmc.h"
+#include "lmc_internal.h"
+#include "util.h"
+
+// Superinstructions, each standing in for a common sequence of instructions and executed in
+// a single dispatch, along with how many instructions they stand in for.
+#define FUSED_LIST                  \
+    X(LDA_ADD_STA,       3)         \
+    X(LDA_ADD_STA_BRA,   4)         \
+    X(LDA_SUB_STA,       3)         \
+    X(LDA_SUB_STA_BRZ,   4)         \
+    X(LDA_SUB_STA_BRP,   4)         \
+    X(LDA_BRZ,           2)         \
+    X(LDA_STA,           2)         \
+    X(ADD_STA,           2)         \
+    X(SUB_STA,           2)         \
+    X(SUB_BRZ,           2)         \
+    X(SUB_BRP,           2)         \
+    X(INP_STA,           2)
+
+// Superinstructions are numbered after the ordinary opcodes, so that one record type (and
+// one switch) covers both.
+enum fused_op
+{
+    FUSED_FIRST = OP_NULL,
+#define X(name, length) FUSED_##name,
+    FUSED_LIST
+#undef X
+};
+
+static const unsigned char fused_lengths[] =
+{
+#define X(name, length) length,
+    FUSED_LIST
+#undef X
+};
+
+static struct fused_insn fused_plain(struct lmc_insn insn)
+{
+    struct fused_insn fused = { .op = insn.op, .x = insn.ar };
+    return fused;
+}
+
+static struct fused_insn fused_single(short data)
+{
+    return fused_plain(lmc_decode(data));
+}
+
+// Try to fuse the instructions starting at a mailbox. A superinstruction never extends
+// over a branch target (so that jumping into the middle of it doesn't need any special
+// handling beyond the plain instructions that are still decoded there), never wraps around
+// the end of the pool, and never stores into itself.
+static bool fuse(const struct lmc_insn* plain, const bool* targets, int at, struct fused_insn* out)
+{
+    static const unsigned char patterns[][4] =
+    {
+        // Longest first, so that the longest match wins.
+        { LDA, ADD, STA, BRA },
+        { LDA, SUB, STA, BRZ },
+        { LDA, SUB, STA, BRP },
+        { LDA, ADD, STA, OP_NULL },
+        { LDA, SUB, STA, OP_NULL },
+        { LDA, BRZ, OP_NULL },
+        { LDA, STA, OP_NULL },
+        { ADD, STA, OP_NULL },
+        { SUB, STA, OP_NULL },
+        { SUB, BRZ, OP_NULL },
+        { SUB, BRP, OP_NULL },
+        { INP, STA, OP_NULL },
+    };
+    static const unsigned char pattern_ops[] =
+    {
+        FUSED_LDA_ADD_STA_BRA, FUSED_LDA_SUB_STA_BRZ, FUSED_LDA_SUB_STA_BRP, FUSED_LDA_ADD_STA,
+        FUSED_LDA_SUB_STA, FUSED_LDA_BRZ, FUSED_LDA_STA, FUSED_ADD_STA, FUSED_SUB_STA,
+        FUSED_SUB_BRZ, FUSED_SUB_BRP, FUSED_INP_STA,
+    };
+
+    int first = plain[at].op;
+    if (first != LDA && first != ADD && first != SUB && first != INP)
+        return false;
+    for (size_t p = 0; p < sizeof(pattern_ops); ++p)
+    {
+        int length = fused_lengths[pattern_ops[p] - FUSED_FIRST - 1];
+        if (at + length > NUM_MAILBOXES)
+            continue;
+
+        bool match = true;
+        for (int i = 0; i < length && match; ++i)
+        {
+            const struct lmc_insn* insn = &plain[at + i];
+            match = (insn->op == patterns[p][i]) && (i == 0 || !targets[at + i]);
+            if (insn->op == STA && insn->ar >= at && insn->ar < at + length)
+                match = false;
+        }
+        if (!match)
+            continue;
+
+        // Gather the memory operands, followed by the branch target, if there is one.
+        struct fused_insn fused = { .op = pattern_ops[p] };
+        unsigned char* operand = &fused.x;
+        for (int i = 0; i < length; ++i)
+        {
+            const struct lmc_insn* insn = &plain[at + i];
+            if (insn->op == BRA || insn->op == BRZ || insn->op == BRP)
+                fused.t = insn->ar;
+            else if (insn->op != INP)
+                *operand++ = insn->ar;
+        }
+        fused.next = (at + length) % NUM_MAILBOXES;
+        *out = fused;
+        return true;
+    }
+    return false;
+}
+
+// Build the fused code for the mailboxes of a run starting from entry.
+static void fused_build(struct lmc_fused* fused, const struct mailboxes* mailboxes,
+                        unsigned char entry)
+{
+    struct lmc_insn plain[NUM_MAILBOXES];
+    bool targets[NUM_MAILBOXES] = { false };
+    for (int i = 0; i < NUM_MAILBOXES; ++i)
+    {
+        plain[i] = lmc_decode(mailboxes->pool[i]);
+        if (plain[i].op == BRA || plain[i].op == BRZ || plain[i].op == BRP)
+            targets[plain[i].ar] = true;
+    }
+    targets[entry] = true;
+
+    for (int i = 0; i < NUM_MAILBOXES; ++i)
+    {
+        fused->head[i] = (unsigned char)i;
+        fused->code[i] = fused_plain(plain[i]);
+    }
+    for (int i = 0; i < NUM_MAILBOXES; ++i)
+    {
+        if (!fuse(plain, targets, i, &fused->code[i]))
+            continue;
+        int length = fused_lengths[fused->code[i].op - FUSED_FIRST - 1];
+        for (int j = 1; j < length; ++j)
+            fused->head[i + j] = (unsigned char)i;
+        i += length - 1;
+    }
+
+    memcpy(fused->pool, mailboxes->pool, sizeof(fused->pool));
+    fused->built = true;
+}
+
+struct lmc_fused* lmc_fused_create(void)
+{
+    return (struct lmc_fused*)quick_calloc(1, sizeof(struct lmc_fused));
+}
+
+void lmc_fused_destroy(struct lmc_fused* fused)
+{
+    free(fused);
+}
+
+// Execute an assembled LMC program from a pre-decoded copy of the pool in which common
+// sequences of instructions have been fused into superinstructions. Everything else works
+// like the decoded engine (see decoded.c). Overwriting any mailbox that a superinstruction
+// covers also marks the superinstruction as stale, and stale records are only ever decoded
+// again as plain instructions, in a copy of the fused code that is private to the run.
+// Code-immutable programs store without marking anything, and so run from the kept code.
+static LMC_FORCEINLINE bool execute_fused(struct mailboxes* mailboxes, struct lmc_exec* exec,
+                                          const struct lmc_regs* start, const bool limited,
+                                          const bool immutable)
+{
+    struct lmc_fused local;
+    struct lmc_fused* fused = exec->fused;
+    if (fused == NULL)
+    {
+        fused = &local;
+        fused->built = false;
+    }
+    if (!fused->built || fused->head[start->pc] != start->pc ||
+        memcmp(fused->pool, mailboxes->pool, sizeof(fused->pool)) != 0)
+        fused_build(fused, mailboxes, start->pc);
+
+    // The run works on a copy, which the compiler can keep apart from the pool in memory.
+    struct fused_insn code[NUM_MAILBOXES];
+    unsigned char head[NUM_MAILBOXES];
+    memcpy(code, fused->code, sizeof(code));
+    if (!immutable)
+        memcpy(head, fused->head, sizeof(head));
+
+    // LMC registers. See lmc_execute() for why there is a negative flag.
+    unsigned char pc = start->pc;
+    short acc = start->acc;
+    bool negative = start->negative;
+    short* pool = mailboxes->pool;
+
+// Store into a mailbox, marking its record stale. A store into the middle of a
+// superinstruction breaks it up for the rest of the run: its head goes back to being a
+// plain instruction straight away, and the mailbox no longer counts as covered by it.
+#define FUSED_STORE(address)                                \
+    do                                                      \
+    {                                                       \
+        unsigned char target = (address);                   \
+        pool[target] = acc;                                 \
+        if (!immutable)                                     \
+        {                                                   \
+            code[target].op = OP_NULL;                      \
+            if (head[target] != target)                     \
+            {                                               \
+                code[head[target]] = fused_single(pool[head[target]]); \
+                head[target] = target;                      \
+            }                                               \
+        }                                                   \
+    } while (0)
+
+// Account for the rest of a superinstruction's instructions, or run just its first one as
+// a plain instruction if that would go over the step limit.
+#define FUSED_STEPS(length)                                                        \
+    do                                                                             \
+    {                                                                              \
+        if (limited && exec->max_steps - steps < (unsigned long long)(length) - 1) \
+        {                                                                          \
+            insn = fused_single(pool[at]);                                         \
+            goto dispatch;                                                         \
+        }                                                                          \
+        steps += (length) - 1;                                                     \
+    } while (0)
+
+    unsigned long long steps = start->steps;
+    for (;;)
+    {
+        if (limited && steps == exec->max_steps)
+            return lmc_fail_step_limit(mailboxes, exec);
+        steps++;
+
+        unsigned char at = pc;
+        struct fused_insn insn = code[at];
+        pc = (at == NUM_MAILBOXES - 1) ? 0 : at + 1;
+
+    dispatch:
+        switch (insn.op)
+        {
+            case HLT:
+                return lmc_halt(exec, steps);
+            case ADD:
+            {
+                negative = false;
+                acc = (acc + pool[insn.x]) % 1000;
+                break;
+            }
+            case SUB:
+            {
+                negative = (acc < pool[insn.x]);
+                acc = (acc - pool[insn.x]) % 1000;
+                break;
+            }
+            case STA:
+            {
+                FUSED_STORE(insn.x);
+                break;
+            }
+            case LDA:
+            {
+                negative = false;
+                acc = pool[insn.x];
+                break;
+            }
+            case BRA:
+            {
+                pc = insn.x;
+                break;
+            }
+            case BRZ:
+            {
+                if (acc == 0)
+                    pc = insn.x;
+                break;
+            }
+            case BRP:
+            {
+                if (!negative)
+                    pc = insn.x;
+                break;
+            }
+            case INP:
+            {
+                if (lmc_input_blocked(exec))
+                    return lmc_suspend(exec, at, acc, negative, steps - 1);
+                lmc_io_read(exec->io, &acc, &negative);
+                break;
+            }
+            case OUT:
+            {
+                if (!lmc_io_write(exec->io, acc))
+                    return lmc_mismatch(mailboxes, exec, steps);
+                break;
+            }
+            case OP_NULL:
+            {
+                insn = code[at] = fused_single(pool[at]);
+                goto dispatch;
+            }
+            case FUSED_LDA_ADD_STA:
+            case FUSED_LDA_ADD_STA_BRA:
+            {
+                FUSED_STEPS(fused_lengths[insn.op - FUSED_FIRST - 1]);
+                negative = false;
+                acc = (pool[insn.x] + pool[insn.y]) % 1000;
+                FUSED_STORE(insn.z);
+                pc = (insn.op == FUSED_LDA_ADD_STA_BRA) ? insn.t : insn.next;
+                break;
+            }
+            case FUSED_LDA_SUB_STA:
+            case FUSED_LDA_SUB_STA_BRZ:
+            case FUSED_LDA_SUB_STA_BRP:
+            {
+                FUSED_STEPS(fused_lengths[insn.op - FUSED_FIRST - 1]);
+                acc = pool[insn.x];
+                negative = (acc < pool[insn.y]);
+                acc = (acc - pool[insn.y]) % 1000;
+                FUSED_STORE(insn.z);
+                pc = insn.next;
+                if ((insn.op == FUSED_LDA_SUB_STA_BRZ && acc == 0) ||
+                    (insn.op == FUSED_LDA_SUB_STA_BRP && !negative))
+                    pc = insn.t;
+                break;
+            }
+            case FUSED_LDA_BRZ:
+            {
+                FUSED_STEPS(2);
+                negative = false;
+                acc = pool[insn.x];
+                pc = (acc == 0) ? insn.t : insn.next;
+                break;
+            }
+            case FUSED_LDA_STA:
+            {
+                FUSED_STEPS(2);
+                negative = false;
+                acc = pool[insn.x];
+                FUSED_STORE(insn.y);
+                pc = insn.next;
+                break;
+            }
+            case FUSED_ADD_STA:
+            {
+                FUSED_STEPS(2);
+                negative = false;
+                acc = (acc + pool[insn.x]) % 1000;
+                FUSED_STORE(insn.y);
+                pc = insn.next;
+                break;
+            }
+            case FUSED_SUB_STA:
+            {
+                FUSED_STEPS(2);
+                negative = (acc < pool[insn.x]);
+                acc = (acc - pool[insn.x]) % 1000;
+                FUSED_STORE(insn.y);
+                pc = insn.next;
+                break;
+            }
+            case FUSED_SUB_BRZ:
+            case FUSED_SUB_BRP:
+            {
+                FUSED_STEPS(2);
+                negative = (acc < pool[insn.x]);
+                acc = (acc - pool[insn.x]) % 1000;
+                pc = insn.next;
+                if ((insn.op == FUSED_SUB_BRZ && acc == 0) || (insn.op == FUSED_SUB_BRP && !negative))
+                    pc = insn.t;
+                break;
+            }
+            case FUSED_INP_STA:
+            {
+                if (lmc_input_blocked(exec))
+                    return lmc_suspend(exec, at, acc, negative, steps - 1);
+                FUSED_STEPS(2);
+                lmc_io_read(exec->io, &acc, &negative);
+                FUSED_STORE(insn.x);
+                pc = insn.next;
+                break;
+            }
+            default:
+                return lmc_fail_opcode(mailboxes, exec, steps, lmc_decode_ir(pool[at]));
+        }
+    }
+
+#undef FUSED_STEPS
+#undef FUSED_STORE
+}
+
+LMC_ENGINE_GUARDED_VARIANTS(execute_fused)
+
+bool lmc_execute_fused(struct mailboxes* mailboxes, struct lmc_exec* exec,
+                       const struct lmc_regs* start)
+{
+    return LMC_ENGINE_GUARDED_RUN(execute_fused, mailboxes, exec, start);
+}
@@ -0,0 +1,206 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "io.h"
+#include "util.h"
+
+// Set up buffered I/O over a pair of streams.
+void lmc_io_init_streams(struct lmc_io* io, FILE* instream, FILE* outstream)
+{
+    io->instream = instream;
+    io->in_cursor = io->in_end = io->in_storage;
+    io->in_eof = (instream == NULL);
+    io->outstream = outstream;
+    io->out_buffer = io->out_storage;
+    io->out_capacity = sizeof(io->out_storage);
+    io->out_length = 0;
+    io->out_total = 0;
+    io->expect = NULL;
+    io->out_values = 0;
+}
+
+// Set up I/O over caller-owned memory.
+void lmc_io_init_memory(struct lmc_io* io, const char* input, size_t input_length,
+                        char* output, size_t output_capacity)
+{
+    io->instream = NULL;
+    io->in_cursor = input;
+    io->in_end = input + input_length;
+    io->in_eof = true;
+    io->outstream = NULL;
+    io->out_buffer = output;
+    io->out_capacity = output_capacity;
+    io->out_length = 0;
+    io->out_total = 0;
+    io->expect = NULL;
+    io->out_values = 0;
+}
+
+// Check every value written by OUT against the values the program is expected to output.
+void lmc_io_expect(struct lmc_io* io, const short* values, size_t count)
+{
+    io->expect = values;
+    io->expect_count = count;
+}
+
+// Refill the input buffer from the input stream, returning false once there is nothing
+// left to read. Anything still buffered for output is flushed first, since this may block
+// waiting on whoever is meant to react to that output.
+static bool io_refill(struct lmc_io* io)
+{
+    if (io->in_eof)
+        return false;
+    lmc_io_flush(io);
+
+    long count = -1;
+    int fd = fileno(io->instream);
+    if (fd >= 0)
+    {
+#ifdef _WIN32
+        count = _read(fd, io->in_storage, sizeof(io->in_storage));
+#else
+        count = (long)read(fd, io->in_storage, sizeof(io->in_storage));
+#endif
+    }
+    else if (fgets(io->in_storage, sizeof(io->in_storage), io->instream))
+        count = (long)strlen(io->in_storage);
+
+    if (count <= 0)
+    {
+        io->in_eof = true;
+        return false;
+    }
+    io->in_cursor = io->in_storage;
+    io->in_end = io->in_storage + count;
+    return true;
+}
+
+static inline int io_getc(struct lmc_io* io)
+{
+    if (io->in_cursor == io->in_end && !io_refill(io))
+        return EOF;
+    return (unsigned char)*io->in_cursor++;
+}
+
+static inline bool io_isspace(int c)
+{
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+// Read a value for INP from the first width characters of a line.
+static inline void io_read(struct lmc_io* io, int* acc, bool* negative, int width)
+{
+    // Gather the first characters of the line, which for the usual width of four is what
+    // fgets() used to read into a 5-byte buffer, and then skip the rest of the line (which
+    // fgets() left for the next read, see lmc_io_read()).
+    char line[LMC_IO_MAX_WIDTH];
+    int length = 0;
+    int c = EOF;
+    while (length < width && (c = io_getc(io)) != EOF)
+    {
+        line[length++] = (char)c;
+        if (c == '\n')
+            break;
+    }
+    while (c != '\n' && c != EOF)
+        c = io_getc(io);
+
+    // Parse it as atoi() would, after taking off the sign of the accumulator.
+    int i = 0;
+    *negative = (length > 0 && line[0] == '-');
+    i += *negative;
+    while (i < length && io_isspace(line[i]))
+        i++;
+    bool minus = false;
+    if (i < length && (line[i] == '-' || line[i] == '+'))
+        minus = (line[i++] == '-');
+    int value = 0;
+    for (; i < length && line[i] >= '0' && line[i] <= '9'; ++i)
+        value = value * 10 + (line[i] - '0');
+    *acc = (minus) ? -value : value;
+}
+
+// Read a value for INP.
+void lmc_io_read(struct lmc_io* io, short* acc, bool* negative)
+{
+    int value;
+    io_read(io, &value, negative, 4);
+    *acc = (short)value;
+}
+
+// Read a value for INP from a wider line.
+void lmc_io_read_wide(struct lmc_io* io, int* acc, bool* negative, size_t width)
+{
+    io_read(io, acc, negative, (int)min(width, LMC_IO_MAX_WIDTH));
+}
+
+// Check whether there is anything left to read.
+bool lmc_io_pending(const struct lmc_io* io)
+{
+    return io->in_cursor != io->in_end || !io->in_eof;
+}
+
+// Write a newline-terminated value for OUT.
+bool lmc_io_write(struct lmc_io* io, short acc)
+{
+    if (io->expect && (io->out_values >= io->expect_count || io->expect[io->out_values] != acc))
+    {
+        io->unexpected = acc;
+        return false;
+    }
+    io->out_values++;
+    lmc_io_write_wide(io, acc);
+    return true;
+}
+
+void lmc_io_write_wide(struct lmc_io* io, int acc)
+{
+    // Format the value backwards from the end of a small buffer.
+    char digits[16];
+    char* start = &digits[sizeof(digits)];
+    unsigned int value = (unsigned int)acc;
+    bool minus = (acc < 0);
+    if (minus)
+        value = 0u - value;
+    *--start = '\n';
+    do
+    {
+        *--start = (char)('0' + value % 10);
+        value /= 10;
+    } while (value);
+    if (minus)
+        *--start = '-';
+    size_t length = &digits[sizeof(digits)] - start;
+
+    io->out_total += length;
+    if (io->outstream)
+    {
+        if (io->out_length + length > io->out_capacity)
+            lmc_io_flush(io);
+    }
+    else if (io->out_length + length > io->out_capacity)
+        length = io->out_capacity - io->out_length;
+    memcpy(&io->out_buffer[io->out_length], start, length);
+    io->out_length += length;
+}
+
+// Hand everything buffered so far to the output stream.
+void lmc_io_flush(struct lmc_io* io)
+{
+    if (!io->outstream)
+        return;
+    if (io->out_length > 0)
+        fwrite(io->out_buffer, 1, io->out_length, io->outstream);
+    io->out_length = 0;
+    fflush(io->outstream);
+}
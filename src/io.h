@@ -0,0 +1,84 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define LMC_IO_BUFFER_SIZE  16384
+
+// Buffered I/O for INP and OUT. Input and output can each either be a FILE* or a block of
+// memory owned by the caller, and the struct owns buffers large enough that stream-backed
+// I/O only goes to the operating system once per buffer rather than once per instruction.
+// The struct is intended to sit on the stack (or inside a longer-lived context), so none
+// of this ever allocates.
+//
+// A stream-backed input is read straight from its file descriptor (falling back to fgets()
+// for streams without one), so the struct should be the only reader of the stream while
+// the program is running. Anything already buffered inside the FILE* is not seen, and
+// whatever has been read ahead into the struct is lost along with it.
+struct lmc_io
+{
+    FILE* instream;
+    const char* in_cursor;
+    const char* in_end;
+    bool in_eof;
+
+    FILE* outstream;
+    char* out_buffer;
+    size_t out_capacity;
+    size_t out_length;      // Characters currently held in out_buffer.
+    size_t out_total;       // Characters written overall, including anything dropped.
+
+    // The values OUT is expected to write, or NULL not to check (see lmc_io_expect()).
+    const short* expect;
+    size_t expect_count;
+    size_t out_values;      // Values written overall.
+    short unexpected;       // The value that did not match, once one has not.
+
+    char in_storage[LMC_IO_BUFFER_SIZE];
+    char out_storage[LMC_IO_BUFFER_SIZE];
+};
+
+// Set up buffered I/O over a pair of streams.
+void lmc_io_init_streams(struct lmc_io* io, FILE* instream, FILE* outstream);
+
+// Set up I/O over caller-owned memory. Output past the end of the output buffer is
+// dropped, but still counted in out_total.
+void lmc_io_init_memory(struct lmc_io* io, const char* input, size_t input_length,
+                        char* output, size_t output_capacity);
+
+// Check every value written by OUT against the values the program is expected to output,
+// which must stay around for as long as the I/O is in use. Writing anything else (or writing
+// more values than expected) ends the run with LMC_STATUS_MISMATCH.
+void lmc_io_expect(struct lmc_io* io, const short* values, size_t count);
+
+// Read a value for INP. Each value is one line of input: the first four characters of the
+// line are parsed by atoi(), a leading '-' sets the negative flag rather than negating the
+// accumulator, and the rest of the line is skipped. Reading past the end of the input yields
+// 0. This differs from the original fgets() into a 5-byte buffer, which left the rest of a
+// line for the next INP: "12345" used to read as 1234 and then 5, and a four-character line
+// such as "1234" used to be followed by an empty read of 0.
+void lmc_io_read(struct lmc_io* io, short* acc, bool* negative);
+
+// The same as lmc_io_read(), but parsing the first width characters of the line (up to
+// LMC_IO_MAX_WIDTH, which always fits in an int), for machines with wider words.
+#define LMC_IO_MAX_WIDTH    10
+
+void lmc_io_read_wide(struct lmc_io* io, int* acc, bool* negative, size_t width);
+
+// Check whether there is anything left to read. For streams, this is true until the end of
+// the stream has been reached, even if reading would block.
+bool lmc_io_pending(const struct lmc_io* io);
+
+// Write a newline-terminated value for OUT, returning false if it is not the value that was
+// expected, in which case the engine ends the run with lmc_mismatch(). Values that do not
+// match are not written.
+bool lmc_io_write(struct lmc_io* io, short acc);
+void lmc_io_write_wide(struct lmc_io* io, int acc);
+
+// Hand everything buffered so far to the output stream. Engines call this when the program
+// halts or fails, and reading input calls it before it would block.
+void lmc_io_flush(struct lmc_io* io);
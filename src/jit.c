@@ -0,0 +1,717 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "io.h"
+#include "lmc.h"
+#include "lmc_internal.h"
+#include "util.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define JIT_X64
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define JIT_A64
+#endif
+
+#if defined(JIT_X64) || defined(JIT_A64)
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#if defined(__APPLE__) && defined(JIT_A64)
+#include <pthread.h>
+#endif
+#endif
+
+// The JIT translates the reachable part of the pool into native code, one block per
+// branch target, with the accumulator and negative flag held in registers. Compiled code
+// runs until it reaches something it cannot do itself, and then leaves through one of
+// these exits with the mailbox to carry on from in exit_pc.
+enum jit_exit
+{
+    JIT_EXIT_HALT,      // HLT was executed.
+    JIT_EXIT_IO,        // exit_pc holds an INP or OUT for the driver to carry out.
+    JIT_EXIT_INTERP,    // The interpreter must take over the rest of the run from exit_pc.
+};
+
+// The state shared by the driver and the compiled code, which addresses it by offset.
+// Every member is naturally aligned, which the AArch64 scaled offsets rely on.
+struct jit_state
+{
+    short* pool;
+    unsigned long long steps;
+    unsigned long long max_steps;
+    short acc;
+    unsigned char negative;
+    unsigned int exit_pc;
+};
+
+// Compiled code is entered through a trampoline at the start of the buffer, which loads
+// the state into registers and jumps to the block for a mailbox.
+typedef int (*jit_entry)(struct jit_state* state, const void* block);
+
+#define JIT_CODE_SIZE   32768
+
+struct jit_buffer
+{
+    unsigned char* code;
+    size_t length;
+    bool overflow;
+};
+
+static void emit_bytes(struct jit_buffer* buf, const void* bytes, size_t length)
+{
+    if (buf->length + length > JIT_CODE_SIZE)
+    {
+        buf->overflow = true;
+        return;
+    }
+    memcpy(&buf->code[buf->length], bytes, length);
+    buf->length += length;
+}
+
+static void emit_u32(struct jit_buffer* buf, unsigned int value)
+{
+    unsigned char bytes[4] = { value & 0xFF, (value >> 8) & 0xFF, (value >> 16) & 0xFF, value >> 24 };
+    emit_bytes(buf, bytes, sizeof(bytes));
+}
+
+static void patch_u32(struct jit_buffer* buf, size_t site, unsigned int value)
+{
+    if (site + 4 > buf->length)
+        return;
+    unsigned char bytes[4] = { value & 0xFF, (value >> 8) & 0xFF, (value >> 16) & 0xFF, value >> 24 };
+    memcpy(&buf->code[site], bytes, sizeof(bytes));
+}
+
+#if defined(JIT_A64)
+static unsigned int read_u32(struct jit_buffer* buf, size_t site)
+{
+    const unsigned char* bytes = &buf->code[site];
+    return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((unsigned int)bytes[3] << 24);
+}
+#endif
+
+// The kinds of branches between blocks.
+enum jit_branch
+{
+    JIT_BRANCH_ALWAYS,  // BRA, or falling through into the next block.
+    JIT_BRANCH_ZERO,    // BRZ.
+    JIT_BRANCH_POSITIVE // BRP.
+};
+
+#if defined(JIT_X64)
+
+// x86-64 backend. Register use, all callee-saved on both the SysV and Windows ABIs:
+//   rbx    pool            r12d   accumulator      r13d  negative flag
+//   r14    steps           r15    struct jit_state*
+// rax, rcx and rdx are scratch.
+
+#define EMIT(...)                                                   \
+    do                                                              \
+    {                                                               \
+        const unsigned char bytes[] = { __VA_ARGS__ };              \
+        emit_bytes(buf, bytes, sizeof(bytes));                      \
+    } while (0)
+
+static void emit_prologue(struct jit_buffer* buf)
+{
+    EMIT(0x55, 0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57);   // push rbp, rbx, r12-r15
+#ifdef _WIN32
+    EMIT(0x49, 0x89, 0xCF);                                             // mov r15, rcx
+#else
+    EMIT(0x49, 0x89, 0xFF);                                             // mov r15, rdi
+#endif
+    EMIT(0x49, 0x8B, 0x9F); emit_u32(buf, offsetof(struct jit_state, pool));        // mov rbx, [r15+pool]
+    EMIT(0x45, 0x0F, 0xBF, 0xA7); emit_u32(buf, offsetof(struct jit_state, acc));   // movsx r12d, word [r15+acc]
+    EMIT(0x45, 0x0F, 0xB6, 0xAF); emit_u32(buf, offsetof(struct jit_state, negative)); // movzx r13d, byte [r15+negative]
+    EMIT(0x4D, 0x8B, 0xB7); emit_u32(buf, offsetof(struct jit_state, steps));       // mov r14, [r15+steps]
+#ifdef _WIN32
+    EMIT(0xFF, 0xE2);                                                   // jmp rdx
+#else
+    EMIT(0xFF, 0xE6);                                                   // jmp rsi
+#endif
+}
+
+static void emit_epilogue(struct jit_buffer* buf)
+{
+    EMIT(0x66, 0x45, 0x89, 0xA7); emit_u32(buf, offsetof(struct jit_state, acc));   // mov [r15+acc], r12w
+    EMIT(0x45, 0x88, 0xAF); emit_u32(buf, offsetof(struct jit_state, negative));    // mov [r15+negative], r13b
+    EMIT(0x4D, 0x89, 0xB7); emit_u32(buf, offsetof(struct jit_state, steps));       // mov [r15+steps], r14
+    EMIT(0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5B, 0x5D);   // pop r15-r12, rbx, rbp
+    EMIT(0xC3);                                                         // ret
+}
+
+static void emit_exit(struct jit_buffer* buf, size_t epilogue, enum jit_exit reason, int pc)
+{
+    EMIT(0x41, 0xC7, 0x87); emit_u32(buf, offsetof(struct jit_state, exit_pc)); emit_u32(buf, pc); // mov dword [r15+exit_pc], pc
+    EMIT(0xB8); emit_u32(buf, reason);                                  // mov eax, reason
+    EMIT(0xE9); emit_u32(buf, (unsigned int)(epilogue - (buf->length + 4)));   // jmp epilogue
+}
+
+// Account for the instructions of a block up front, leaving for the interpreter instead
+// if the block would take the run past its step limit.
+static void emit_block_start(struct jit_buffer* buf, size_t epilogue, int pc, int length,
+                             bool limited)
+{
+    if (length == 0)
+        return;
+    if (limited)
+    {
+        EMIT(0x49, 0x8D, 0x86); emit_u32(buf, length);                  // lea rax, [r14+length]
+        EMIT(0x49, 0x3B, 0x87); emit_u32(buf, offsetof(struct jit_state, max_steps)); // cmp rax, [r15+max_steps]
+        EMIT(0x76, 0x00);                                               // jbe over
+        size_t site = buf->length;
+        emit_exit(buf, epilogue, JIT_EXIT_INTERP, pc);
+        if (!buf->overflow)
+            buf->code[site - 1] = (unsigned char)(buf->length - site);
+    }
+    EMIT(0x49, 0x81, 0xC6); emit_u32(buf, length);                      // add r14, length
+}
+
+// Reduce eax modulo 1000 into r12d, truncating like C does. Division by 1000 is done by
+// multiplying with its reciprocal; the accumulator never gets anywhere near large enough
+// for this to be inexact.
+static void emit_mod1000(struct jit_buffer* buf)
+{
+    EMIT(0x89, 0xC1);                                                   // mov ecx, eax
+    EMIT(0x48, 0x63, 0xC0);                                             // movsxd rax, eax
+    EMIT(0x48, 0x69, 0xC0); emit_u32(buf, 0x10624DD3);                  // imul rax, rax, 2^38/1000
+    EMIT(0x48, 0xC1, 0xF8, 0x26);                                       // sar rax, 38
+    EMIT(0x89, 0xCA);                                                   // mov edx, ecx
+    EMIT(0xC1, 0xFA, 0x1F);                                             // sar edx, 31
+    EMIT(0x29, 0xD0);                                                   // sub eax, edx
+    EMIT(0x69, 0xC0); emit_u32(buf, 1000);                              // imul eax, eax, 1000
+    EMIT(0x29, 0xC1);                                                   // sub ecx, eax
+    EMIT(0x41, 0x89, 0xCC);                                             // mov r12d, ecx
+}
+
+static void emit_op(struct jit_buffer* buf, struct lmc_insn insn)
+{
+    unsigned int cell = insn.ar * sizeof(short);
+    switch (insn.op)
+    {
+        case ADD:
+            EMIT(0x0F, 0xBF, 0x83); emit_u32(buf, cell);                // movsx eax, word [rbx+cell]
+            EMIT(0x44, 0x01, 0xE0);                                     // add eax, r12d
+            emit_mod1000(buf);
+            EMIT(0x45, 0x31, 0xED);                                     // xor r13d, r13d
+            break;
+        case SUB:
+            EMIT(0x0F, 0xBF, 0x83); emit_u32(buf, cell);                // movsx eax, word [rbx+cell]
+            EMIT(0x45, 0x31, 0xED);                                     // xor r13d, r13d
+            EMIT(0x41, 0x39, 0xC4);                                     // cmp r12d, eax
+            EMIT(0x41, 0x0F, 0x9C, 0xC5);                               // setl r13b
+            EMIT(0x44, 0x89, 0xE1);                                     // mov ecx, r12d
+            EMIT(0x29, 0xC1);                                           // sub ecx, eax
+            EMIT(0x89, 0xC8);                                           // mov eax, ecx
+            emit_mod1000(buf);
+            break;
+        case STA:
+            EMIT(0x66, 0x44, 0x89, 0xA3); emit_u32(buf, cell);          // mov [rbx+cell], r12w
+            break;
+        case LDA:
+            EMIT(0x44, 0x0F, 0xBF, 0xA3); emit_u32(buf, cell);          // movsx r12d, word [rbx+cell]
+            EMIT(0x45, 0x31, 0xED);                                     // xor r13d, r13d
+            break;
+    }
+}
+
+// Emit a branch to another block, returning where to patch in its destination.
+static size_t emit_branch(struct jit_buffer* buf, enum jit_branch kind)
+{
+    switch (kind)
+    {
+        case JIT_BRANCH_ALWAYS:
+            EMIT(0xE9);                                                 // jmp rel32
+            break;
+        case JIT_BRANCH_ZERO:
+            EMIT(0x45, 0x85, 0xE4);                                     // test r12d, r12d
+            EMIT(0x0F, 0x84);                                           // jz rel32
+            break;
+        case JIT_BRANCH_POSITIVE:
+            EMIT(0x45, 0x85, 0xED);                                     // test r13d, r13d
+            EMIT(0x0F, 0x84);                                           // jz rel32
+            break;
+    }
+    size_t site = buf->length;
+    emit_u32(buf, 0);
+    return site;
+}
+
+static void patch_branch(struct jit_buffer* buf, size_t site, size_t target)
+{
+    patch_u32(buf, site, (unsigned int)(target - (site + 4)));
+}
+
+#undef EMIT
+
+#elif defined(JIT_A64)
+
+// AArch64 backend. Register use, all callee-saved:
+//   x19    pool            w20    accumulator      w21   negative flag
+//   x22    steps           x23    struct jit_state*
+// w0-w2 are scratch.
+
+#define A64_LDRSH(rt, rn, offset)   (0x79C00000u | (((offset) / 2) << 10) | ((rn) << 5) | (rt))
+#define A64_STRH(rt, rn, offset)    (0x79000000u | (((offset) / 2) << 10) | ((rn) << 5) | (rt))
+#define A64_LDRB(rt, rn, offset)    (0x39400000u | ((offset) << 10) | ((rn) << 5) | (rt))
+#define A64_STRB(rt, rn, offset)    (0x39000000u | ((offset) << 10) | ((rn) << 5) | (rt))
+#define A64_LDRX(rt, rn, offset)    (0xF9400000u | (((offset) / 8) << 10) | ((rn) << 5) | (rt))
+#define A64_STRX(rt, rn, offset)    (0xF9000000u | (((offset) / 8) << 10) | ((rn) << 5) | (rt))
+#define A64_STRW(rt, rn, offset)    (0xB9000000u | (((offset) / 4) << 10) | ((rn) << 5) | (rt))
+#define A64_MOVZW(rd, imm)          (0x52800000u | ((imm) << 5) | (rd))
+#define A64_ADDW(rd, rn, rm)        (0x0B000000u | ((rm) << 16) | ((rn) << 5) | (rd))
+#define A64_SUBW(rd, rn, rm)        (0x4B000000u | ((rm) << 16) | ((rn) << 5) | (rd))
+#define A64_CMPW(rn, rm)            (0x6B00001Fu | ((rm) << 16) | ((rn) << 5))
+#define A64_CMPX(rn, rm)            (0xEB00001Fu | ((rm) << 16) | ((rn) << 5))
+#define A64_ADDXI(rd, rn, imm)      (0x91000000u | ((imm) << 10) | ((rn) << 5) | (rd))
+#define A64_SDIVW(rd, rn, rm)       (0x1AC00C00u | ((rm) << 16) | ((rn) << 5) | (rd))
+#define A64_MSUBW(rd, rn, rm, ra)   (0x1B008000u | ((rm) << 16) | ((ra) << 10) | ((rn) << 5) | (rd))
+#define A64_CSET_LT(rd)             (0x1A9FA7E0u | (rd))
+#define A64_B(imm26)                (0x14000000u | ((imm26) & 0x3FFFFFF))
+#define A64_CBZW(rt, imm19)         (0x34000000u | (((imm19) & 0x7FFFF) << 5) | (rt))
+#define A64_BLS(imm19)              (0x54000009u | (((imm19) & 0x7FFFF) << 5))
+#define A64_BR(rn)                  (0xD61F0000u | ((rn) << 5))
+#define A64_RET                     0xD65F03C0u
+
+static void emit_prologue(struct jit_buffer* buf)
+{
+    emit_u32(buf, 0xA9BC7BFDu);                                         // stp x29, x30, [sp, #-64]!
+    emit_u32(buf, 0xA90153F3u);                                         // stp x19, x20, [sp, #16]
+    emit_u32(buf, 0xA9025BF5u);                                         // stp x21, x22, [sp, #32]
+    emit_u32(buf, 0xA90363F7u);                                         // stp x23, x24, [sp, #48]
+    emit_u32(buf, 0xAA0003F7u);                                         // mov x23, x0
+    emit_u32(buf, A64_LDRX(19, 23, offsetof(struct jit_state, pool)));
+    emit_u32(buf, A64_LDRSH(20, 23, offsetof(struct jit_state, acc)));
+    emit_u32(buf, A64_LDRB(21, 23, offsetof(struct jit_state, negative)));
+    emit_u32(buf, A64_LDRX(22, 23, offsetof(struct jit_state, steps)));
+    emit_u32(buf, A64_BR(1));
+}
+
+static void emit_epilogue(struct jit_buffer* buf)
+{
+    emit_u32(buf, A64_STRH(20, 23, offsetof(struct jit_state, acc)));
+    emit_u32(buf, A64_STRB(21, 23, offsetof(struct jit_state, negative)));
+    emit_u32(buf, A64_STRX(22, 23, offsetof(struct jit_state, steps)));
+    emit_u32(buf, 0xA94363F7u);                                         // ldp x23, x24, [sp, #48]
+    emit_u32(buf, 0xA9425BF5u);                                         // ldp x21, x22, [sp, #32]
+    emit_u32(buf, 0xA94153F3u);                                         // ldp x19, x20, [sp, #16]
+    emit_u32(buf, 0xA8C47BFDu);                                         // ldp x29, x30, [sp], #64
+    emit_u32(buf, A64_RET);
+}
+
+static void emit_exit(struct jit_buffer* buf, size_t epilogue, enum jit_exit reason, int pc)
+{
+    emit_u32(buf, A64_MOVZW(0, pc));
+    emit_u32(buf, A64_STRW(0, 23, offsetof(struct jit_state, exit_pc)));
+    emit_u32(buf, A64_MOVZW(0, reason));
+    emit_u32(buf, A64_B(((int)epilogue - (int)buf->length) / 4));
+}
+
+// Account for the instructions of a block up front, leaving for the interpreter instead
+// if the block would take the run past its step limit.
+static void emit_block_start(struct jit_buffer* buf, size_t epilogue, int pc, int length,
+                             bool limited)
+{
+    if (length == 0)
+        return;
+    if (limited)
+    {
+        emit_u32(buf, A64_LDRX(0, 23, offsetof(struct jit_state, max_steps)));
+        emit_u32(buf, A64_ADDXI(1, 22, length));
+        emit_u32(buf, A64_CMPX(1, 0));
+        emit_u32(buf, A64_BLS(5));                                      // b.ls over the exit
+        emit_exit(buf, epilogue, JIT_EXIT_INTERP, pc);
+    }
+    emit_u32(buf, A64_ADDXI(22, 22, length));
+}
+
+// Reduce w0 modulo 1000 into w20, truncating like C does.
+static void emit_mod1000(struct jit_buffer* buf)
+{
+    emit_u32(buf, A64_MOVZW(2, 1000));
+    emit_u32(buf, A64_SDIVW(1, 0, 2));
+    emit_u32(buf, A64_MSUBW(20, 1, 2, 0));
+}
+
+static void emit_op(struct jit_buffer* buf, struct lmc_insn insn)
+{
+    unsigned int cell = insn.ar * sizeof(short);
+    switch (insn.op)
+    {
+        case ADD:
+            emit_u32(buf, A64_LDRSH(0, 19, cell));
+            emit_u32(buf, A64_ADDW(0, 0, 20));
+            emit_mod1000(buf);
+            emit_u32(buf, A64_MOVZW(21, 0));
+            break;
+        case SUB:
+            emit_u32(buf, A64_LDRSH(0, 19, cell));
+            emit_u32(buf, A64_CMPW(20, 0));
+            emit_u32(buf, A64_CSET_LT(21));
+            emit_u32(buf, A64_SUBW(0, 20, 0));
+            emit_mod1000(buf);
+            break;
+        case STA:
+            emit_u32(buf, A64_STRH(20, 19, cell));
+            break;
+        case LDA:
+            emit_u32(buf, A64_LDRSH(20, 19, cell));
+            emit_u32(buf, A64_MOVZW(21, 0));
+            break;
+    }
+}
+
+// Emit a branch to another block, returning where to patch in its destination.
+static size_t emit_branch(struct jit_buffer* buf, enum jit_branch kind)
+{
+    size_t site = buf->length;
+    switch (kind)
+    {
+        case JIT_BRANCH_ALWAYS:
+            emit_u32(buf, A64_B(0));
+            break;
+        case JIT_BRANCH_ZERO:
+            emit_u32(buf, A64_CBZW(20, 0));
+            break;
+        case JIT_BRANCH_POSITIVE:
+            emit_u32(buf, A64_CBZW(21, 0));
+            break;
+    }
+    return site;
+}
+
+static void patch_branch(struct jit_buffer* buf, size_t site, size_t target)
+{
+    if (site + 4 > buf->length)
+        return;
+    unsigned int insn = read_u32(buf, site);
+    int offset = ((int)target - (int)site) / 4;
+    if ((insn & 0xFC000000u) == 0x14000000u)
+        insn = A64_B(offset);
+    else
+        insn = (insn & 0xFF00001Fu) | ((offset & 0x7FFFF) << 5);
+    patch_u32(buf, site, insn);
+}
+
+#endif
+
+// Executable memory is mapped writable, filled in, and then flipped to executable, so that
+// it is never both at once.
+static unsigned char* jit_map(void)
+{
+#if defined(_WIN32)
+    return (unsigned char*)VirtualAlloc(NULL, JIT_CODE_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+#elif defined(__APPLE__) && defined(JIT_A64)
+    void* memory = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_JIT, -1, 0);
+    if (memory == MAP_FAILED)
+        return NULL;
+    pthread_jit_write_protect_np(0);
+    return (unsigned char*)memory;
+#else
+    void* memory = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return (memory == MAP_FAILED) ? NULL : (unsigned char*)memory;
+#endif
+}
+
+static bool jit_seal(unsigned char* code, size_t length)
+{
+#if defined(_WIN32)
+    DWORD old;
+    if (!VirtualProtect(code, JIT_CODE_SIZE, PAGE_EXECUTE_READ, &old))
+        return false;
+    FlushInstructionCache(GetCurrentProcess(), code, length);
+    return true;
+#else
+#if defined(__APPLE__) && defined(JIT_A64)
+    pthread_jit_write_protect_np(1);
+#else
+    if (mprotect(code, JIT_CODE_SIZE, PROT_READ | PROT_EXEC) != 0)
+        return false;
+#endif
+#if defined(JIT_A64)
+    __builtin___clear_cache((char*)code, (char*)code + length);
+#endif
+    (void)length;
+    return true;
+#endif
+}
+
+static void jit_unmap(unsigned char* code)
+{
+#ifdef _WIN32
+    VirtualFree(code, 0, MEM_RELEASE);
+#else
+    munmap(code, JIT_CODE_SIZE);
+#endif
+}
+
+// A compiled program: the entry trampoline, and the native block for every mailbox that
+// starts one.
+struct jit_program
+{
+    unsigned char* code;
+    jit_entry entry;
+    const void* blocks[NUM_MAILBOXES];
+};
+
+static inline int jit_next(int pc)
+{
+    return (pc == NUM_MAILBOXES - 1) ? 0 : pc + 1;
+}
+
+static inline bool jit_native(unsigned char op)
+{
+    return op == ADD || op == SUB || op == STA || op == LDA;
+}
+
+// Work out which mailboxes can be reached from the start of the program, and which of
+// those start a block: the first mailbox, every branch target, and every mailbox that
+// follows a conditional branch or I/O instruction (which the driver re-enters at).
+static void jit_analyse(const struct lmc_insn* code, bool* reachable, bool* leader)
+{
+    int worklist[NUM_MAILBOXES];
+    int count = 0;
+    memset(reachable, 0, NUM_MAILBOXES * sizeof(bool));
+    memset(leader, 0, NUM_MAILBOXES * sizeof(bool));
+    leader[0] = true;
+    worklist[count++] = 0;
+    reachable[0] = true;
+
+#define VISIT(target)                           \
+    do                                          \
+    {                                           \
+        int visit = (target);                   \
+        if (!reachable[visit])                  \
+        {                                       \
+            reachable[visit] = true;            \
+            worklist[count++] = visit;          \
+        }                                       \
+    } while (0)
+
+    while (count > 0)
+    {
+        int pc = worklist[--count];
+        struct lmc_insn insn = code[pc];
+        switch (insn.op)
+        {
+            case BRA:
+                leader[insn.ar] = true;
+                VISIT(insn.ar);
+                break;
+            case BRZ:
+            case BRP:
+                leader[insn.ar] = leader[jit_next(pc)] = true;
+                VISIT(insn.ar);
+                VISIT(jit_next(pc));
+                break;
+            case INP:
+            case OUT:
+                leader[jit_next(pc)] = true;
+                VISIT(jit_next(pc));
+                break;
+            default:
+                if (jit_native(insn.op))
+                    VISIT(jit_next(pc));
+                break;
+        }
+    }
+
+#undef VISIT
+}
+
+// Compile a pool. Returns false if it does not fit or executable memory is unavailable,
+// in which case the run is left to the interpreter.
+static bool jit_compile(const short* pool, bool limited, struct jit_program* program)
+{
+    struct lmc_insn code[NUM_MAILBOXES];
+    bool reachable[NUM_MAILBOXES];
+    bool leader[NUM_MAILBOXES];
+    for (int i = 0; i < NUM_MAILBOXES; ++i)
+        code[i] = lmc_decode(pool[i]);
+    jit_analyse(code, reachable, leader);
+
+    struct jit_buffer buf = { jit_map(), 0, false };
+    if (!buf.code)
+        return false;
+
+    // Branches are patched once every block has been placed. Each block has at most two.
+    struct { size_t site; int target; } patches[NUM_MAILBOXES * 2];
+    int patch_count = 0;
+    size_t offsets[NUM_MAILBOXES];
+
+    emit_prologue(&buf);
+    size_t epilogue = buf.length;
+    emit_epilogue(&buf);
+
+    for (int start = 0; start < NUM_MAILBOXES; ++start)
+    {
+        if (!leader[start] || !reachable[start])
+            continue;
+        offsets[start] = buf.length;
+
+        // Find the end of the block, and count the instructions that it executes itself.
+        // The block stops at the next block, at anything that leaves compiled code, and
+        // after anything that branches or overwrites a compiled mailbox.
+        int length = 0;
+        int end = start;
+        for (;;)
+        {
+            struct lmc_insn insn = code[end];
+            bool native = jit_native(insn.op);
+            if (native || insn.op == BRA || insn.op == BRZ || insn.op == BRP || insn.op == HLT)
+                length++;
+            if (!native || (insn.op == STA && reachable[insn.ar]) || leader[jit_next(end)])
+                break;
+            end = jit_next(end);
+        }
+
+        emit_block_start(&buf, epilogue, start, length, limited);
+        for (int pc = start;; pc = jit_next(pc))
+        {
+            struct lmc_insn insn = code[pc];
+            int next = jit_next(pc);
+            if (jit_native(insn.op))
+            {
+                emit_op(&buf, insn);
+
+                // Overwriting compiled code means the compiled code is no longer valid,
+                // so leave the rest of the run to the interpreter.
+                if (insn.op == STA && reachable[insn.ar])
+                {
+                    emit_exit(&buf, epilogue, JIT_EXIT_INTERP, next);
+                    break;
+                }
+                if (pc != end)
+                    continue;
+
+                // Fall through into the next block, which is usually placed right after
+                // this one.
+                if (next < start)
+                {
+                    patches[patch_count].site = emit_branch(&buf, JIT_BRANCH_ALWAYS);
+                    patches[patch_count++].target = next;
+                }
+                break;
+            }
+
+            switch (insn.op)
+            {
+                case BRA:
+                case BRZ:
+                case BRP:
+                    patches[patch_count].site = emit_branch(&buf, (insn.op == BRA) ? JIT_BRANCH_ALWAYS
+                                                               : (insn.op == BRZ) ? JIT_BRANCH_ZERO
+                                                               : JIT_BRANCH_POSITIVE);
+                    patches[patch_count++].target = insn.ar;
+                    if (insn.op != BRA && next < start)
+                    {
+                        patches[patch_count].site = emit_branch(&buf, JIT_BRANCH_ALWAYS);
+                        patches[patch_count++].target = next;
+                    }
+                    break;
+                case HLT:
+                    emit_exit(&buf, epilogue, JIT_EXIT_HALT, pc);
+                    break;
+                case INP:
+                case OUT:
+                    emit_exit(&buf, epilogue, JIT_EXIT_IO, pc);
+                    break;
+                default:
+                    emit_exit(&buf, epilogue, JIT_EXIT_INTERP, pc);
+                    break;
+            }
+            break;
+        }
+    }
+
+    for (int i = 0; i < patch_count; ++i)
+        patch_branch(&buf, patches[i].site, offsets[patches[i].target]);
+
+    if (buf.overflow || !jit_seal(buf.code, buf.length))
+    {
+        jit_unmap(buf.code);
+        return false;
+    }
+
+    program->code = buf.code;
+    program->entry = (jit_entry)(void*)buf.code;
+    for (int i = 0; i < NUM_MAILBOXES; ++i)
+        program->blocks[i] = (leader[i] && reachable[i]) ? buf.code + offsets[i] : NULL;
+    return true;
+}
+
+// Execute an assembled LMC program as native code. The driver only steps in to carry out
+// I/O, and hands over to the decoded engine for whatever compiled code cannot handle:
+// unknown opcodes, the last few instructions before the step limit, and everything after
+// an STA overwrites a compiled mailbox.
+bool lmc_execute_jit(struct mailboxes* mailboxes, struct lmc_exec* exec,
+                     const struct lmc_regs* start)
+{
+    struct jit_program program;
+    bool limited = (exec->max_steps != 0);
+    if (!jit_compile(mailboxes->pool, limited, &program))
+        return lmc_execute_decoded(mailboxes, exec, start);
+
+    struct jit_state state;
+    state.pool = mailboxes->pool;
+    state.steps = start->steps;
+    state.max_steps = exec->max_steps;
+    state.acc = start->acc;
+    state.negative = start->negative;
+    state.exit_pc = start->pc;
+
+    enum jit_exit reason = JIT_EXIT_INTERP;
+    while (program.blocks[state.exit_pc])
+    {
+        reason = (enum jit_exit)program.entry(&state, program.blocks[state.exit_pc]);
+        if (reason != JIT_EXIT_IO || (limited && state.steps == state.max_steps))
+            break;
+
+        bool negative = state.negative;
+        bool input = (lmc_decode(mailboxes->pool[state.exit_pc]).op == INP);
+        if (input && lmc_input_blocked(exec))
+        {
+            jit_unmap(program.code);
+            return lmc_suspend(exec, (unsigned char)state.exit_pc, state.acc, negative,
+                               state.steps);
+        }
+        state.steps++;
+        if (input)
+            lmc_io_read(exec->io, &state.acc, &negative);
+        else if (!lmc_io_write(exec->io, state.acc))
+        {
+            jit_unmap(program.code);
+            return lmc_mismatch(mailboxes, exec, state.steps);
+        }
+        state.negative = negative;
+        state.exit_pc = jit_next(state.exit_pc);
+        reason = JIT_EXIT_INTERP;
+    }
+    jit_unmap(program.code);
+
+    if (reason == JIT_EXIT_HALT)
+        return lmc_halt(exec, state.steps);
+
+    struct lmc_regs regs = { (unsigned char)state.exit_pc, state.acc, state.negative != 0, state.steps };
+    return lmc_execute_decoded(mailboxes, exec, &regs);
+}
+
+#else
+
+// There is no backend for this architecture, so leave everything to the interpreter.
+bool lmc_execute_jit(struct mailboxes* mailboxes, struct lmc_exec* exec,
+                     const struct lmc_regs* start)
+{
+    return lmc_execute_decoded(mailboxes, exec, start);
+}
+
+#endif
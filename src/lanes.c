@@ -0,0 +1,463 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lanes.h"
+#include "lmc.h"
+#include "lmc_internal.h"
+#include "util.h"
+
+// Every vector holds one 16-bit value per lane. The arithmetic never leaves 16 bits: the
+// accumulator and mailboxes stay within -999..9999, so sums and differences stay within
+// -10998..19998.
+#if defined(__AVX2__)
+
+#include <immintrin.h>
+
+#define LANES 16
+typedef __m256i vec_t;
+
+static inline vec_t v_load(const short* p)      { return _mm256_loadu_si256((const __m256i*)p); }
+static inline void v_store(short* p, vec_t v)   { _mm256_storeu_si256((__m256i*)p, v); }
+static inline vec_t v_set1(short value)         { return _mm256_set1_epi16(value); }
+static inline vec_t v_add(vec_t a, vec_t b)     { return _mm256_add_epi16(a, b); }
+static inline vec_t v_sub(vec_t a, vec_t b)     { return _mm256_sub_epi16(a, b); }
+static inline vec_t v_eq(vec_t a, vec_t b)      { return _mm256_cmpeq_epi16(a, b); }
+static inline vec_t v_gt(vec_t a, vec_t b)      { return _mm256_cmpgt_epi16(a, b); }
+static inline vec_t v_and(vec_t a, vec_t b)     { return _mm256_and_si256(a, b); }
+static inline vec_t v_or(vec_t a, vec_t b)      { return _mm256_or_si256(a, b); }
+
+// Gather the all-ones lanes of a comparison into a bitmask. Packing works within each
+// 128-bit half, so the bits for lanes 8-15 end up in bits 16-23.
+static inline unsigned v_mask(vec_t m)
+{
+    unsigned bits = (unsigned)_mm256_movemask_epi8(_mm256_packs_epi16(m, _mm256_setzero_si256()));
+    return (bits & 0xFF) | ((bits >> 8) & 0xFF00);
+}
+
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+
+#include <emmintrin.h>
+
+#define LANES 8
+typedef __m128i vec_t;
+
+static inline vec_t v_load(const short* p)      { return _mm_loadu_si128((const __m128i*)p); }
+static inline void v_store(short* p, vec_t v)   { _mm_storeu_si128((__m128i*)p, v); }
+static inline vec_t v_set1(short value)         { return _mm_set1_epi16(value); }
+static inline vec_t v_add(vec_t a, vec_t b)     { return _mm_add_epi16(a, b); }
+static inline vec_t v_sub(vec_t a, vec_t b)     { return _mm_sub_epi16(a, b); }
+static inline vec_t v_eq(vec_t a, vec_t b)      { return _mm_cmpeq_epi16(a, b); }
+static inline vec_t v_gt(vec_t a, vec_t b)      { return _mm_cmpgt_epi16(a, b); }
+static inline vec_t v_and(vec_t a, vec_t b)     { return _mm_and_si128(a, b); }
+static inline vec_t v_or(vec_t a, vec_t b)      { return _mm_or_si128(a, b); }
+
+static inline unsigned v_mask(vec_t m)
+{
+    return (unsigned)_mm_movemask_epi8(_mm_packs_epi16(m, _mm_setzero_si128())) & 0xFF;
+}
+
+#elif (defined(__ARM_NEON) && defined(__aarch64__)) || defined(_M_ARM64)
+
+#include <arm_neon.h>
+
+#define LANES 8
+typedef int16x8_t vec_t;
+
+static inline vec_t v_load(const short* p)      { return vld1q_s16(p); }
+static inline void v_store(short* p, vec_t v)   { vst1q_s16(p, v); }
+static inline vec_t v_set1(short value)         { return vdupq_n_s16(value); }
+static inline vec_t v_add(vec_t a, vec_t b)     { return vaddq_s16(a, b); }
+static inline vec_t v_sub(vec_t a, vec_t b)     { return vsubq_s16(a, b); }
+static inline vec_t v_eq(vec_t a, vec_t b)      { return vreinterpretq_s16_u16(vceqq_s16(a, b)); }
+static inline vec_t v_gt(vec_t a, vec_t b)      { return vreinterpretq_s16_u16(vcgtq_s16(a, b)); }
+static inline vec_t v_and(vec_t a, vec_t b)     { return vandq_s16(a, b); }
+static inline vec_t v_or(vec_t a, vec_t b)      { return vorrq_s16(a, b); }
+
+static inline unsigned v_mask(vec_t m)
+{
+    static const uint16_t bits[8] = { 1, 2, 4, 8, 16, 32, 64, 128 };
+    return vaddvq_u16(vandq_u16(vreinterpretq_u16_s16(m), vld1q_u16(bits)));
+}
+
+#else
+
+// Plain C fallback for targets without a supported vector extension. Compilers will
+// usually still auto-vectorise these loops.
+#define LANES 8
+typedef struct { short v[LANES]; } vec_t;
+
+#define V_MAP(expr)                         \
+    vec_t r;                                \
+    for (int i = 0; i < LANES; ++i)         \
+        r.v[i] = (expr);                    \
+    return r
+
+static inline vec_t v_load(const short* p)      { V_MAP(p[i]); }
+static inline void v_store(short* p, vec_t v)   { memcpy(p, v.v, sizeof(v.v)); }
+static inline vec_t v_set1(short value)         { V_MAP(value); }
+static inline vec_t v_add(vec_t a, vec_t b)     { V_MAP(a.v[i] + b.v[i]); }
+static inline vec_t v_sub(vec_t a, vec_t b)     { V_MAP(a.v[i] - b.v[i]); }
+static inline vec_t v_eq(vec_t a, vec_t b)      { V_MAP(-(a.v[i] == b.v[i])); }
+static inline vec_t v_gt(vec_t a, vec_t b)      { V_MAP(-(a.v[i] > b.v[i])); }
+static inline vec_t v_and(vec_t a, vec_t b)     { V_MAP(a.v[i] & b.v[i]); }
+static inline vec_t v_or(vec_t a, vec_t b)      { V_MAP(a.v[i] | b.v[i]); }
+
+static inline unsigned v_mask(vec_t m)
+{
+    unsigned bits = 0;
+    for (int i = 0; i < LANES; ++i)
+        bits |= (unsigned)(m.v[i] != 0) << i;
+    return bits;
+}
+
+#undef V_MAP
+
+#endif
+
+// The C % operator truncates, so the remainder keeps the sign of the dividend. Reproduce
+// that by stepping every lane towards zero until it is within -999..999. This is nearly
+// always a single pass.
+static inline vec_t v_mod1000(vec_t value)
+{
+    const vec_t upper = v_set1(999);
+    const vec_t lower = v_set1(-999);
+    const vec_t step = v_set1(1000);
+    for (;;)
+    {
+        vec_t over = v_gt(value, upper);
+        vec_t under = v_gt(lower, value);
+        if (!v_mask(v_or(over, under)))
+            return value;
+        value = v_add(v_sub(value, v_and(over, step)), v_and(under, step));
+    }
+}
+
+// A group of lanes that step through the program together. The pool is stored as a
+// structure of arrays: pool[address] holds that mailbox for every lane in the group.
+struct lane_group
+{
+    short pool[NUM_MAILBOXES][LANES];
+    struct lmc_lane* lanes[LANES];
+    size_t input_pos[LANES];
+    unsigned long long max_steps;
+};
+
+static inline unsigned char next_pc(unsigned char pc)
+{
+    return (pc == NUM_MAILBOXES - 1) ? 0 : pc + 1;
+}
+
+static inline int popcount(unsigned bits)
+{
+    int count = 0;
+    for (; bits; bits &= bits - 1)
+        count++;
+    return count;
+}
+
+static inline int lowest_lane(unsigned bits)
+{
+    int lane = 0;
+    while (!(bits & (1u << lane)))
+        lane++;
+    return lane;
+}
+
+// Read the next input value of a lane, as INP would.
+static void lane_input(struct lmc_lane* lane, size_t* pos, short* acc, bool* negative)
+{
+    short value = (*pos < lane->input_count) ? lane->input[(*pos)++] : 0;
+    *negative = (value < 0);
+    *acc = (*negative) ? min(-value, 999) : min(value, 9999);
+}
+
+static void lane_output(struct lmc_lane* lane, short acc)
+{
+    if (lane->output_count < lane->output_capacity)
+        lane->output[lane->output_count] = acc;
+    lane->output_count++;
+}
+
+static void lane_fail(struct lmc_lane* lane, short data)
+{
+    lane->status = LMC_STATUS_ERROR;
+    lane->result = false;
+    sprintf_s(lane->error_msg, sizeof(lane->error_msg), "Unknown opcode %d", lmc_decode_ir(data));
+}
+
+static void lane_fail_step_limit(struct lmc_lane* lane, unsigned long long max_steps)
+{
+    lane->status = LMC_STATUS_STEP_LIMIT;
+    lane->result = false;
+    sprintf_s(lane->error_msg, sizeof(lane->error_msg), "Step limit of %llu instructions exceeded",
+              max_steps);
+}
+
+static void lane_halt(struct lmc_lane* lane)
+{
+    lane->status = LMC_STATUS_HALTED;
+    lane->result = true;
+}
+
+// Finish off a single lane on its own, once it has left its group having executed steps
+// instructions.
+static void lane_run_scalar(struct lmc_lane* lane, short* pool, size_t input_pos,
+                            unsigned char pc, short acc, bool negative, unsigned long long steps,
+                            unsigned long long max_steps)
+{
+    for (;; ++steps)
+    {
+        if (max_steps && steps >= max_steps)
+        {
+            lane_fail_step_limit(lane, max_steps);
+            return;
+        }
+
+        short data = pool[pc];
+        struct lmc_insn insn = lmc_decode(data);
+        pc = next_pc(pc);
+
+        switch (insn.op)
+        {
+            case HLT:
+                lane_halt(lane);
+                return;
+            case ADD:
+                negative = false;
+                acc = (acc + pool[insn.ar]) % 1000;
+                break;
+            case SUB:
+                negative = (acc < pool[insn.ar]);
+                acc = (acc - pool[insn.ar]) % 1000;
+                break;
+            case STA:
+                pool[insn.ar] = acc;
+                break;
+            case LDA:
+                negative = false;
+                acc = pool[insn.ar];
+                break;
+            case BRA:
+                pc = insn.ar;
+                break;
+            case BRZ:
+                if (acc == 0)
+                    pc = insn.ar;
+                break;
+            case BRP:
+                if (!negative)
+                    pc = insn.ar;
+                break;
+            case INP:
+                lane_input(lane, &input_pos, &acc, &negative);
+                break;
+            case OUT:
+                lane_output(lane, acc);
+                break;
+            default:
+                lane_fail(lane, data);
+                return;
+        }
+    }
+}
+
+// Take every lane in a mask out of its group and run it to completion on its own, starting
+// from the given register state and step count.
+static void group_eject(struct lane_group* group, unsigned mask, unsigned char pc,
+                        const short* acc, const short* negative, unsigned long long steps)
+{
+    short pool[NUM_MAILBOXES];
+    for (int lane = 0; lane < LANES; ++lane)
+    {
+        if (!(mask & (1u << lane)))
+            continue;
+        for (int i = 0; i < NUM_MAILBOXES; ++i)
+            pool[i] = group->pool[i][lane];
+        lane_run_scalar(group->lanes[lane], pool, group->input_pos[lane], pc, acc[lane],
+                        negative[lane] != 0, steps, group->max_steps);
+    }
+}
+
+static void group_run(struct lane_group* group, unsigned active)
+{
+    // LMC registers, one per lane. The negative flag is kept as a comparison mask.
+    short acc_spill[LANES];
+    short negative_spill[LANES];
+    const vec_t zero = v_set1(0);
+    vec_t acc = zero;
+    vec_t negative = zero;
+    unsigned char pc = 0;
+
+    // The lanes of a group have always executed the same number of instructions.
+    for (unsigned long long steps = 0; active; ++steps)
+    {
+        if (group->max_steps && steps >= group->max_steps)
+        {
+            for (int lane = 0; lane < LANES; ++lane)
+            {
+                if (active & (1u << lane))
+                    lane_fail_step_limit(group->lanes[lane], group->max_steps);
+            }
+            return;
+        }
+
+        // Every lane in the group must agree on the next instruction. Any lane whose
+        // mailbox holds something else has modified its code differently, so leaves.
+        short data = group->pool[pc][lowest_lane(active)];
+        unsigned same = v_mask(v_eq(v_load(group->pool[pc]), v_set1(data))) & active;
+        if (same != active)
+        {
+            v_store(acc_spill, acc);
+            v_store(negative_spill, negative);
+            group_eject(group, active & ~same, pc, acc_spill, negative_spill, steps);
+            active = same;
+        }
+
+        struct lmc_insn insn = lmc_decode(data);
+        unsigned char next = next_pc(pc);
+        unsigned taken;
+        switch (insn.op)
+        {
+            case HLT:
+            {
+                for (int lane = 0; lane < LANES; ++lane)
+                {
+                    if (active & (1u << lane))
+                        lane_halt(group->lanes[lane]);
+                }
+                return;
+            }
+            case ADD:
+            {
+                negative = zero;
+                acc = v_mod1000(v_add(acc, v_load(group->pool[insn.ar])));
+                pc = next;
+                continue;
+            }
+            case SUB:
+            {
+                vec_t value = v_load(group->pool[insn.ar]);
+                negative = v_gt(value, acc);
+                acc = v_mod1000(v_sub(acc, value));
+                pc = next;
+                continue;
+            }
+            case STA:
+            {
+                v_store(group->pool[insn.ar], acc);
+                pc = next;
+                continue;
+            }
+            case LDA:
+            {
+                negative = zero;
+                acc = v_load(group->pool[insn.ar]);
+                pc = next;
+                continue;
+            }
+            case BRA:
+            {
+                pc = insn.ar;
+                continue;
+            }
+            case BRZ:
+            {
+                taken = v_mask(v_eq(acc, zero)) & active;
+                break;
+            }
+            case BRP:
+            {
+                taken = ~v_mask(negative) & active;
+                break;
+            }
+            case INP:
+            {
+                v_store(acc_spill, acc);
+                v_store(negative_spill, negative);
+                for (int lane = 0; lane < LANES; ++lane)
+                {
+                    if (!(active & (1u << lane)))
+                        continue;
+                    bool flag;
+                    lane_input(group->lanes[lane], &group->input_pos[lane], &acc_spill[lane], &flag);
+                    negative_spill[lane] = -(short)flag;
+                }
+                acc = v_load(acc_spill);
+                negative = v_load(negative_spill);
+                pc = next;
+                continue;
+            }
+            case OUT:
+            {
+                v_store(acc_spill, acc);
+                for (int lane = 0; lane < LANES; ++lane)
+                {
+                    if (active & (1u << lane))
+                        lane_output(group->lanes[lane], acc_spill[lane]);
+                }
+                pc = next;
+                continue;
+            }
+            default:
+            {
+                for (int lane = 0; lane < LANES; ++lane)
+                {
+                    if (active & (1u << lane))
+                        lane_fail(group->lanes[lane], data);
+                }
+                return;
+            }
+        }
+
+        // BRZ/BRP: if the lanes disagree, the larger side stays in the group and the
+        // other side is finished off on its own.
+        if (taken == active)
+            pc = insn.ar;
+        else if (taken == 0)
+            pc = next;
+        else
+        {
+            unsigned not_taken = active & ~taken;
+            bool stay_taken = popcount(taken) >= popcount(not_taken);
+            v_store(acc_spill, acc);
+            v_store(negative_spill, negative);
+            group_eject(group, (stay_taken) ? not_taken : taken, (stay_taken) ? next : insn.ar,
+                        acc_spill, negative_spill, steps + 1);
+            active = (stay_taken) ? taken : not_taken;
+            pc = (stay_taken) ? insn.ar : next;
+        }
+    }
+}
+
+// Execute one assembled program over many input vectors at once.
+void lmc_execute_lanes(const struct mailboxes* program, struct lmc_lane* lanes, size_t count,
+                       unsigned long long max_steps)
+{
+    struct lane_group* group = (struct lane_group*)quick_malloc(sizeof(struct lane_group));
+    group->max_steps = max_steps;
+    for (size_t base = 0; base < count; base += LANES)
+    {
+        unsigned active = 0;
+        for (int lane = 0; lane < LANES; ++lane)
+        {
+            for (int i = 0; i < NUM_MAILBOXES; ++i)
+                group->pool[i][lane] = program->pool[i];
+            group->input_pos[lane] = 0;
+            group->lanes[lane] = NULL;
+            if (base + lane < count)
+            {
+                group->lanes[lane] = &lanes[base + lane];
+                group->lanes[lane]->output_count = 0;
+                group->lanes[lane]->error_msg[0] = '\0';
+                active |= 1u << lane;
+            }
+        }
+        group_run(group, active);
+    }
+    free(group);
+}
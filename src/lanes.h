@@ -0,0 +1,40 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "lmc.h"
+
+// One input vector for lockstep execution, and everything that running the program over it
+// produced. INP reads the next value of the input vector; a negative value -n behaves the
+// same as the text "-n" would on a stream (the accumulator becomes n with the negative flag
+// set), values are clamped to what INP could read from a stream, and reading past the end
+// yields 0. OUT appends to the output buffer, and output_count keeps counting even once
+// output_capacity is reached. status is LMC_STATUS_HALTED, LMC_STATUS_ERROR or
+// LMC_STATUS_STEP_LIMIT, and result is only true for the first.
+struct lmc_lane
+{
+    const short* input;
+    size_t input_count;
+    short* output;
+    size_t output_capacity;
+
+    size_t output_count;
+    enum lmc_status status;
+    bool result;
+    char error_msg[NUM_MAILBOXES * 2];
+};
+
+// Execute one assembled program over many input vectors at once. Every lane gets its own
+// copy of the pool, and the copies are stored as a structure of arrays so that groups of
+// lanes step through the program together using SIMD (SSE2, AVX2 or NEON, depending on what
+// the build targets). Lanes are taken out of the group and finished off individually
+// whenever they stop agreeing with the rest of it on the next instruction, which happens
+// when BRZ/BRP branch differently or when a lane modifies its code differently. Every lane
+// stops after max_steps instructions (unless it is 0), so that one which never halts can't
+// keep the rest of its group running forever.
+void lmc_execute_lanes(const struct mailboxes* program, struct lmc_lane* lanes, size_t count,
+                       unsigned long long max_steps);
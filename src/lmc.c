@@ -6,36 +6,25 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <limits.h>
 
+#include "io.h"
 #include "lmc.h"
+#include "lmc_internal.h"
+#include "trace.h"
 #include "util.h"
 
-#define OPCODE_LIST \
-    X(HLT)          \
-    X(ADD)          \
-    X(SUB)          \
-    X(STA)          \
-    X(DAT)          \
-    X(LDA)          \
-    X(BRA)          \
-    X(BRZ)          \
-    X(BRP)          \
-    X(INP)          \
-    X(OUT)          \
-    X(OP_COUNT)     \
-    X(OP_NULL)
-
-enum opcode
-{
-#define X(name) name,
-    OPCODE_LIST
+static const char* const engine_names[] =
+{
+#define X(name, string) string,
+    LMC_ENGINE_LIST
 #undef X
 };
 
-static const char* op_names[] =
+static const char* const arith_names[] =
 {
-#define X(name) #name,
-    OPCODE_LIST
+#define X(name, string) string,
+    LMC_ARITH_LIST
 #undef X
 };
 
@@ -48,56 +37,267 @@ struct pstring
     size_t column;
 };
 
-// The intermediate representation for an LMC opcode will consist of node structs which are
-// linked together. Each instance will contain an optional label attribute, the opcode type
-// (or the first digit for storing data with DAT - could be considered the segment), and an 
-// address offset.
+// The intermediate representation for an LMC program is an array of nodes, one for each
+// mailbox, allocated from the assembler's arena. Each instance will contain an optional label
+// attribute, the opcode type (or the first digit for storing data with DAT - could be
+// considered the segment), and an address offset.
 struct ir_node
 {
     struct pstring label;
     enum opcode op;
     char offset;
     struct pstring label_offset;
-    struct ir_node* next;
+    const char* source;     // The first token of the instruction.
+};
+
+// Labels are kept in an open-addressed hash table keyed case-insensitively on their name.
+// There can never be more labels than mailboxes, so a table of twice that size (rounded up to
+// a power of two) never fills up and keeps probe sequences short.
+#define LABEL_TABLE_SIZE    256
+
+struct label_entry
+{
+    struct pstring label;
+    unsigned char address;
 };
 
-void cleanup_ir_node(struct ir_node* node)
+static unsigned int label_hash(const struct pstring* label)
 {
-    struct ir_node* current;
-    struct ir_node* next = node;
-    while ((current = next) != NULL)
+    // FNV-1a over the upper-cased name.
+    unsigned int hash = 2166136261u;
+    for (size_t i = 0; i < label->length; i++)
+        hash = (hash ^ (unsigned char)toupper(label->string[i])) * 16777619u;
+    return hash;
+}
+
+// Find the slot holding a label, or the empty slot where it would go.
+static struct label_entry* label_lookup(struct label_entry* table, const struct pstring* label)
+{
+    unsigned int slot = label_hash(label) & (LABEL_TABLE_SIZE - 1);
+    for (;;)
     {
-        next = current->next;
-        free(current);
+        struct label_entry* entry = &table[slot];
+        if (entry->label.string == NULL)
+            return entry;
+        if (entry->label.length == label->length &&
+            util_strncasecmp(entry->label.string, label->string, label->length) == 0)
+            return entry;
+        slot = (slot + 1) & (LABEL_TABLE_SIZE - 1);
     }
 }
 
+// strtol() for a token, which unlike strtol() never looks past the end of the token (the
+// buffer being assembled need not be NUL-terminated).
+static long pstring_strtol(const struct pstring* token)
+{
+    long value = 0;
+    for (size_t i = 0; i < token->length && isdigit(token->string[i]); i++)
+    {
+        int digit = token->string[i] - '0';
+        if (value > (LONG_MAX - digit) / 10)
+            return LONG_MAX;
+        value = value * 10 + digit;
+    }
+    return value;
+}
+
+const unsigned char lmc_lex_classes[256] =
+{
+    ['\0'] = LMC_LEX_SPACE,
+    ['\t'] = LMC_LEX_SPACE,
+    ['\n'] = LMC_LEX_SPACE | LMC_LEX_EOL,
+    ['\v'] = LMC_LEX_SPACE,
+    ['\f'] = LMC_LEX_SPACE,
+    ['\r'] = LMC_LEX_SPACE,
+    [' ']  = LMC_LEX_SPACE,
+    [';']  = LMC_LEX_SPACE | LMC_LEX_EOL,
+};
+
 bool program_isspace(int c)
 {
-    return isspace(c) || c == '\0' || c == ';';
+    return lmc_lex_isspace((char)c);
 }
 
 bool program_eol(int c)
 {
-    return c == '\n' || c == ';';
+    return (lmc_lex_classes[(unsigned char)c] & LMC_LEX_EOL) != 0;
+}
+
+// Tokens and the whitespace between them are skipped a block at a time, classifying every
+// byte of the block at once: lex_block() sets one bit in space for each byte that separates
+// tokens, and one bit in eol for each newline or semicolon.
+#if defined(__AVX2__)
+
+#include <immintrin.h>
+
+#define LEX_BLOCK       32
+#define LEX_BLOCK_MASK  0xFFFFFFFFu
+
+static inline void lex_block(const char* p, unsigned* space, unsigned* eol)
+{
+    __m256i v = _mm256_loadu_si256((const __m256i*)p);
+    __m256i controls = _mm256_sub_epi8(v, _mm256_set1_epi8('\t'));
+    controls = _mm256_cmpeq_epi8(_mm256_min_epu8(controls, _mm256_set1_epi8('\r' - '\t')), controls);
+    __m256i ends = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')),
+                                   _mm256_cmpeq_epi8(v, _mm256_set1_epi8(';')));
+    __m256i blanks = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                                     _mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+    *space = (unsigned)_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(controls, blanks), ends));
+    *eol = (unsigned)_mm256_movemask_epi8(ends);
+}
+
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+
+#include <emmintrin.h>
+
+#define LEX_BLOCK       16
+#define LEX_BLOCK_MASK  0xFFFFu
+
+static inline void lex_block(const char* p, unsigned* space, unsigned* eol)
+{
+    __m128i v = _mm_loadu_si128((const __m128i*)p);
+    __m128i controls = _mm_sub_epi8(v, _mm_set1_epi8('\t'));
+    controls = _mm_cmpeq_epi8(_mm_min_epu8(controls, _mm_set1_epi8('\r' - '\t')), controls);
+    __m128i ends = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')),
+                                _mm_cmpeq_epi8(v, _mm_set1_epi8(';')));
+    __m128i blanks = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                                  _mm_cmpeq_epi8(v, _mm_setzero_si128()));
+    *space = (unsigned)_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(controls, blanks), ends));
+    *eol = (unsigned)_mm_movemask_epi8(ends);
+}
+
+#elif (defined(__ARM_NEON) && defined(__aarch64__)) || defined(_M_ARM64)
+
+#include <arm_neon.h>
+
+#define LEX_BLOCK       16
+#define LEX_BLOCK_MASK  0xFFFFu
+
+static inline unsigned lex_mask(uint8x16_t m)
+{
+    static const uint8_t bits[16] = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+    uint8x16_t masked = vandq_u8(m, vld1q_u8(bits));
+    return vaddv_u8(vget_low_u8(masked)) | ((unsigned)vaddv_u8(vget_high_u8(masked)) << 8);
+}
+
+static inline void lex_block(const char* p, unsigned* space, unsigned* eol)
+{
+    uint8x16_t v = vld1q_u8((const uint8_t*)p);
+    uint8x16_t controls = vcleq_u8(vsubq_u8(v, vdupq_n_u8('\t')), vdupq_n_u8('\r' - '\t'));
+    uint8x16_t ends = vorrq_u8(vceqq_u8(v, vdupq_n_u8('\n')), vceqq_u8(v, vdupq_n_u8(';')));
+    uint8x16_t blanks = vorrq_u8(vceqq_u8(v, vdupq_n_u8(' ')), vceqzq_u8(v));
+    *space = lex_mask(vorrq_u8(vorrq_u8(controls, blanks), ends));
+    *eol = lex_mask(ends);
+}
+
+#endif
+
+size_t lmc_lex_token_end(const char* buffer, size_t from, size_t to)
+{
+#ifdef LEX_BLOCK
+    for (; from + LEX_BLOCK <= to; from += LEX_BLOCK)
+    {
+        unsigned space, eol;
+        lex_block(&buffer[from], &space, &eol);
+        if (space != 0)
+            return from + util_ctz(space);
+    }
+#endif
+    while (from < to && !lmc_lex_isspace(buffer[from]))
+        from++;
+    return from;
+}
+
+size_t lmc_lex_blank_end(const char* buffer, size_t from, size_t to)
+{
+#ifdef LEX_BLOCK
+    for (; from + LEX_BLOCK <= to; from += LEX_BLOCK)
+    {
+        unsigned space, eol;
+        lex_block(&buffer[from], &space, &eol);
+        unsigned others = ~(space & ~eol) & LEX_BLOCK_MASK;
+        if (others != 0)
+            return from + util_ctz(others);
+    }
+#endif
+    while (from < to && lmc_lex_classes[(unsigned char)buffer[from]] == LMC_LEX_SPACE)
+        from++;
+    return from;
+}
+
+// Mnemonics are looked up in a perfect hash of their upper-cased letters, which puts each of
+// the eleven in a slot of its own. Folding with & ~0x20 rather than toupper() only changes
+// what non-letters map to, and the key is compared in full, so nothing else can match.
+#define LEX_OPCODE_KEY(a, b, c) (((unsigned)(a) << 16) | ((unsigned)(b) << 8) | (unsigned)(c))
+#define LEX_OPCODE_SLOT(key)    ((unsigned)((key) * 10803111u) >> 28)
+
+// The slots that no mnemonic hashes to have a key that no token can have.
+static const struct
+{
+    unsigned key;
+    enum opcode op;
+} lex_opcodes[16] =
+{
+#define X(name, a, b, c) [LEX_OPCODE_SLOT(LEX_OPCODE_KEY(a, b, c))] = { LEX_OPCODE_KEY(a, b, c), name },
+    X(HLT, 'H', 'L', 'T')
+    X(ADD, 'A', 'D', 'D')
+    X(SUB, 'S', 'U', 'B')
+    X(STA, 'S', 'T', 'A')
+    X(DAT, 'D', 'A', 'T')
+    X(LDA, 'L', 'D', 'A')
+    X(BRA, 'B', 'R', 'A')
+    X(BRZ, 'B', 'R', 'Z')
+    X(BRP, 'B', 'R', 'P')
+    X(INP, 'I', 'N', 'P')
+    X(OUT, 'O', 'U', 'T')
+#undef X
+};
+
+enum opcode lmc_lex_opcode(const char* token)
+{
+    unsigned key = LEX_OPCODE_KEY((unsigned char)token[0] & ~0x20, (unsigned char)token[1] & ~0x20,
+                                  (unsigned char)token[2] & ~0x20);
+    unsigned slot = LEX_OPCODE_SLOT(key);
+    return (lex_opcodes[slot].key == key) ? lex_opcodes[slot].op : OP_COUNT;
+}
+
+_Static_assert(sizeof(struct ir_node) * NUM_MAILBOXES + sizeof(struct label_entry) * LABEL_TABLE_SIZE
+               + 2 * sizeof(max_align_t) <= LMC_ASSEMBLER_SCRATCH_SIZE,
+               "LMC_ASSEMBLER_SCRATCH_SIZE is too small");
+
+bool lmc_assemble(const char* buffer, size_t length, struct mailboxes* mailboxes)
+{
+    struct lmc_assembler assembler;
+    return lmc_assemble_ex(&assembler, buffer, length, mailboxes);
 }
 
 // Assemble an LMC program. This is a two-pass assembler (the first pass generates an 
 // intermediate representation, whereas the second assembles the actual mailboxes).
-bool lmc_assemble(const char* buffer, size_t length, struct mailboxes* mailboxes)
+bool lmc_assemble_ex(struct lmc_assembler* assembler, const char* buffer, size_t length,
+                     struct mailboxes* mailboxes)
 {
-    memset(mailboxes->pool, 0, NUM_MAILBOXES);
+    memset(mailboxes->pool, 0, sizeof(mailboxes->pool));
+
+    // Everything the assembler needs lives in the scratch arena, which is simply started
+    // over for every program.
+    struct util_arena arena;
+    util_arena_init(&arena, assembler->scratch, sizeof(assembler->scratch));
+    struct ir_node* nodes = 
+        (struct ir_node*)util_arena_alloc(&arena, sizeof(struct ir_node) * NUM_MAILBOXES);
 
-    // Hold an array of all cached labels. A trie/dictionary would be more efficient,
-    // but there's only 100 mailboxes and this is a basic assembler anyway.
-    struct pstring cached_labels[NUM_MAILBOXES] = { { NULL, 0 } };
+    // Labels are hashed as they are defined in the first pass, so that the second pass can
+    // resolve each reference with a single lookup.
+    struct label_entry* labels = 
+        (struct label_entry*)util_arena_alloc(&arena,
+                                              sizeof(struct label_entry) * LABEL_TABLE_SIZE);
 
     // This is a strange tokeniser, but I'm trying to minimize memory allocations here.
     // Effectively offset into tokens within the buffer and use strncmp for string
-    // comparisons. This makes up the first pass of the assembler.
+    // comparisons. This makes up the first pass of the assembler. Comments, the body of each
+    // token and runs of whitespace are each skipped in one go rather than a character at a
+    // time, so that the loop only goes round for the characters that matter.
     bool is_comment = false;
-    struct ir_node* head = (struct ir_node*)quick_malloc(sizeof(struct ir_node));
-    struct ir_node* ir = head;
+    struct ir_node* ir = nodes;
     struct pstring start = { NULL };
     struct pstring erroneous_token;
     size_t offset = 0;
@@ -109,8 +309,9 @@ bool lmc_assemble(const char* buffer, size_t length, struct mailboxes* mailboxes
     {
         if (is_comment)
         {
-            if (buffer[offset++] == '\n')
-                is_comment = false;
+            const char* eol = memchr(&buffer[offset], '\n', length - offset);
+            offset = (eol != NULL) ? (size_t)(eol - buffer) + 1 : length;
+            is_comment = false;
             continue;
         }
 
@@ -125,7 +326,7 @@ bool lmc_assemble(const char* buffer, size_t length, struct mailboxes* mailboxes
             }
         }
 
-        if (!program_isspace(buffer[offset]))
+        if (!lmc_lex_isspace(buffer[offset]))
         {
             start.length++;
             if (start.string == NULL)
@@ -134,28 +335,31 @@ bool lmc_assemble(const char* buffer, size_t length, struct mailboxes* mailboxes
                 start.line = address + 1;
                 start.column = column;
             }
+
+            // Take in the rest of the token, up to its last character.
+            size_t last = lmc_lex_token_end(buffer, offset + 1, length) - 1;
+            start.length += last - offset;
+            column += last - offset;
+            offset = last;
         }
 
-        if (program_isspace(buffer[offset]) || (offset + 1) >= length)
+        if (lmc_lex_isspace(buffer[offset]) || (offset + 1) >= length)
         {
             if (start.string != NULL)
             {
-                // Decode the opcode used where applicable. A trie/hashmap would be more ideal
-                // in this context, but since this is a small instruction set, I'm not too
-                // concerned.
-                enum opcode op = (isalpha(start.string[0]) && ir->op == OP_NULL && start.length == 3) 
-                               ? HLT 
+                if (ir->source == NULL)
+                    ir->source = start.string;
+
+                // Decode the opcode used where applicable.
+                enum opcode op = (ir->op == OP_NULL && start.length == 3)
+                               ? lmc_lex_opcode(start.string)
                                : OP_COUNT;
-                for (; op < OP_COUNT; op++)
+                if (op != OP_COUNT)
                 {
-                    if (util_strncasecmp(start.string, op_names[op], 3) == 0)
-                    {
-                        // INP and OUT are encoded as 901 and 902 respectively.
-                        ir->op = min(op, 9);
-                        if (ir->op == 9)
-                            ir->offset = max(0, op - 8);
-                        break;
-                    }
+                    // INP and OUT are encoded as 901 and 902 respectively.
+                    ir->op = min(op, 9);
+                    if (ir->op == 9)
+                        ir->offset = max(0, op - 8);
                 }
 
                 // Was this actually an opcode that was decoded?
@@ -164,8 +368,19 @@ bool lmc_assemble(const char* buffer, size_t length, struct mailboxes* mailboxes
                     // Check if a label was decoded instead.
                     if (ir->label.string == NULL && isalpha(start.string[0]) && ir->op == OP_NULL)
                     {
+                        struct label_entry* entry = label_lookup(labels, &start);
+                        if (entry->label.string != NULL)
+                        {
+                            sprintf_s(mailboxes->error_msg, sizeof(mailboxes->error_msg),
+                                      "Duplicate label on line %d:%d: ", (int)start.line,
+                                      (int)start.column);
+                            strncat_s(mailboxes->error_msg, sizeof(mailboxes->error_msg),
+                                      start.string, start.length);
+                            goto compiler_fail;
+                        }
+                        entry->label = start;
+                        entry->address = (unsigned char)address;
                         ir->label = start;
-                        cached_labels[address] = start;
                     }
 
                     // This might've been an offset instead?
@@ -173,7 +388,7 @@ bool lmc_assemble(const char* buffer, size_t length, struct mailboxes* mailboxes
                     {
                         if (isdigit(start.string[0]))
                         {
-                            int num = strtol(start.string, NULL, 10);
+                            int num = (int)pstring_strtol(&start);
                             if (ir->op == DAT)
                                 ir->op = (num / 100) % 10;
                             ir->offset = num % 100;
@@ -204,10 +419,6 @@ bool lmc_assemble(const char* buffer, size_t length, struct mailboxes* mailboxes
                 }
                 else
                 {
-                    ir->next = (struct ir_node*)quick_malloc(sizeof(struct ir_node));
-                    ir = ir->next;
-                    ir->op = OP_NULL;
-                    ir->offset = -1;
                     address++;
                     column = 0; // Column is always incremented below.
 
@@ -218,11 +429,24 @@ bool lmc_assemble(const char* buffer, size_t length, struct mailboxes* mailboxes
                                  "Program is too large");
                         goto compiler_fail;
                     }
+
+                    ir = &nodes[address];
+                    ir->op = OP_NULL;
+                    ir->offset = -1;
                 }
             }
 
             start.string = NULL;
             start.length = 0;
+
+            // Skip the whitespace that follows, stopping short of the last character so that
+            // the end of the source still ends the instruction.
+            if (!is_comment && length - offset > 2)
+            {
+                size_t next = lmc_lex_blank_end(buffer, offset + 1, length - 1);
+                column += next - (offset + 1);
+                offset = next - 1;
+            }
         }
         
         offset++;
@@ -239,29 +463,40 @@ bool lmc_assemble(const char* buffer, size_t length, struct mailboxes* mailboxes
 
     // The second pass of the assembler is responsible for actually assembling the
     // mailboxes.
-    ir = head;
-    address = 0;
-    while (ir)
+    struct lmc_symbols* symbols = &assembler->symbols;
+    memset(symbols->lines, 0, sizeof(symbols->lines));
+    symbols->count = 0;
+    const char* line_start = buffer;
+    unsigned int line = 1;
+
+    size_t count = address;
+    for (address = 0; address < count; address++)
     {
-        if (ir->op == OP_NULL)
-            break;
+        ir = &nodes[address];
+
+        // Note down where this came from in the source.
+        for (const char* eol; (eol = memchr(line_start, '\n', ir->source - line_start)) != NULL;)
+        {
+            line_start = eol + 1;
+            line++;
+        }
+        symbols->lines[address] = line;
+        if (ir->label.string != NULL)
+        {
+            struct lmc_symbol* symbol = &symbols->symbols[symbols->count++];
+            size_t name_length = min(ir->label.length, sizeof(symbol->name) - 1);
+            symbol->address = (unsigned char)address;
+            memcpy(symbol->name, ir->label.string, name_length);
+            symbol->name[name_length] = '\0';
+        }
 
         short value = ir->op * 100;
         if (ir->label_offset.string != NULL)
         {
-            bool label_found = false;
-            for (int i = 0; i < NUM_MAILBOXES; ++i)
-            {
-                if (ir->label_offset.length != cached_labels[i].length)
-                    continue;
-                if (util_strncasecmp(ir->label_offset.string, cached_labels[i].string, 
-                    ir->label_offset.length) != 0)
-                    continue;
-                label_found = true;
-                value += i;
-            }
-
-            if (!label_found)
+            const struct label_entry* entry = label_lookup(labels, &ir->label_offset);
+            if (entry->label.string != NULL)
+                value += entry->address;
+            else
             {
                 erroneous_token = ir->label_offset;
                 goto lexer_fail;
@@ -269,12 +504,9 @@ bool lmc_assemble(const char* buffer, size_t length, struct mailboxes* mailboxes
         }
         else if (ir->offset != -1)
             value += ir->offset % 100;
-        mailboxes->pool[address++] = value;
-
-        ir = ir->next;
+        mailboxes->pool[address] = value;
     }
 
-    cleanup_ir_node(head);
     return true;
 
 lexer_fail:
@@ -285,17 +517,329 @@ lexer_fail:
               erroneous_token.string,
               erroneous_token.length);
 compiler_fail:
-    cleanup_ir_node(head);
     return false;
 }
 
-// Execute an assembled LMC program.
-bool lmc_execute(struct mailboxes* mailboxes)
+// A line of source held by the incremental assembler, along with what it assembles to. Tokens
+// are kept as offsets into the line's own copy of its text.
+struct source_line
+{
+    char* text;
+    size_t length;
+
+    bool instruction;       // Whether the line holds an instruction.
+    enum opcode op;
+    char offset;
+    size_t label, label_length;
+    size_t label_offset, label_offset_length;
+
+    // The first token that could not be made sense of, if there was one.
+    bool error;
+    size_t error_token, error_length;
+};
+
+struct lmc_incremental
+{
+    struct source_line* lines;
+    size_t count;
+    size_t capacity;
+
+    short pool[NUM_MAILBOXES];
+    struct lmc_symbols symbols;
+    struct label_entry labels[LABEL_TABLE_SIZE];
+    char error[NUM_MAILBOXES * 2];
+};
+
+// Tokenise one line, following exactly the same rules as the first pass of lmc_assemble_ex()
+// does for each of its instructions, other than the labels that it defines being checked
+// against the rest of the program.
+static void incremental_tokenise(struct source_line* line)
+{
+    line->instruction = false;
+    line->op = OP_NULL;
+    line->offset = -1;
+    line->label_length = line->label_offset_length = 0;
+    line->error = false;
+
+    // Everything after a semicolon is a comment.
+    const char* text = line->text;
+    const char* semicolon = memchr(text, ';', line->length);
+    size_t end = semicolon ? (size_t)(semicolon - text) : line->length;
+    size_t offset = 0;
+    while (offset < end)
+    {
+        if (lmc_lex_isspace(text[offset]))
+        {
+            offset++;
+            continue;
+        }
+        struct pstring token = { .string = &text[offset], .length = 0 };
+        offset = lmc_lex_token_end(text, offset, end);
+        token.length = &text[offset] - token.string;
+
+        enum opcode op = (line->op == OP_NULL && token.length == 3)
+                       ? lmc_lex_opcode(token.string)
+                       : OP_COUNT;
+        if (op != OP_COUNT)
+        {
+            line->op = min(op, 9);
+            if (line->op == 9)
+                line->offset = max(0, op - 8);
+            continue;
+        }
+
+        if (line->label_length == 0 && isalpha(token.string[0]) && line->op == OP_NULL)
+        {
+            line->label = token.string - text;
+            line->label_length = token.length;
+        }
+        else if (line->offset == -1 && line->label_offset_length == 0 && line->op != OP_NULL)
+        {
+            if (isdigit(token.string[0]))
+            {
+                int num = (int)pstring_strtol(&token);
+                if (line->op == DAT)
+                    line->op = (num / 100) % 10;
+                line->offset = num % 100;
+            }
+            else
+            {
+                line->label_offset = token.string - text;
+                line->label_offset_length = token.length;
+            }
+        }
+        else
+        {
+            line->error = true;
+            line->error_token = token.string - text;
+            line->error_length = token.length;
+            return;
+        }
+    }
+
+    // A label has to label something.
+    line->instruction = (line->op != OP_NULL);
+    if (!line->instruction && line->label_length > 0)
+    {
+        line->error = true;
+        line->error_token = line->label;
+        line->error_length = line->label_length;
+    }
+}
+
+static void incremental_fail(struct lmc_incremental* incremental, const char* message, 
+                             size_t line, const char* token, size_t token_length)
+{
+    sprintf_s(incremental->error, sizeof(incremental->error), "%s on line %d:%d: ", message,
+              (int)line + 1, (int)(token - incremental->lines[line].text) + 1);
+    strncat_s(incremental->error, sizeof(incremental->error), token, token_length);
+}
+
+// Assemble the program from its tokenised lines. This is the first pass of the assembler
+// without the tokenising, followed by the second pass as it is.
+static bool incremental_assemble(struct lmc_incremental* incremental, short* pool,
+                                 struct lmc_symbols* symbols)
+{
+    struct label_entry* labels = incremental->labels;
+    memset(labels, 0, sizeof(incremental->labels));
+    size_t lines[NUM_MAILBOXES];
+    size_t count = 0;
+    for (size_t i = 0; i < incremental->count; ++i)
+    {
+        const struct source_line* line = &incremental->lines[i];
+        if (line->label_length > 0)
+        {
+            struct pstring label = { .string = &line->text[line->label],
+                                     .length = line->label_length };
+            struct label_entry* entry = label_lookup(labels, &label);
+            if (entry->label.string != NULL)
+            {
+                incremental_fail(incremental, "Duplicate label", i, label.string, label.length);
+                return false;
+            }
+            entry->label = label;
+            entry->address = (unsigned char)count;
+        }
+        if (line->error)
+        {
+            incremental_fail(incremental, "Unknown token", i, &line->text[line->error_token],
+                             line->error_length);
+            return false;
+        }
+        if (!line->instruction)
+            continue;
+
+        // The program must not be bigger than 100 mailboxes.
+        if (count + 1 >= NUM_MAILBOXES)
+        {
+            strcpy_s(incremental->error, sizeof(incremental->error), "Program is too large");
+            return false;
+        }
+        lines[count++] = i;
+    }
+
+    memset(pool, 0, sizeof(short) * NUM_MAILBOXES);
+    memset(symbols->lines, 0, sizeof(symbols->lines));
+    symbols->count = 0;
+    for (size_t address = 0; address < count; ++address)
+    {
+        const struct source_line* line = &incremental->lines[lines[address]];
+        symbols->lines[address] = (unsigned int)lines[address] + 1;
+        if (line->label_length > 0)
+        {
+            struct lmc_symbol* symbol = &symbols->symbols[symbols->count++];
+            size_t name_length = min(line->label_length, sizeof(symbol->name) - 1);
+            symbol->address = (unsigned char)address;
+            memcpy(symbol->name, &line->text[line->label], name_length);
+            symbol->name[name_length] = '\0';
+        }
+
+        short value = line->op * 100;
+        if (line->label_offset_length > 0)
+        {
+            struct pstring label = { .string = &line->text[line->label_offset],
+                                     .length = line->label_offset_length };
+            const struct label_entry* entry = label_lookup(labels, &label);
+            if (entry->label.string == NULL)
+            {
+                incremental_fail(incremental, "Unknown token", lines[address], label.string,
+                                 label.length);
+                return false;
+            }
+            value += entry->address;
+        }
+        else if (line->offset != -1)
+            value += line->offset % 100;
+        pool[address] = value;
+    }
+    return true;
+}
+
+struct lmc_incremental* lmc_incremental_create(void)
+{
+    return (struct lmc_incremental*)quick_malloc(sizeof(struct lmc_incremental));
+}
+
+void lmc_incremental_destroy(struct lmc_incremental* incremental)
+{
+    for (size_t i = 0; i < incremental->count; ++i)
+        free(incremental->lines[i].text);
+    free(incremental->lines);
+    free(incremental);
+}
+
+bool lmc_incremental_edit(struct lmc_incremental* incremental, size_t first, size_t count,
+                          const char* text, size_t length, struct lmc_changes* changes)
+{
+    first = min(first, incremental->count);
+    count = min(count, incremental->count - first);
+    size_t added = 0;
+    for (size_t i = 0; i < length; ++i)
+        added += (text[i] == '\n') || (i + 1 == length && text[i] != '\n');
+
+    // Make room for the new lines in place of the old ones.
+    for (size_t i = first; i < first + count; ++i)
+        free(incremental->lines[i].text);
+    size_t total = incremental->count - count + added;
+    if (total > incremental->capacity)
+    {
+        incremental->capacity = max(total, incremental->capacity * 2);
+        incremental->lines = (struct source_line*)quick_realloc(incremental->lines, 
+            incremental->capacity * sizeof(struct source_line));
+    }
+    if (first + count < incremental->count)
+    {
+        memmove(&incremental->lines[first + added], &incremental->lines[first + count],
+                (incremental->count - first - count) * sizeof(struct source_line));
+    }
+    incremental->count = total;
+
+    // Only the new lines are tokenised.
+    const char* cursor = text;
+    const char* end = text + length;
+    for (size_t i = first; i < first + added; ++i)
+    {
+        const char* eol = memchr(cursor, '\n', end - cursor);
+        if (!eol)
+            eol = end;
+        struct source_line* line = &incremental->lines[i];
+        line->length = eol - cursor;
+        line->text = (char*)quick_malloc(line->length + 1);
+        memcpy(line->text, cursor, line->length);
+        incremental_tokenise(line);
+        cursor = eol + 1;
+    }
+
+    if (changes)
+        changes->count = 0;
+    short pool[NUM_MAILBOXES];
+    struct lmc_symbols symbols;
+    if (!incremental_assemble(incremental, pool, &symbols))
+        return false;
+    incremental->symbols = symbols;
+    incremental->error[0] = '\0';
+    for (int address = 0; address < NUM_MAILBOXES; ++address)
+    {
+        if (pool[address] == incremental->pool[address])
+            continue;
+        incremental->pool[address] = pool[address];
+        if (changes)
+            changes->addresses[changes->count++] = (unsigned char)address;
+    }
+    return true;
+}
+
+size_t lmc_incremental_lines(const struct lmc_incremental* incremental)
+{
+    return incremental->count;
+}
+
+const short* lmc_incremental_pool(const struct lmc_incremental* incremental)
+{
+    return incremental->pool;
+}
+
+const struct lmc_symbols* lmc_incremental_symbols(const struct lmc_incremental* incremental)
+{
+    return &incremental->symbols;
+}
+
+const char* lmc_incremental_error(const struct lmc_incremental* incremental)
+{
+    return incremental->error;
+}
+
+_Static_assert(OUT + 1 == LMC_NUM_OPCODES, "LMC_NUM_OPCODES does not match OPCODE_LIST");
+
+// Count a branch instruction. pc has already moved past it.
+static inline void profile_branch(struct lmc_profile* profile, unsigned char pc, unsigned char ar,
+                                  bool taken)
+{
+    unsigned char at = (pc + 99) % 100;
+    if (taken)
+    {
+        profile->taken[at]++;
+        profile->targets[at] = ar;
+    }
+    else
+        profile->not_taken[at]++;
+}
+
+// The reference interpreter, which decodes every instruction as it is fetched. It also
+// serves as the profiler and the tracer: the default variants pass a constant NULL profile
+// and trace so that every bit of bookkeeping compiles out of them, and only runs that ask for
+// a profile or a trace go through the variants that keep them. Both kinds are instantiated
+// once per accumulator convention.
+static LMC_FORCEINLINE bool execute_switch_core(struct mailboxes* mailboxes, struct lmc_exec* exec,
+                                                const struct lmc_regs* start, const bool limited,
+                                                const enum lmc_arith arith,
+                                                struct lmc_profile* const profile,
+                                                struct lmc_trace* const trace)
 {
     // LMC registers.
-    unsigned char pc = 0;       // Program counter.
-    unsigned char ar = 0;       // Address register.
-    short acc = 0;              // Accumulator.
+    unsigned char pc = start->pc;   // Program counter.
+    unsigned char ar = 0;           // Address register.
+    short acc = start->acc;         // Accumulator.
     enum opcode ir = OP_NULL;   // Instruction register.
     
     // This LMC interpreter assumes that the accumulator can only hold 3-digit
@@ -303,95 +847,358 @@ bool lmc_execute(struct mailboxes* mailboxes)
     // realistically handled. Some simulators treat this differently (i.e.
     // tolerate -999 to 999, or just straight up undefined behaviour). Instead,
     // this interpreter incorporates a negative flag that is set to true if
-    // a subtraction calculation underflows.
-    bool negative = false;
+    // a subtraction calculation underflows. The other conventions in LMC_ARITH_LIST
+    // can be picked with lmc_exec::arith instead.
+    bool negative = start->negative;
 
+    unsigned long long steps = start->steps;
     for (;;)
     {
+        if (limited && steps == exec->max_steps)
+            return lmc_fail_step_limit(mailboxes, exec);
+        steps++;
+
         // Fetch the opcode from the current mailbox.
         short data = mailboxes->pool[pc];
+        if (profile)
+            profile->hits[pc]++;
+        unsigned char at = pc;
+        short before = acc;
+        bool taken = false;
         pc = (pc + 1) % 100;
 
         // Decode the fetched opcode.
         ir = data / 100 + ((data / 100 == INP) ? data % 100 - 1 : 0);
         ar = data % 100;
+        if (profile && ir >= HLT && ir <= OUT)
+            profile->opcodes[ir]++;
         
         // Execute the fetched opcode.
         switch (ir)
         {
             case HLT:
-                goto halt;
+            {
+                if (trace)
+                    lmc_trace_step(trace, at, pc, HLT, 0, negative, false);
+                return lmc_halt(exec, steps);
+            }
             case ADD:
             {
-                negative = false;
-                acc = (acc + mailboxes->pool[ar]) % 1000;
+                if (profile)
+                    profile->reads[ar]++;
+                lmc_arith_add(arith, &acc, &negative, mailboxes->pool[ar]);
                 break;
             }
             case SUB:
             {
-                negative = (acc < mailboxes->pool[ar]);
-                acc = (acc - mailboxes->pool[ar]) % 1000;
+                if (profile)
+                    profile->reads[ar]++;
+                lmc_arith_sub(arith, &acc, &negative, mailboxes->pool[ar]);
                 break;
             }
             case STA:
             {
+                if (profile)
+                    profile->writes[ar]++;
                 mailboxes->pool[ar] = acc;
                 break;
             }
             case LDA:
             {
+                if (profile)
+                    profile->reads[ar]++;
                 negative = false;
                 acc = mailboxes->pool[ar];
                 break;
             }
             case BRA:
             {
+                if (profile)
+                    profile_branch(profile, pc, ar, true);
+                taken = true;
                 pc = ar;
                 break;
             }
             case BRZ:
             {
-                if (acc == 0)
+                if (profile)
+                    profile_branch(profile, pc, ar, acc == 0);
+                taken = (acc == 0);
+                if (taken)
                     pc = ar;
                 break;
             }
             case BRP:
             {
-                if (!negative)
+                taken = lmc_arith_positive(arith, acc, negative);
+                if (profile)
+                    profile_branch(profile, pc, ar, taken);
+                if (taken)
                     pc = ar;
                 break;
             }
             case INP:
             {
-                // A three-digit value is read from the input file stream into
-                // the accumulator, setting the negative flag where necessary.
-                // A char buffer of size 5 is selected to account for the negative,
-                // sign maximum digit length and the terminating NUL character.
-                char buffer[5];
-                fgets(buffer, sizeof(buffer), mailboxes->instream);
-                negative = (buffer[0] == '-');
-                if (negative)
-                    acc = atoi(&buffer[1]);
-                else
-                    acc = atoi(buffer);
+                // A three-digit value is read from the input into the accumulator,
+                // setting the negative flag where necessary.
+                if (lmc_input_blocked(exec))
+                    return lmc_suspend(exec, (pc + 99) % 100, acc, negative, steps - 1);
+                lmc_io_read(exec->io, &acc, &negative);
+                lmc_arith_input(arith, &acc, &negative);
                 break;
             }
             case OUT:
             {
                 // A newline-terminated string of the three-digit accumulator is
-                // sent to to the output file stream.
-                fprintf(mailboxes->outstream, "%d\n", acc);
+                // sent to to the output.
+                if (!lmc_io_write(exec->io, acc))
+                {
+                    if (trace)
+                        lmc_trace_step(trace, at, pc, OUT, 0, negative, false);
+                    return lmc_mismatch(mailboxes, exec, steps);
+                }
                 break;
             }
             default:
             {
-                sprintf_s(mailboxes->error_msg, sizeof(mailboxes->error_msg), "Unknown opcode %d",
-                          ir);
-                return false;
+                if (trace)
+                    lmc_trace_step(trace, at, pc, LMC_TRACE_BAD_OPCODE, 0, negative, false);
+                return lmc_fail_opcode(mailboxes, exec, steps, ir);
             }
         }
+        if (trace)
+            lmc_trace_step(trace, at, pc, ir, acc - before, negative, taken);
+    }
+}
+
+#define X(name, string)                                                                         \
+    static LMC_FORCEINLINE bool execute_switch_##name(struct mailboxes* mailboxes,              \
+                                                      struct lmc_exec* exec,                    \
+                                                      const struct lmc_regs* start,             \
+                                                      const bool limited)                       \
+    {                                                                                           \
+        return execute_switch_core(mailboxes, exec, start, limited, LMC_ARITH_##name,           \
+                                   NULL, NULL);                                                 \
+    }                                                                                           \
+    static LMC_FORCEINLINE bool execute_instrumented_##name(struct mailboxes* mailboxes,        \
+                                                            struct lmc_exec* exec,              \
+                                                            const struct lmc_regs* start,       \
+                                                            const bool limited)                 \
+    {                                                                                           \
+        return execute_switch_core(mailboxes, exec, start, limited, LMC_ARITH_##name,           \
+                                   exec->profile, exec->trace);                                 \
+    }                                                                                           \
+    LMC_ENGINE_VARIANTS(execute_switch_##name)                                                  \
+    LMC_ENGINE_VARIANTS(execute_instrumented_##name)
+LMC_ARITH_LIST
+#undef X
+
+bool lmc_execute_switch(struct mailboxes* mailboxes, struct lmc_exec* exec,
+                        const struct lmc_regs* start)
+{
+    switch (exec->arith)
+    {
+#define X(name, string)                                                             \
+        case LMC_ARITH_##name:                                                      \
+            return LMC_ENGINE_RUN(execute_switch_##name, mailboxes, exec, start);
+        LMC_ARITH_LIST
+#undef X
+        default:
+            return LMC_ENGINE_RUN(execute_switch_FLAG, mailboxes, exec, start);
+    }
+}
+
+// The reference interpreter, keeping the run's profile and trace.
+static bool execute_instrumented(struct mailboxes* mailboxes, struct lmc_exec* exec,
+                                 const struct lmc_regs* start)
+{
+    switch (exec->arith)
+    {
+#define X(name, string)                                                             \
+        case LMC_ARITH_##name:                                                      \
+            return LMC_ENGINE_RUN(execute_instrumented_##name, mailboxes, exec, start);
+        LMC_ARITH_LIST
+#undef X
+        default:
+            return LMC_ENGINE_RUN(execute_instrumented_FLAG, mailboxes, exec, start);
     }
+}
 
-halt:
+// End a run that executed HLT.
+bool lmc_halt(struct lmc_exec* exec, unsigned long long steps)
+{
+    lmc_io_flush(exec->io);
+    exec->steps = steps;
+    exec->status = LMC_STATUS_HALTED;
     return true;
+}
+
+// End a run that tried to execute something other than an opcode.
+bool lmc_fail_opcode(struct mailboxes* mailboxes, struct lmc_exec* exec, unsigned long long steps,
+                     int ir)
+{
+    lmc_io_flush(exec->io);
+    exec->steps = steps;
+    exec->status = LMC_STATUS_ERROR;
+    sprintf_s(mailboxes->error_msg, sizeof(mailboxes->error_msg), "Unknown opcode %d", ir);
+    return false;
+}
+
+// End a run that used up its step limit.
+bool lmc_fail_step_limit(struct mailboxes* mailboxes, struct lmc_exec* exec)
+{
+    lmc_io_flush(exec->io);
+    exec->steps = exec->max_steps;
+    exec->status = LMC_STATUS_STEP_LIMIT;
+    sprintf_s(mailboxes->error_msg, sizeof(mailboxes->error_msg), 
+              "Step limit of %llu instructions exceeded", exec->max_steps);
+    return false;
+}
+
+// End a run whose OUT did not write the value that was expected.
+bool lmc_mismatch(struct mailboxes* mailboxes, struct lmc_exec* exec, unsigned long long steps)
+{
+    const struct lmc_io* io = exec->io;
+    lmc_io_flush(exec->io);
+    exec->steps = steps;
+    exec->status = LMC_STATUS_MISMATCH;
+    if (io->out_values < io->expect_count)
+        sprintf_s(mailboxes->error_msg, sizeof(mailboxes->error_msg),
+                  "Output %zu was %d rather than %d", io->out_values + 1, io->unexpected,
+                  io->expect[io->out_values]);
+    else
+        sprintf_s(mailboxes->error_msg, sizeof(mailboxes->error_msg),
+                  "Output %zu (%d) was not expected", io->out_values + 1, io->unexpected);
+    return false;
+}
+
+// Check whether an INP should suspend the run.
+bool lmc_input_blocked(const struct lmc_exec* exec)
+{
+    return exec->suspend && !lmc_io_pending(exec->io);
+}
+
+// End a run that is waiting for input at the INP in mailbox pc, leaving the registers as they
+// were before it.
+bool lmc_suspend(struct lmc_exec* exec, unsigned char pc, short acc, bool negative,
+                 unsigned long long steps)
+{
+    lmc_io_flush(exec->io);
+    exec->suspend->pc = pc;
+    exec->suspend->acc = acc;
+    exec->suspend->negative = negative;
+    exec->suspend->steps = steps;
+    exec->steps = steps;
+    exec->status = LMC_STATUS_INPUT;
+    return true;
+}
+
+// Look up an engine by name, returning false if there is no such engine.
+bool lmc_engine_from_name(const char* name, enum lmc_engine* engine)
+{
+    for (int i = 0; i < LMC_ENGINE_COUNT; ++i)
+    {
+        if (strcmp(name, engine_names[i]) == 0)
+        {
+            *engine = (enum lmc_engine)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Get the name of an engine.
+const char* lmc_engine_name(enum lmc_engine engine)
+{
+    return (engine < LMC_ENGINE_COUNT) ? engine_names[engine] : "unknown";
+}
+
+// Look up an accumulator convention by name, returning false if there is no such convention.
+bool lmc_arith_from_name(const char* name, enum lmc_arith* arith)
+{
+    for (int i = 0; i < LMC_ARITH_COUNT; ++i)
+    {
+        if (strcmp(name, arith_names[i]) == 0)
+        {
+            *arith = (enum lmc_arith)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Get the name of an accumulator convention.
+const char* lmc_arith_name(enum lmc_arith arith)
+{
+    return (arith < LMC_ARITH_COUNT) ? arith_names[arith] : "unknown";
+}
+
+// Execute an assembled LMC program with the given execution settings, starting from the
+// given registers.
+bool lmc_execute_at(struct mailboxes* mailboxes, struct lmc_exec* exec, const struct lmc_regs* start)
+{
+    // Without any I/O to use, buffer the mailboxes' own streams for the length of the run.
+    struct lmc_io stream_io;
+    bool own_io = (exec->io == NULL);
+    if (own_io)
+    {
+        lmc_io_init_streams(&stream_io, mailboxes->instream, mailboxes->outstream);
+        exec->io = &stream_io;
+    }
+
+    exec->steps = start->steps;
+    bool result;
+    if (exec->profile || exec->trace)
+    {
+        if (exec->trace)
+            lmc_trace_begin(exec->trace, mailboxes, start, exec->arith);
+        result = execute_instrumented(mailboxes, exec, start);
+        if (exec->trace)
+            lmc_trace_end(exec->trace, exec);
+    }
+    else if (exec->accelerate && exec->arith == LMC_ARITH_FLAG)
+        result = lmc_execute_accelerated(mailboxes, exec, start);
+    else
+    {
+        // Only the switch and decoded engines are specialised for the other conventions.
+        enum lmc_engine engine = exec->engine;
+        if (exec->arith != LMC_ARITH_FLAG && engine != LMC_ENGINE_SWITCH)
+            engine = LMC_ENGINE_DECODED;
+        switch (engine)
+        {
+            case LMC_ENGINE_DECODED:
+                result = lmc_execute_decoded(mailboxes, exec, start);
+                break;
+            case LMC_ENGINE_THREADED:
+                result = lmc_execute_threaded(mailboxes, exec, start);
+                break;
+            case LMC_ENGINE_FUSED:
+                result = lmc_execute_fused(mailboxes, exec, start);
+                break;
+            case LMC_ENGINE_JIT:
+                result = lmc_execute_jit(mailboxes, exec, start);
+                break;
+            default:
+                result = lmc_execute_switch(mailboxes, exec, start);
+                break;
+        }
+    }
+
+    if (own_io)
+        exec->io = NULL;
+    return result;
+}
+
+// Execute an assembled LMC program with the given execution settings.
+bool lmc_execute_ex(struct mailboxes* mailboxes, struct lmc_exec* exec)
+{
+    const struct lmc_regs start = { 0 };
+    return lmc_execute_at(mailboxes, exec, &start);
+}
+
+// Execute an assembled LMC program.
+bool lmc_execute(struct mailboxes* mailboxes)
+{
+    struct lmc_exec exec = { LMC_ENGINE_SWITCH };
+    return lmc_execute_ex(mailboxes, &exec);
 }
\ No newline at end of file
@@ -5,6 +5,24 @@
 
 #include <stdio.h>
 #include <stdbool.h>
+#include <stddef.h>
+
+// Symbols are only exported explicitly when the library is built as a Windows DLL.
+#if defined(_WIN32) && defined(LMCVM_SHARED)
+#ifdef LMCVM_BUILDING
+#define LMC_API __declspec(dllexport)
+#else
+#define LMC_API __declspec(dllimport)
+#endif
+#else
+#define LMC_API
+#endif
+
+struct lmc_io;
+struct lmc_regs;
+struct lmc_trace;
+struct lmc_fused;
+struct lmc_accel;
 
 #define NUM_MAILBOXES   100
 
@@ -21,8 +39,237 @@ struct mailboxes
     FILE* outstream;
 };
 
+// Execution engines. LMC_ENGINE_SWITCH is the reference interpreter; every other engine
+// must produce exactly the same observable behaviour.
+#define LMC_ENGINE_LIST         \
+    X(SWITCH,   "switch")       \
+    X(DECODED,  "decoded")      \
+    X(THREADED, "threaded")     \
+    X(FUSED,    "fused")        \
+    X(JIT,      "jit")
+
+enum lmc_engine
+{
+#define X(name, string) LMC_ENGINE_##name,
+    LMC_ENGINE_LIST
+#undef X
+    LMC_ENGINE_COUNT
+};
+
+// Accumulator conventions, since courses disagree on how LMC arithmetic handles negative
+// numbers. Each engine that supports them is specialised for every convention, so picking
+// one costs nothing per instruction.
+//
+//   - FLAG: the default. ADD and LDA clear a negative flag, SUB sets it when it underflows,
+//     and BRP branches while it is clear.
+//   - TENS: ten's complement. The accumulator always holds 0-999, where 500-999 stand for
+//     -500 to -1, so BRP branches when it is below 500 and there is no negative flag.
+//   - SIGNED: the accumulator holds -999 to 999, as in Peter Higginson's simulator, and BRP
+//     branches when it is not below zero.
+#define LMC_ARITH_LIST          \
+    X(FLAG,     "flag")         \
+    X(TENS,     "tens")         \
+    X(SIGNED,   "signed")
+
+enum lmc_arith
+{
+#define X(name, string) LMC_ARITH_##name,
+    LMC_ARITH_LIST
+#undef X
+    LMC_ARITH_COUNT
+};
+
+// How a run ended.
+enum lmc_status
+{
+    LMC_STATUS_HALTED,          // The program executed HLT.
+    LMC_STATUS_ERROR,           // The program failed, see error_msg.
+    LMC_STATUS_STEP_LIMIT,      // The program ran for max_steps instructions without halting.
+    LMC_STATUS_LOOP,            // The program was found to be stuck in a loop that never ends.
+    LMC_STATUS_INPUT,           // The program is waiting at INP for input, see lmc_exec::suspend.
+    LMC_STATUS_MISMATCH,        // The program output something other than what its I/O was
+                                // told to expect, see lmc_io_expect().
+};
+
+// Where a run spent its time. The counters accumulate over every run given the same profile,
+// so it needs zeroing beforehand.
+#define LMC_NUM_OPCODES     11
+
+struct lmc_profile
+{
+    unsigned long long hits[NUM_MAILBOXES];         // Instructions executed at each address.
+    unsigned long long reads[NUM_MAILBOXES];        // Operand reads by ADD, SUB and LDA.
+    unsigned long long writes[NUM_MAILBOXES];       // Stores by STA.
+    unsigned long long opcodes[LMC_NUM_OPCODES];    // Instructions executed per opcode.
+    unsigned long long taken[NUM_MAILBOXES];        // Branches at each address that were taken...
+    unsigned long long not_taken[NUM_MAILBOXES];    // ...and that were not.
+    unsigned char targets[NUM_MAILBOXES];           // Where each branch last went.
+};
+
+// Per-run execution settings, and what the run came to.
+struct lmc_exec
+{
+    enum lmc_engine engine;
+    struct lmc_io* io;          // I/O for INP and OUT, or NULL to buffer the mailboxes' streams.
+    unsigned long long max_steps;   // Maximum instructions to execute, or 0 for no limit.
+    struct lmc_profile* profile;    // Where to profile the run, or NULL not to. Profiled runs
+                                    // always use the reference interpreter, whatever engine.
+    struct lmc_trace* trace;    // Where to record every instruction executed, or NULL not to.
+                                // Traced runs use the reference interpreter too.
+    bool accelerate;            // Skip ahead through simple loops, and end the run as soon as
+                                // the program is found to be stuck in a loop that never ends
+                                // (see accel.c). This uses its own interpreter, whatever engine.
+    bool code_immutable;        // Whether the program is known never to store into its own
+                                // code, see lmc_code_immutable(). The engines then leave out
+                                // their checks for self-modification, so this must only be
+                                // set for programs that lmc_code_immutable() has cleared.
+    struct lmc_regs* suspend;   // Where to leave the registers when INP finds no input left
+                                // to read, or NULL to read 0 as usual. Such a run stops
+                                // before the INP with LMC_STATUS_INPUT (returning true), and
+                                // can be picked up again from the registers once there is
+                                // more input. Streams still block until they can be read.
+    enum lmc_arith arith;       // How arithmetic treats negative numbers. Only the switch and
+                                // decoded engines support every convention, so runs with another
+                                // engine (or with accelerate on) use the decoded engine instead
+                                // unless the convention is LMC_ARITH_FLAG.
+    struct lmc_fused* fused;    // Where the fused engine keeps the superinstructions it builds,
+                                // so that later runs of the same program can reuse them, or
+                                // NULL to build them again for every run. Each run checks them
+                                // against its mailboxes, and only builds them again when those
+                                // differ. Only one run at a time may use it.
+    struct lmc_accel* accel;    // Scratch space for accelerated runs to analyse loops in, or
+                                // NULL to allocate it for every run. Only one run at a time
+                                // may use it.
+
+    unsigned long long steps;   // Instructions executed.
+    enum lmc_status status;
+};
+
+// Start recording runs to a binary trace file (see trace.h for the format), which must stay
+// open until the trace is closed. The records are written out by a thread of the trace's
+// own, so a trace must only be given to one run at a time. Returns NULL on failure.
+LMC_API struct lmc_trace* lmc_trace_open(FILE* file);
+
+// Write out everything recorded so far and stop tracing, returning false if anything could
+// not be written.
+LMC_API bool lmc_trace_close(struct lmc_trace* trace);
+
+// Re-execute every run recorded in a trace file and check that each instruction did exactly
+// what the trace says it did, printing the outcome (or where the two diverge) to report.
+LMC_API bool lmc_trace_replay(FILE* file, FILE* report);
+
+// Create somewhere for the fused engine to keep its code between runs (see lmc_exec::fused).
+LMC_API struct lmc_fused* lmc_fused_create(void);
+
+// Free what lmc_fused_create() made.
+LMC_API void lmc_fused_destroy(struct lmc_fused* fused);
+
+// Create scratch space for accelerated runs (see lmc_exec::accel).
+LMC_API struct lmc_accel* lmc_accel_create(void);
+
+// Free what lmc_accel_create() made.
+LMC_API void lmc_accel_destroy(struct lmc_accel* accel);
+
+// Look up an engine by name, returning false if there is no such engine.
+LMC_API bool lmc_engine_from_name(const char* name, enum lmc_engine* engine);
+
+// Get the name of an engine.
+LMC_API const char* lmc_engine_name(enum lmc_engine engine);
+
+// Look up an accumulator convention by name, returning false if there is no such convention.
+LMC_API bool lmc_arith_from_name(const char* name, enum lmc_arith* arith);
+
+// Get the name of an accumulator convention.
+LMC_API const char* lmc_arith_name(enum lmc_arith arith);
+
+// A label defined by a program. Longer names are truncated.
+#define LMC_SYMBOL_LENGTH   32
+
+struct lmc_symbol
+{
+    unsigned char address;
+    char name[LMC_SYMBOL_LENGTH];
+};
+
+// Everything the assembler knows about a program beyond its mailboxes: its labels, and the
+// source line (counting from 1) that each mailbox was assembled from, or 0 for mailboxes
+// past the end of the program.
+struct lmc_symbols
+{
+    size_t count;
+    struct lmc_symbol symbols[NUM_MAILBOXES];
+    unsigned int lines[NUM_MAILBOXES];
+};
+
+// Scratch memory for the assembler's intermediate representation. Passing the same one to
+// every call of lmc_assemble_ex() lets a caller assemble any number of programs without the
+// assembler ever going to the heap. The symbols of the last program assembled successfully
+// are left behind in it.
+#define LMC_ASSEMBLER_SCRATCH_SIZE  32768
+
+struct lmc_assembler
+{
+    struct lmc_symbols symbols;
+    max_align_t scratch[LMC_ASSEMBLER_SCRATCH_SIZE / sizeof(max_align_t)];
+};
+
 // Assemble an LMC program.
-bool lmc_assemble(const char* buffer, size_t length, struct mailboxes* mailboxes);
+LMC_API bool lmc_assemble(const char* buffer, size_t length, struct mailboxes* mailboxes);
+
+// Assemble an LMC program using the given scratch memory.
+LMC_API bool lmc_assemble_ex(struct lmc_assembler* assembler, const char* buffer, size_t length,
+                             struct mailboxes* mailboxes);
+
+// Check whether no STA that an assembled program can reach ever stores into a mailbox that
+// it can execute, which makes it safe to run with lmc_exec::code_immutable set.
+LMC_API bool lmc_code_immutable(const struct mailboxes* mailboxes);
+
+// An assembler for a program that is being edited, which keeps the program's source line by
+// line and only tokenises the lines that each edit touches. Every edit reassembles the program
+// to exactly what lmc_assemble() would make of the whole source, and reports which mailboxes
+// that changed, so that whatever is running or caching the program can be patched rather than
+// rebuilt. Errors give the line and column within the source.
+struct lmc_incremental;
+
+// The mailboxes that an edit changed, in increasing order.
+struct lmc_changes
+{
+    size_t count;
+    unsigned char addresses[NUM_MAILBOXES];
+};
+
+// Create an incremental assembler with an empty program.
+LMC_API struct lmc_incremental* lmc_incremental_create(void);
+
+// Destroy an incremental assembler.
+LMC_API void lmc_incremental_destroy(struct lmc_incremental* incremental);
+
+// Replace count lines of the source, starting from line first (counting from 0), with the
+// lines of text, each of which ends with a newline except maybe the last, then reassemble.
+// An empty text deletes the lines, and a count of 0 inserts the text before the first line.
+// On success, changes (if not NULL) lists the mailboxes that differ from the last program
+// that assembled. On failure the source is still edited, but the program is left as it was
+// until an edit makes it assemble again.
+LMC_API bool lmc_incremental_edit(struct lmc_incremental* incremental, size_t first, size_t count,
+                                  const char* text, size_t length, struct lmc_changes* changes);
+
+// The number of lines of source.
+LMC_API size_t lmc_incremental_lines(const struct lmc_incremental* incremental);
+
+// The mailboxes and symbols of the last program that assembled.
+LMC_API const short* lmc_incremental_pool(const struct lmc_incremental* incremental);
+LMC_API const struct lmc_symbols* lmc_incremental_symbols(
+    const struct lmc_incremental* incremental);
+
+// Why the last edit did not assemble, or an empty string.
+LMC_API const char* lmc_incremental_error(const struct lmc_incremental* incremental);
+
+// Execute an assembled LMC program. INP reads the mailboxes' input stream through its file
+// descriptor rather than through the FILE* (see struct lmc_io in io.h), so anything already
+// buffered in the FILE* is skipped, and input read ahead past the run's last INP is not
+// given back to the stream once the run ends.
+LMC_API bool lmc_execute(struct mailboxes* mailboxes);
 
-// Execute an assembled LMC program.
-bool lmc_execute(struct mailboxes* mailboxes);
\ No newline at end of file
+// Execute an assembled LMC program with the given execution settings. Without an I/O of its
+// own, a run reads its input the same way as lmc_execute() does.
+LMC_API bool lmc_execute_ex(struct mailboxes* mailboxes, struct lmc_exec* exec);
\ No newline at end of file
@@ -0,0 +1,297 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "lmc.h"
+
+#define OPCODE_LIST \
+    X(HLT)          \
+    X(ADD)          \
+    X(SUB)          \
+    X(STA)          \
+    X(DAT)          \
+    X(LDA)          \
+    X(BRA)          \
+    X(BRZ)          \
+    X(BRP)          \
+    X(INP)          \
+    X(OUT)          \
+    X(OP_COUNT)     \
+    X(OP_NULL)
+
+enum opcode
+{
+#define X(name) name,
+    OPCODE_LIST
+#undef X
+};
+
+// Character classes for the assemblers' lexers, looked up in lmc_lex_classes[] rather than
+// with isspace(), so that what separates tokens never depends on the locale. Whitespace and
+// NUL separate tokens, and a newline or semicolon also ends the instruction.
+#define LMC_LEX_SPACE   1
+#define LMC_LEX_EOL     2
+
+extern const unsigned char lmc_lex_classes[256];
+
+static inline bool lmc_lex_isspace(char c)
+{
+    return (lmc_lex_classes[(unsigned char)c] & LMC_LEX_SPACE) != 0;
+}
+
+// Find the first character from buffer[from] up to buffer[to] that separates tokens, or to
+// if there is none.
+size_t lmc_lex_token_end(const char* buffer, size_t from, size_t to);
+
+// Find the first character from buffer[from] up to buffer[to] that is not whitespace within
+// a line, or to if there is none.
+size_t lmc_lex_blank_end(const char* buffer, size_t from, size_t to);
+
+// Look up a three-letter mnemonic, case-insensitively, returning OP_COUNT if it is not one.
+// INP and OUT are returned as themselves.
+enum opcode lmc_lex_opcode(const char* token);
+
+// A pre-decoded mailbox. The pre-decoding engines keep one of these per mailbox so that
+// the hot loop never has to divide. Mailboxes that do not hold an executable opcode are
+// decoded as OP_COUNT, and OP_NULL marks a record that must be decoded again because the
+// mailbox has been overwritten by STA since.
+struct lmc_insn
+{
+    unsigned char op;
+    unsigned char ar;
+};
+
+// Decode the instruction register from a mailbox value, exactly as lmc_execute() does.
+static inline int lmc_decode_ir(short data)
+{
+    return data / 100 + ((data / 100 == INP) ? data % 100 - 1 : 0);
+}
+
+// Decode a mailbox value into a pre-decoded record.
+static inline struct lmc_insn lmc_decode(short data)
+{
+    int ir = lmc_decode_ir(data);
+    struct lmc_insn insn;
+    insn.op = (ir >= HLT && ir <= OUT) ? ir : OP_COUNT;
+    insn.ar = data % 100;
+    return insn;
+}
+
+// A fused engine record: a pre-decoded mailbox which may start a superinstruction (see
+// fused.c). x, y and z are the operands of the instructions in order, t is the target of a
+// trailing branch, and next is where execution continues otherwise. The record is padded out
+// to eight bytes, so that fetching one is a single load.
+struct fused_insn
+{
+    unsigned char op;
+    unsigned char x;
+    unsigned char y;
+    unsigned char z;
+    unsigned char t;
+    unsigned char next;
+    unsigned char padding[2];
+};
+
+// The fused code for a program, along with the mailboxes it was built from. It is kept
+// between runs (see lmc_exec::fused), and only built again once a run starts from different
+// mailboxes, or part way through one of its superinstructions.
+struct lmc_fused
+{
+    bool built;
+    short pool[NUM_MAILBOXES];
+    struct fused_insn code[NUM_MAILBOXES];
+    unsigned char head[NUM_MAILBOXES];  // The head of the superinstruction covering each
+                                        // mailbox, or the mailbox itself.
+};
+
+// The variables of the accelerated engine's loop analysis (see accel.c): the mailboxes, then
+// the accumulator.
+#define ACCEL_ACC           NUM_MAILBOXES
+#define ACCEL_VARS          (NUM_MAILBOXES + 1)
+
+// Limits on what a loop can be to be skipped.
+#define ACCEL_TERMS         8       // Variables that any one value can depend on.
+#define ACCEL_BODY          256     // Instructions per trip around the loop.
+#define ACCEL_CONDITIONS    128     // Conditions on the trip's path and arithmetic.
+
+// An affine expression over the values at the start of a trip around the loop.
+struct accel_expr
+{
+    long long constant;
+    int count;
+    unsigned char vars[ACCEL_TERMS];
+    long long coefs[ACCEL_TERMS];
+};
+
+// Something that has to hold on every trip for it to go like the first one did.
+enum accel_condition
+{
+    ACCEL_IN_RANGE,     // The value does not wrap around at 1000.
+    ACCEL_ZERO,
+    ACCEL_NONZERO,
+    ACCEL_NEGATIVE,
+    ACCEL_NOT_NEGATIVE,
+};
+
+struct accel_check
+{
+    enum accel_condition condition;
+    struct accel_expr value;
+};
+
+// The scratch space for analysing a loop, which is a little too big to keep on the stack, so
+// is kept between runs instead (see lmc_exec::accel).
+struct lmc_accel
+{
+    struct accel_expr values[ACCEL_VARS];
+    bool written[ACCEL_VARS];
+    bool executed[NUM_MAILBOXES];
+    struct accel_check checks[ACCEL_CONDITIONS];
+    int check_count;
+
+    long long start[ACCEL_VARS];
+    long long delta[ACCEL_VARS];
+    bool known[ACCEL_VARS];
+};
+
+// The LMC registers, and the number of instructions executed so far. Engines start a run
+// from one of these, so that one engine can hand a run over to another part way through.
+struct lmc_regs
+{
+    unsigned char pc;
+    short acc;
+    bool negative;
+    unsigned long long steps;
+};
+
+#if defined(_MSC_VER)
+#define LMC_FORCEINLINE __forceinline
+#else
+#define LMC_FORCEINLINE inline __attribute__((always_inline))
+#endif
+
+// The arithmetic of ADD, SUB, BRP and INP under each accumulator convention (see
+// LMC_ARITH_LIST). Engines pass a constant convention, so each of these compiles down to the
+// one convention's arithmetic. Under LMC_ARITH_FLAG, they do exactly what lmc_execute() always
+// has; the other conventions leave the negative flag clear.
+static LMC_FORCEINLINE void lmc_arith_add(const enum lmc_arith arith, short* acc, bool* negative,
+                                          short value)
+{
+    *negative = false;
+    if (arith == LMC_ARITH_TENS)
+        *acc = (short)(((*acc + value) % 1000 + 1000) % 1000);
+    else
+        *acc = (short)((*acc + value) % 1000);
+}
+
+static LMC_FORCEINLINE void lmc_arith_sub(const enum lmc_arith arith, short* acc, bool* negative,
+                                          short value)
+{
+    if (arith == LMC_ARITH_FLAG)
+        *negative = (*acc < value);
+    if (arith == LMC_ARITH_TENS)
+        *acc = (short)(((*acc - value) % 1000 + 1000) % 1000);
+    else
+        *acc = (short)((*acc - value) % 1000);
+}
+
+// Whether BRP branches.
+static LMC_FORCEINLINE bool lmc_arith_positive(const enum lmc_arith arith, short acc, bool negative)
+{
+    if (arith == LMC_ARITH_TENS)
+        return acc < 500;
+    if (arith == LMC_ARITH_SIGNED)
+        return acc >= 0;
+    return !negative;
+}
+
+// Turn what lmc_io_read() read (a magnitude and a sign) into the accumulator's convention.
+static LMC_FORCEINLINE void lmc_arith_input(const enum lmc_arith arith, short* acc, bool* negative)
+{
+    if (arith == LMC_ARITH_FLAG)
+        return;
+    int value = (*negative ? -*acc : *acc) % 1000;
+    *acc = (short)((arith == LMC_ARITH_TENS && value < 0) ? value + 1000 : value);
+    *negative = false;
+}
+
+// Every engine is written once as a force-inlined loop taking a constant "limited" flag,
+// and then instantiated with and without it, so that runs without a step limit do not pay
+// for checking one.
+#define LMC_ENGINE_VARIANTS(loop)                                                   \
+    static bool loop##_unlimited(struct mailboxes* mailboxes, struct lmc_exec* exec,  \
+                                 const struct lmc_regs* start)                      \
+    {                                                                               \
+        return loop(mailboxes, exec, start, false);                                 \
+    }                                                                               \
+    static bool loop##_limited(struct mailboxes* mailboxes, struct lmc_exec* exec,    \
+                               const struct lmc_regs* start)                        \
+    {                                                                               \
+        return loop(mailboxes, exec, start, true);                                  \
+    }
+
+// Pick the variant of an engine for a run.
+#define LMC_ENGINE_RUN(loop, mailboxes, exec, start)                                \
+    (((exec)->max_steps) ? loop##_limited(mailboxes, exec, start)                   \
+                         : loop##_unlimited(mailboxes, exec, start))
+
+// Engines that guard against self-modifying code are also instantiated without the guards,
+// for programs known never to store into their own code (see lmc_code_immutable()). Their
+// loop takes a second constant "immutable" flag, and gets four variants in all.
+#define LMC_ENGINE_GUARDED_VARIANTS(loop)                                           \
+    static LMC_FORCEINLINE bool loop##_guarded(struct mailboxes* mailboxes,         \
+                                               struct lmc_exec* exec,               \
+                                               const struct lmc_regs* start,        \
+                                               const bool limited)                  \
+    {                                                                               \
+        return loop(mailboxes, exec, start, limited, false);                        \
+    }                                                                               \
+    static LMC_FORCEINLINE bool loop##_immutable(struct mailboxes* mailboxes,       \
+                                                 struct lmc_exec* exec,             \
+                                                 const struct lmc_regs* start,      \
+                                                 const bool limited)                \
+    {                                                                               \
+        return loop(mailboxes, exec, start, limited, true);                         \
+    }                                                                               \
+    LMC_ENGINE_VARIANTS(loop##_guarded)                                             \
+    LMC_ENGINE_VARIANTS(loop##_immutable)
+
+// Pick the variant of a guarded engine for a run.
+#define LMC_ENGINE_GUARDED_RUN(loop, mailboxes, exec, start)                        \
+    (((exec)->code_immutable) ? LMC_ENGINE_RUN(loop##_immutable, mailboxes, exec, start) \
+                              : LMC_ENGINE_RUN(loop##_guarded, mailboxes, exec, start))
+
+// The same as lmc_execute_ex(), but starting from the given registers (and step count) rather
+// than from the top of the program.
+bool lmc_execute_at(struct mailboxes* mailboxes, struct lmc_exec* exec, const struct lmc_regs* start);
+
+// Shared ways for an engine to end a run. Both flush the output and record the number of
+// instructions executed.
+bool lmc_halt(struct lmc_exec* exec, unsigned long long steps);
+bool lmc_fail_opcode(struct mailboxes* mailboxes, struct lmc_exec* exec, unsigned long long steps,
+                     int ir);
+bool lmc_fail_step_limit(struct mailboxes* mailboxes, struct lmc_exec* exec);
+bool lmc_mismatch(struct mailboxes* mailboxes, struct lmc_exec* exec, unsigned long long steps);
+
+// Whether an INP should suspend the run rather than read, see lmc_exec::suspend. Engines check
+// this before the INP's step is counted, and suspend with the registers as they were before it.
+bool lmc_input_blocked(const struct lmc_exec* exec);
+bool lmc_suspend(struct lmc_exec* exec, unsigned char pc, short acc, bool negative,
+                 unsigned long long steps);
+
+// Execution engines, each starting from the given registers.
+bool lmc_execute_switch(struct mailboxes* mailboxes, struct lmc_exec* exec,
+                        const struct lmc_regs* start);
+bool lmc_execute_decoded(struct mailboxes* mailboxes, struct lmc_exec* exec,
+                         const struct lmc_regs* start);
+bool lmc_execute_threaded(struct mailboxes* mailboxes, struct lmc_exec* exec,
+                          const struct lmc_regs* start);
+bool lmc_execute_fused(struct mailboxes* mailboxes, struct lmc_exec* exec,
+                       const struct lmc_regs* start);
+bool lmc_execute_accelerated(struct mailboxes* mailboxes, struct lmc_exec* exec,
+                             const struct lmc_regs* start);
+bool lmc_execute_jit(struct mailboxes* mailboxes, struct lmc_exec* exec,
+                     const struct lmc_regs* start);
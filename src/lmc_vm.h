@@ -0,0 +1,139 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "lmc.h"
+
+// An LMC virtual machine for embedding. A context holds everything a program needs to run,
+// including a pristine copy of the loaded program, its I/O buffers and its error message, so
+// once one has been created a host can load, run and reset programs in it as often as it
+// likes without anything being allocated per run (with the exception of the JIT engine,
+// which maps memory for its code).
+struct lmc_vm;
+
+// Create a context, running programs on the given engine.
+LMC_API struct lmc_vm* lmc_vm_create(enum lmc_engine engine);
+
+// Destroy a context, along with every snapshot taken of it.
+LMC_API void lmc_vm_destroy(struct lmc_vm* vm);
+
+// A fixed number of contexts that are allocated up front and then handed out and taken back
+// over and over, for hosts that get through contexts too quickly to create each one afresh.
+// Each context keeps its mailboxes and registers on cache lines of their own, next to a
+// pristine copy of the loaded program, so that resetting one is a single copy. Contexts can be
+// acquired and released from any thread.
+struct lmc_vm_pool;
+
+// Create a pool of contexts running programs on the given engine.
+LMC_API struct lmc_vm_pool* lmc_vm_pool_create(size_t capacity, enum lmc_engine engine);
+
+// Destroy a pool, along with every context in it, whether or not it has been released.
+LMC_API void lmc_vm_pool_destroy(struct lmc_vm_pool* pool);
+
+// Take a context out of a pool, or get NULL if every context is in use. A context comes back
+// in whatever state it was released in, so load a program into it (or reset it) before
+// running anything.
+LMC_API struct lmc_vm* lmc_vm_pool_acquire(struct lmc_vm_pool* pool);
+
+// Give a context back to the pool it came from. Pooled contexts must never be destroyed with
+// lmc_vm_destroy().
+LMC_API void lmc_vm_pool_release(struct lmc_vm_pool* pool, struct lmc_vm* vm);
+
+// Create a new context in exactly the same state as an existing one, with the same program,
+// settings and I/O. Forks of a context using memory I/O share the caller's input; forks of
+// one using streams share the streams.
+LMC_API struct lmc_vm* lmc_vm_fork(const struct lmc_vm* vm);
+
+// Load a program from either source code or an object image, and reset the context to run
+// it. On failure the context has no program until one loads successfully.
+LMC_API bool lmc_vm_load(struct lmc_vm* vm, const char* buffer, size_t length);
+
+// Load an already assembled program, and reset the context to run it.
+LMC_API void lmc_vm_load_mailboxes(struct lmc_vm* vm, const short pool[NUM_MAILBOXES]);
+
+// Patch some of the mailboxes of the loaded program, both in the program as loaded and in
+// the program as it runs, such as the mailboxes that an incremental assembler reports an edit
+// to have changed (see lmc_incremental_edit()). The rest of the program's state is kept.
+// Addresses of NUM_MAILBOXES or more are skipped.
+LMC_API void lmc_vm_patch(struct lmc_vm* vm, const short pool[NUM_MAILBOXES],
+                          const unsigned char* addresses, size_t count);
+
+// Change the engine that programs run on.
+LMC_API void lmc_vm_set_engine(struct lmc_vm* vm, enum lmc_engine engine);
+
+// Change how arithmetic treats negative numbers (see LMC_ARITH_LIST). The default is
+// LMC_ARITH_FLAG.
+LMC_API void lmc_vm_set_arith(struct lmc_vm* vm, enum lmc_arith arith);
+
+// Skip ahead through simple loops, and end runs that are stuck in a loop that never ends
+// with LMC_STATUS_LOOP.
+LMC_API void lmc_vm_set_accelerate(struct lmc_vm* vm, bool accelerate);
+
+// Have runs stop with LMC_STATUS_INPUT when the program reaches an INP with no memory input
+// left to read, rather than reading 0, so that a host can wait for the input without holding
+// a thread (see lmc_vm_resume()). This is off by default.
+LMC_API void lmc_vm_set_suspend_on_input(struct lmc_vm* vm, bool suspend);
+
+// Limit runs to a number of instructions, or 0 for no limit.
+LMC_API void lmc_vm_set_max_steps(struct lmc_vm* vm, unsigned long long max_steps);
+
+// Have INP read from a block of memory owned by the caller, which must stay around until the
+// next run has finished. OUT is collected in the context (see lmc_vm_output()). This is the
+// default, with no input at all.
+LMC_API void lmc_vm_set_input(struct lmc_vm* vm, const char* input, size_t length);
+
+// Have INP and OUT go to a pair of streams instead.
+LMC_API void lmc_vm_set_streams(struct lmc_vm* vm, FILE* instream, FILE* outstream);
+
+// Run the loaded program until it halts, fails, hits the step limit or waits for input. Each
+// run starts from the program's current state, so call lmc_vm_reset() in between runs to start
+// afresh.
+LMC_API bool lmc_vm_run(struct lmc_vm* vm);
+
+// Carry on with a program that is waiting for input, giving its INP a value (read the same
+// way as a line of input holding it would be, so values outside -999 to 9999 are clamped to
+// that range), and run until it halts, fails, hits the step limit or waits for input again.
+// Running it with lmc_vm_run() instead, after giving it more input with lmc_vm_set_input(),
+// reads the INP from that input. Fails if the program is not waiting for input.
+LMC_API bool lmc_vm_resume(struct lmc_vm* vm, short value);
+
+// Put the program back to how it was when it was loaded, and rewind its input.
+LMC_API void lmc_vm_reset(struct lmc_vm* vm);
+
+// A saved copy of the state of a program: its mailboxes, its registers and step count, and
+// how far through its memory input it has read. Snapshots are small and are allocated from
+// a pool owned by the context that took them, so taking and releasing them is cheap enough
+// to do at every step of a search over inputs.
+struct lmc_vm_snapshot;
+
+// Take a snapshot of a context's program as it currently stands.
+LMC_API struct lmc_vm_snapshot* lmc_vm_snapshot(struct lmc_vm* vm);
+
+// Put a program back to how it was when a snapshot was taken, which can be done any number
+// of times. The snapshot can come from any context running the same program, such as a fork.
+// Streams are not rewound, and the input position is only restored for memory I/O.
+LMC_API void lmc_vm_restore(struct lmc_vm* vm, const struct lmc_vm_snapshot* snapshot);
+
+// Give a snapshot back to the context that took it.
+LMC_API void lmc_vm_release(struct lmc_vm* vm, struct lmc_vm_snapshot* snapshot);
+
+// How the last run ended, and the number of instructions it executed.
+LMC_API enum lmc_status lmc_vm_status(const struct lmc_vm* vm);
+LMC_API unsigned long long lmc_vm_steps(const struct lmc_vm* vm);
+
+// The reason the last load or run failed, or an empty string.
+LMC_API const char* lmc_vm_error(const struct lmc_vm* vm);
+
+// The output of the last run when using memory I/O. The length counts everything that was
+// output, even if only the first LMC_VM_OUTPUT_SIZE characters were kept.
+#define LMC_VM_OUTPUT_SIZE  16384
+
+LMC_API const char* lmc_vm_output(const struct lmc_vm* vm, size_t* length);
+
+// The mailboxes of the program as they currently stand.
+LMC_API const short* lmc_vm_pool(const struct lmc_vm* vm);
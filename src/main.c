@@ -6,43 +6,699 @@
 #include <string.h>
 #include <stdlib.h>
 
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+#include "aot.h"
+#include "batch.h"
+#include "bulk.h"
+#include "cases.h"
+#include "extended.h"
+#include "lanes.h"
 #include "lmc.h"
+#include "object.h"
+#include "perf.h"
+#include "profile.h"
+#include "server.h"
+#include "source.h"
 #include "util.h"
 
-int main(int argc, char** argv)
+// Run every program given on the command line as one batch. Each program reads its input
+// from "<path>.in" (if there is one) and writes its output to "<path>.out", and a result
+// line is printed per program once the whole batch has finished.
+static int run_batch(char** paths, int count, const struct lmc_exec* exec, unsigned int threads)
 {
-    if (argc < 2)
+    struct lmc_batch_job* jobs = (struct lmc_batch_job*)quick_calloc(count, sizeof(struct lmc_batch_job));
+    struct source* sources = (struct source*)quick_calloc(count, sizeof(struct source));
+    char stream_path[4096];
+    int status = 0;
+    int loaded = 0;
+    for (; loaded < count; ++loaded)
     {
-        puts("usage: lmcvm path");
-        return 0;
+        struct lmc_batch_job* job = &jobs[loaded];
+        if (!source_open(&sources[loaded], paths[loaded]))
+            break;
+        job->buffer = sources[loaded].buffer;
+        job->length = sources[loaded].length;
+
+        snprintf(stream_path, sizeof(stream_path), "%s.in", paths[loaded]);
+        if (fopen_s(&job->instream, stream_path, "r"))
+            job->instream = tmpfile();
+        snprintf(stream_path, sizeof(stream_path), "%s.out", paths[loaded]);
+        errno_t err = fopen_s(&job->outstream, stream_path, "w");
+        if (err || !job->instream)
+        {
+            fprintf(stderr, "Could not open streams for \"%s\": %s\n", paths[loaded], 
+                    strerror(err ? err : errno));
+            if (job->instream)
+                fclose(job->instream);
+            if (job->outstream)
+                fclose(job->outstream);
+            source_close(&sources[loaded]);
+            break;
+        }
+    }
+
+    if (loaded < count)
+        status = 1;
+    else
+    {
+        size_t failed = lmc_batch_run(jobs, count, exec, threads);
+        for (int i = 0; i < count; ++i)
+        {
+            if (jobs[i].result)
+                printf("%s: ok (%llu steps)\n", paths[i], jobs[i].steps);
+            else
+                printf("%s: %s (%llu steps)\n", paths[i], jobs[i].error_msg, jobs[i].steps);
+        }
+        printf("%d programs, %zu failed\n", count, failed);
+        status = (failed > 0);
+    }
+
+    for (int i = 0; i < loaded; ++i)
+    {
+        fclose(jobs[i].instream);
+        fclose(jobs[i].outstream);
+        source_close(&sources[i]);
     }
+    free(sources);
+    free(jobs);
+    return status;
+}
 
-    char* buffer;
+// Run an assembled program once per line of an input vector file, all in lockstep, and
+// print what each lane output.
+static int run_lanes(const struct mailboxes* mailboxes, const char* path,
+                     unsigned long long max_steps)
+{
+    // The values are parsed with strtol(), so read the file rather than mapping it to have it
+    // NUL-terminated.
     FILE* file;
-    errno_t err = fopen_s(&file, argv[1], "r");
+    errno_t err = fopen_s(&file, path, "r");
     if (err)
     {
-        fprintf(stderr, "Could not read file \"%s\": %s\n", argv[1], strerror(err));
+        fprintf(stderr, "Could not read file \"%s\": %s\n", path, strerror(err));
         return 1;
     }
+    struct source vectors;
+    bool result = source_read(&vectors, file);
+    fclose(file);
+    if (!result)
+        return 1;
+    const char* buffer = vectors.buffer;
+    size_t length = vectors.length;
 
-    fseek(file, 0, SEEK_END);
-    size_t length = ftell(file);
-    buffer = (char*)quick_malloc(length);
-    fseek(file, 0, SEEK_SET);
-    fread(buffer, 1, length, file);
+    // Every value in the file is an input, so this is enough room for all of them.
+    enum { OUTPUT_CAPACITY = 256 };
+    size_t count = 0;
+    for (size_t i = 0; i < length; ++i)
+        count += (buffer[i] == '\n') || (i + 1 == length);
+    struct lmc_lane* lanes = (struct lmc_lane*)quick_calloc(max(count, 1), sizeof(struct lmc_lane));
+    short* inputs = (short*)quick_calloc(length + 1, sizeof(short));
+    short* outputs = (short*)quick_calloc(max(count, 1) * OUTPUT_CAPACITY, sizeof(short));
+
+    const char* cursor = buffer;
+    const char* end = buffer + length;
+    short* input = inputs;
+    for (size_t lane = 0; lane < count; ++lane)
+    {
+        const char* eol = memchr(cursor, '\n', end - cursor);
+        if (!eol)
+            eol = end;
+
+        lanes[lane].input = input;
+        while (cursor < eol)
+        {
+            char* next;
+            long value = strtol(cursor, &next, 10);
+            if (next == cursor || next > eol)
+                break;
+            *input++ = (short)value;
+            cursor = next;
+        }
+        lanes[lane].input_count = input - lanes[lane].input;
+        lanes[lane].output = &outputs[lane * OUTPUT_CAPACITY];
+        lanes[lane].output_capacity = OUTPUT_CAPACITY;
+        cursor = eol + 1;
+    }
+
+    lmc_execute_lanes(mailboxes, lanes, count, max_steps);
+
+    int status = 0;
+    for (size_t lane = 0; lane < count; ++lane)
+    {
+        printf("%zu:", lane + 1);
+        size_t shown = min(lanes[lane].output_count, lanes[lane].output_capacity);
+        for (size_t i = 0; i < shown; ++i)
+            printf(" %d", lanes[lane].output[i]);
+        if (shown < lanes[lane].output_count)
+            fputs(" ...", stdout);
+        if (!lanes[lane].result)
+        {
+            printf(" (%s)", lanes[lane].error_msg);
+            status = 1;
+        }
+        putchar('\n');
+    }
+
+    free(outputs);
+    free(inputs);
+    free(lanes);
+    source_close(&vectors);
+    return status;
+}
+
+// Run an assembled program against every test case in a file, and print how each one went.
+// Each line is a case, giving the values to input and then, after a colon, the values the
+// program should output. Blank lines and lines starting with # are skipped.
+static int run_cases(const struct mailboxes* mailboxes, const char* path,
+                     const struct lmc_exec* exec, unsigned int threads)
+{
+    FILE* file;
+    errno_t err = fopen_s(&file, path, "r");
+    if (err)
+    {
+        fprintf(stderr, "Could not read file \"%s\": %s\n", path, strerror(err));
+        return 1;
+    }
+    struct source source;
+    bool result = source_read(&source, file);
     fclose(file);
+    if (!result)
+        return 1;
+    const char* buffer = source.buffer;
+    size_t length = source.length;
+
+    // Inputs are copied out a line at a time for INP, so they take at most one more character
+    // each than they do in the file.
+    size_t lines = 0;
+    for (size_t i = 0; i < length; ++i)
+        lines += (buffer[i] == '\n') || (i + 1 == length);
+    struct lmc_case* cases = (struct lmc_case*)quick_calloc(max(lines, 1), sizeof(struct lmc_case));
+    char* inputs = (char*)quick_calloc(length * 2 + 1, 1);
+    short* expected = (short*)quick_calloc(length + 1, sizeof(short));
+
+    const char* cursor = buffer;
+    const char* end = buffer + length;
+    char* input = inputs;
+    short* output = expected;
+    size_t count = 0;
+    int status = 0;
+    for (size_t line = 1; cursor < end; ++line)
+    {
+        const char* eol = memchr(cursor, '\n', end - cursor);
+        if (!eol)
+            eol = end;
+        while (cursor < eol && (*cursor == ' ' || *cursor == '\t' || *cursor == '\r'))
+            cursor++;
+        if (cursor == eol || *cursor == '#')
+        {
+            cursor = eol + 1;
+            continue;
+        }
+        const char* colon = memchr(cursor, ':', eol - cursor);
+        if (!colon)
+        {
+            fprintf(stderr, "%s:%zu: expected a colon between the input and the output\n",
+                    path, line);
+            status = 1;
+            goto done;
+        }
+
+        struct lmc_case* test = &cases[count++];
+        test->input = input;
+        while (cursor < colon)
+        {
+            char* next;
+            strtol(cursor, &next, 10);
+            if (next == cursor || next > colon)
+                break;
+            while (isspace((unsigned char)*cursor))
+                cursor++;
+            memcpy(input, cursor, next - cursor);
+            input += next - cursor;
+            *input++ = '\n';
+            cursor = next;
+        }
+        test->input_length = input - test->input;
+
+        test->expected = output;
+        for (cursor = colon + 1; cursor < eol;)
+        {
+            char* next;
+            long value = strtol(cursor, &next, 10);
+            if (next == cursor || next > eol)
+                break;
+            *output++ = (short)value;
+            cursor = next;
+        }
+        test->expected_count = output - test->expected;
+        cursor = eol + 1;
+    }
+
+    size_t failed = lmc_cases_run(mailboxes, cases, count, exec, threads);
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (cases[i].passed)
+            printf("%zu: pass (%llu steps)\n", i + 1, cases[i].steps);
+        else
+            printf("%zu: fail (%s)\n", i + 1, cases[i].error_msg);
+    }
+    printf("%zu of %zu cases passed\n", count - failed, count);
+    status = (failed != 0);
+
+done:
+    free(expected);
+    free(inputs);
+    free(cases);
+    source_close(&source);
+    return status;
+}
+
+// Check a trace file by replaying it.
+static int run_replay(const char* path)
+{
+    FILE* file;
+    errno_t err = fopen_s(&file, path, "rb");
+    if (err)
+    {
+        fprintf(stderr, "Could not read file \"%s\": %s\n", path, strerror(err));
+        return 1;
+    }
+    bool result = lmc_trace_replay(file, stdout);
+    fclose(file);
+    return !result;
+}
+
+// Assemble and run a program on an extended-memory machine with the given number of cells.
+static int run_extended(const struct source* source, unsigned int cells, struct lmc_exec* exec,
+                        FILE* instream, bool show_steps)
+{
+    struct lmc_ext* ext = lmc_ext_create(cells);
+    if (!ext)
+    {
+        fprintf(stderr, "Memory must be a power of ten from %d to %d cells\n", LMC_EXT_MIN_CELLS,
+                LMC_EXT_MAX_CELLS);
+        return 1;
+    }
+    ext->instream = instream;
+
+    bool result = lmc_ext_assemble(ext, source->buffer, source->length);
+    if (result)
+    {
+        result = lmc_ext_execute(ext, exec);
+        if (show_steps)
+            fprintf(stderr, "%llu steps\n", exec->steps);
+    }
+    if (!result)
+        puts(ext->error_msg);
+    lmc_ext_destroy(ext);
+    return !result;
+}
+
+// Report the host counters for assembling and executing a program as JSON.
+static void print_stats(const struct lmc_exec* exec, const struct lmc_perf_sample* assemble,
+                        const struct lmc_perf_sample* execute)
+{
+    static const char* const status_names[] = { "halted", "error", "step_limit", "loop", "input",
+                                                 "mismatch" };
+    fprintf(stderr, "{\"engine\": \"%s\", \"status\": \"%s\", \"steps\": %llu,\n",
+            lmc_engine_name(exec->engine), status_names[exec->status], exec->steps);
+    fputs(" \"assemble\": ", stderr);
+    lmc_perf_write_json(stderr, assemble);
+    fputs(",\n \"execute\": ", stderr);
+    lmc_perf_write_json(stderr, execute);
+
+    // What each LMC instruction cost the host.
+    unsigned long long steps = max(exec->steps, 1);
+    fprintf(stderr, ",\n \"ns_per_step\": %.3f", execute->seconds * 1e9 / steps);
+    for (int i = 0; i < LMC_PERF_COUNTER_COUNT; ++i)
+    {
+        const char* name = lmc_perf_counter_name((enum lmc_perf_counter)i);
+        if (execute->available[i])
+            fprintf(stderr, ", \"%s_per_step\": %.3f", name, (double)execute->counts[i] / steps);
+        else
+            fprintf(stderr, ", \"%s_per_step\": null", name);
+    }
+    fputs("}\n", stderr);
+}
+
+// A cache entry is an object image with the source it was assembled from appended to it. The
+// hash only picks out the entry: FNV-1a collisions are easy to make, so the image is only
+// trusted once the source it was assembled from matches byte for byte.
+static bool cache_load(const char* path, const struct source* source, struct mailboxes* mailboxes,
+                       struct lmc_symbols* symbols)
+{
+    FILE* file;
+    if (fopen_s(&file, path, "rb") != 0)
+        return false;
+    struct source entry;
+    bool result = source_read(&entry, file);
+    fclose(file);
+
+    struct lmc_object_source cached;
+    size_t image_length = entry.length - source->length;
+    result = result && entry.length >= LMC_OBJECT_HEADER_SIZE + source->length &&
+             memcmp(entry.buffer + image_length, source->buffer, source->length) == 0 &&
+             lmc_object_read(entry.buffer, image_length, mailboxes, symbols, &cached) &&
+             cached.length == source->length;
+    source_close(&entry);
+    return result;
+}
 
+// Returns 0 or the errno value that caused it to fail.
+static int cache_save(const char* path, const struct source* source,
+                      const struct mailboxes* mailboxes, const struct lmc_symbols* symbols,
+                      const struct lmc_object_source* identity)
+{
+    unsigned char image[LMC_OBJECT_MAX_SIZE];
+    size_t length = lmc_object_write(image, mailboxes, symbols, identity);
+
+    FILE* file;
+    errno_t err = fopen_s(&file, path, "wb");
+    if (err)
+        return err;
+    if (fwrite(image, 1, length, file) != length ||
+        fwrite(source->buffer, 1, source->length, file) != source->length)
+        err = errno ? errno : EIO;
+    if (fclose(file) != 0 && !err)
+        err = errno ? errno : EIO;
+    return err;
+}
+
+// Get a program ready to run, filling in its mailboxes and symbols. The program can be
+// source code or an object image. Source code is looked up by its hash in the cache
+// directory, if there is one, and assembled (and added to the cache) only when it is not
+// already there.
+static bool load_program(const struct source* source, const char* cache, 
+                         struct mailboxes* mailboxes, struct lmc_symbols* symbols,
+                         struct lmc_object_source* identity)
+{
+    if (lmc_object_is_image(source->buffer, source->length))
+        return lmc_object_read(source->buffer, source->length, mailboxes, symbols, identity);
+
+    identity->hash = lmc_source_hash(source->buffer, source->length);
+    identity->length = source->length;
+    char cache_path[4096];
+    if (cache)
+    {
+        snprintf(cache_path, sizeof(cache_path), "%s/%016llx.lmo", cache, identity->hash);
+        if (cache_load(cache_path, source, mailboxes, symbols))
+            return true;
+    }
+
+    struct lmc_assembler* assembler = (struct lmc_assembler*)quick_malloc(sizeof(struct lmc_assembler));
+    bool result = lmc_assemble_ex(assembler, source->buffer, source->length, mailboxes);
+    if (result)
+        *symbols = assembler->symbols;
+    free(assembler);
+
+    // Write the entry out under a temporary name first, so that nothing can ever load a
+    // partly written one from the cache. The name is this process's own, so that processes
+    // sharing the cache never write to the same file.
+    if (result && cache)
+    {
+        char temp_path[4096 + 32];
+        snprintf(temp_path, sizeof(temp_path), "%s.%lu.tmp", cache_path, (unsigned long)getpid());
+        int err = cache_save(temp_path, source, mailboxes, symbols, identity);
+        if (!err && rename(temp_path, cache_path) != 0)
+            err = errno;
+        if (err)
+        {
+            fprintf(stderr, "Could not write \"%s\": %s\n", cache_path, strerror(err));
+            remove(temp_path);
+        }
+    }
+    return result;
+}
+
+static void usage(void)
+{
+    puts("usage: lmcvm [--engine name] [--max-steps count] [--steps] [--input path] path");
+    puts("       lmcvm [--engine name] [--max-steps count] [--threads count] --batch path...");
+    puts("       lmcvm [--max-steps count] --lanes vectors path");
+    puts("       lmcvm [--engine name] [--max-steps count] [--threads count] --cases file path");
+    puts("       lmcvm --emit image.lmo path");
+    puts("       lmcvm --emit-c program.c path");
+    puts("       lmcvm [--threads count] --assemble path...");
+    puts("       lmcvm --replay trace");
+    puts("       lmcvm --memory cells [--max-steps count] [--steps] [--input path] path");
+    puts("       lmcvm [--engine name] [--max-steps count] [--threads count] --serve [host:]port");
+    puts("       lmcvm [--engine name] [--max-steps count] [--threads count] --serve unix:path");
+    puts("options: --cache dir (look up and store assembled programs in dir)");
+    puts("         --arith name (how arithmetic treats negative numbers)");
+    puts("         --profile (report where the program spent its time)");
+    puts("         --trace path (record every instruction executed to path)");
+    puts("         --stats (report host CPU counters for the run as JSON)");
+    puts("         --accelerate (skip ahead through simple loops, and stop at endless ones)");
+    fputs("engines:", stdout);
+    for (int i = 0; i < LMC_ENGINE_COUNT; ++i)
+        printf(" %s", lmc_engine_name((enum lmc_engine)i));
+    putchar('\n');
+    fputs("arithmetic:", stdout);
+    for (int i = 0; i < LMC_ARITH_COUNT; ++i)
+        printf(" %s", lmc_arith_name((enum lmc_arith)i));
+    putchar('\n');
+    puts("a path of - reads the program from stdin");
+}
+
+int main(int argc, char** argv)
+{
+    struct lmc_exec exec = { LMC_ENGINE_SWITCH };
+    bool batch = false;
+    bool assemble = false;
+    bool show_steps = false;
+    bool profile = false;
+    bool stats = false;
+    const char* vectors = NULL;
+    const char* cases = NULL;
+    const char* input = NULL;
+    const char* emit = NULL;
+    const char* emit_c = NULL;
+    const char* cache = NULL;
+    const char* serve = NULL;
+    const char* trace = NULL;
+    const char* replay = NULL;
+    unsigned int threads = 0;
+    unsigned int memory = 0;
+    int first_path = argc;
+    for (int i = 1; i < argc && first_path == argc; ++i)
+    {
+        if (strcmp(argv[i], "--engine") == 0 && i + 1 < argc)
+        {
+            if (!lmc_engine_from_name(argv[++i], &exec.engine))
+            {
+                fprintf(stderr, "Unknown engine \"%s\"\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--arith") == 0 && i + 1 < argc)
+        {
+            if (!lmc_arith_from_name(argv[++i], &exec.arith))
+            {
+                fprintf(stderr, "Unknown arithmetic \"%s\"\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--max-steps") == 0 && i + 1 < argc)
+            exec.max_steps = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--steps") == 0)
+            show_steps = true;
+        else if (strcmp(argv[i], "--profile") == 0)
+            profile = true;
+        else if (strcmp(argv[i], "--stats") == 0)
+            stats = true;
+        else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+            trace = argv[++i];
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+            replay = argv[++i];
+        else if (strcmp(argv[i], "--accelerate") == 0)
+            exec.accelerate = true;
+        else if (strcmp(argv[i], "--memory") == 0 && i + 1 < argc)
+            memory = (unsigned int)strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            threads = (unsigned int)strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--lanes") == 0 && i + 1 < argc)
+            vectors = argv[++i];
+        else if (strcmp(argv[i], "--cases") == 0 && i + 1 < argc)
+            cases = argv[++i];
+        else if (strcmp(argv[i], "--input") == 0 && i + 1 < argc)
+            input = argv[++i];
+        else if (strcmp(argv[i], "--emit") == 0 && i + 1 < argc)
+            emit = argv[++i];
+        else if (strcmp(argv[i], "--emit-c") == 0 && i + 1 < argc)
+            emit_c = argv[++i];
+        else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc)
+            cache = argv[++i];
+        else if (strcmp(argv[i], "--batch") == 0)
+            batch = true;
+        else if (strcmp(argv[i], "--assemble") == 0)
+            assemble = true;
+        else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc)
+            serve = argv[++i];
+        else
+            first_path = i;
+    }
+
+    if (serve && (exec.accelerate || exec.arith != LMC_ARITH_FLAG || profile || trace || stats))
+    {
+        fputs("The server only runs jobs with flag arithmetic, and without acceleration or reports\n",
+              stderr);
+        return 1;
+    }
+    if (serve)
+        return !lmc_server_run(serve, exec.engine, exec.max_steps, threads);
+    if (replay)
+        return run_replay(replay);
+    if (first_path == argc)
+    {
+        usage();
+        return 0;
+    }
+    if (assemble)
+        return lmc_bulk_assemble(&argv[first_path], argc - first_path, threads) > 0;
+    if ((vectors || emit_c) && exec.arith != LMC_ARITH_FLAG)
+    {
+        fputs("Lanes and generated C only support flag arithmetic\n", stderr);
+        return 1;
+    }
+    if (memory && (batch || vectors || emit || emit_c || cache || profile || trace ||
+                   exec.accelerate || exec.arith != LMC_ARITH_FLAG))
+    {
+        fputs("Extended memory only runs a single program, with flag arithmetic\n", stderr);
+        return 1;
+    }
+    if (cases && (batch || vectors || memory || profile || trace))
+    {
+        fputs("Test cases can only be run on their own\n", stderr);
+        return 1;
+    }
+    if (stats && (batch || vectors || cases || emit || emit_c || memory))
+    {
+        fputs("Only a single run can be measured\n", stderr);
+        return 1;
+    }
+    if (batch && trace)
+    {
+        fputs("A batch cannot be traced\n", stderr);
+        return 1;
+    }
+    if (batch)
+        return run_batch(&argv[first_path], argc - first_path, &exec, threads);
+
+    // A program piped in on stdin uses up stdin, so its input has to come from elsewhere.
     struct mailboxes mailboxes;
     mailboxes.instream = stdin;
     mailboxes.outstream = stdout;
+    if (input)
+    {
+        errno_t err = fopen_s(&mailboxes.instream, input, "r");
+        if (err)
+        {
+            fprintf(stderr, "Could not read file \"%s\": %s\n", input, strerror(err));
+            return 1;
+        }
+    }
 
-    bool result = lmc_assemble(buffer, length, &mailboxes);
-    free(buffer);
+    struct source source;
+    struct lmc_symbols symbols;
+    struct lmc_object_source identity;
+    if (!source_open(&source, argv[first_path]))
+        return 1;
+    if (memory)
+    {
+        int status = run_extended(&source, memory, &exec, mailboxes.instream, show_steps);
+        source_close(&source);
+        return status;
+    }
+    struct lmc_perf perf;
+    struct lmc_perf_sample assemble_sample;
+    if (stats)
+    {
+        lmc_perf_open(&perf);
+        lmc_perf_start(&perf);
+    }
+    bool result = load_program(&source, cache, &mailboxes, &symbols, &identity);
+    if (stats)
+        lmc_perf_stop(&perf, &assemble_sample);
+    source_close(&source);
     if (!result)
+    {
+        if (stats)
+            lmc_perf_close(&perf);
         goto fail;
+    }
 
-    if (!lmc_execute(&mailboxes))
+    if (emit)
+    {
+        int err = lmc_object_save(emit, &mailboxes, &symbols, &identity);
+        if (err)
+            fprintf(stderr, "Could not write \"%s\": %s\n", emit, strerror(err));
+        return err != 0;
+    }
+
+    if (emit_c)
+    {
+        int err = lmc_aot_save(emit_c, &mailboxes, &symbols);
+        if (err)
+            fprintf(stderr, "Could not write \"%s\": %s\n", emit_c, strerror(err));
+        return err != 0;
+    }
+
+    if (vectors)
+        return run_lanes(&mailboxes, vectors, exec.max_steps);
+
+    exec.code_immutable = lmc_code_immutable(&mailboxes);
+    if (cases)
+        return run_cases(&mailboxes, cases, &exec, threads);
+    struct lmc_profile* counters = NULL;
+    if (profile)
+        exec.profile = counters = (struct lmc_profile*)quick_calloc(1, sizeof(struct lmc_profile));
+    FILE* trace_file = NULL;
+    if (trace)
+    {
+        errno_t err = fopen_s(&trace_file, trace, "wb");
+        if (err)
+        {
+            fprintf(stderr, "Could not write \"%s\": %s\n", trace, strerror(err));
+            return 1;
+        }
+        exec.trace = lmc_trace_open(trace_file);
+        if (!exec.trace)
+        {
+            fprintf(stderr, "Could not start tracing to \"%s\"\n", trace);
+            fclose(trace_file);
+            return 1;
+        }
+    }
+    if (stats)
+        lmc_perf_start(&perf);
+    result = lmc_execute_ex(&mailboxes, &exec);
+    if (stats)
+    {
+        struct lmc_perf_sample execute_sample;
+        lmc_perf_stop(&perf, &execute_sample);
+        lmc_perf_close(&perf);
+        print_stats(&exec, &assemble_sample, &execute_sample);
+    }
+    if (trace_file)
+    {
+        if (!lmc_trace_close(exec.trace))
+            fprintf(stderr, "Could not write all of \"%s\"\n", trace);
+        fclose(trace_file);
+    }
+    if (show_steps)
+        fprintf(stderr, "%llu steps\n", exec.steps);
+    if (counters)
+    {
+        lmc_profile_report(stderr, counters, &symbols);
+        free(counters);
+    }
+    if (!result)
         goto fail;
 
     return 0;
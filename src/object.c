@@ -0,0 +1,146 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+
+#include "lmc.h"
+#include "object.h"
+#include "util.h"
+
+static const unsigned char object_magic[4] = { 0x7F, 'L', 'M', 'O' };
+
+unsigned long long lmc_source_hash(const char* buffer, size_t length)
+{
+    // FNV-1a.
+    unsigned long long hash = 14695981039346656037ull;
+    for (size_t i = 0; i < length; i++)
+        hash = (hash ^ (unsigned char)buffer[i]) * 1099511628211ull;
+    return hash;
+}
+
+bool lmc_object_is_image(const void* data, size_t length)
+{
+    return length >= sizeof(object_magic) && memcmp(data, object_magic, sizeof(object_magic)) == 0;
+}
+
+size_t lmc_object_write(void* data, const struct mailboxes* mailboxes,
+                        const struct lmc_symbols* symbols, const struct lmc_object_source* source)
+{
+    unsigned char* out = (unsigned char*)data;
+    memcpy(out, object_magic, sizeof(object_magic));
+    util_store_le16(&out[4], LMC_OBJECT_VERSION);
+    util_store_le16(&out[6], (unsigned int)symbols->count);
+    util_store_le64(&out[8], source->hash);
+    util_store_le64(&out[16], source->length);
+    for (int i = 0; i < NUM_MAILBOXES; i++)
+    {
+        util_store_le16(&out[24 + i * 2], (unsigned short)mailboxes->pool[i]);
+        util_store_le32(&out[224 + i * 4], symbols->lines[i]);
+    }
+
+    size_t length = LMC_OBJECT_HEADER_SIZE;
+    for (size_t i = 0; i < symbols->count; i++)
+    {
+        const struct lmc_symbol* symbol = &symbols->symbols[i];
+        size_t name_length = strlen(symbol->name);
+        out[length++] = symbol->address;
+        out[length++] = (unsigned char)name_length;
+        memcpy(&out[length], symbol->name, name_length);
+        length += name_length;
+    }
+    return length;
+}
+
+bool lmc_object_read(const void* data, size_t length, struct mailboxes* mailboxes,
+                     struct lmc_symbols* symbols, struct lmc_object_source* source)
+{
+    const unsigned char* in = (const unsigned char*)data;
+    if (length < LMC_OBJECT_HEADER_SIZE || !lmc_object_is_image(data, length))
+    {
+        strcpy_s(mailboxes->error_msg, sizeof(mailboxes->error_msg), "Not an object image");
+        return false;
+    }
+    if (util_load_le16(&in[4]) != LMC_OBJECT_VERSION)
+    {
+        sprintf_s(mailboxes->error_msg, sizeof(mailboxes->error_msg),
+                  "Unsupported object image version %u", util_load_le16(&in[4]));
+        return false;
+    }
+
+    // Check the symbol table before anything is overwritten.
+    size_t count = util_load_le16(&in[6]);
+    size_t offset = LMC_OBJECT_HEADER_SIZE;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (count > NUM_MAILBOXES || offset + 2 > length || in[offset] >= NUM_MAILBOXES ||
+            in[offset + 1] >= LMC_SYMBOL_LENGTH || offset + 2 + in[offset + 1] > length)
+        {
+            strcpy_s(mailboxes->error_msg, sizeof(mailboxes->error_msg),
+                     "Object image is corrupt");
+            return false;
+        }
+        offset += 2 + in[offset + 1];
+    }
+
+    for (int i = 0; i < NUM_MAILBOXES; i++)
+        mailboxes->pool[i] = (short)util_load_le16(&in[24 + i * 2]);
+    if (source)
+    {
+        source->hash = util_load_le64(&in[8]);
+        source->length = util_load_le64(&in[16]);
+    }
+    if (symbols)
+    {
+        for (int i = 0; i < NUM_MAILBOXES; i++)
+            symbols->lines[i] = (unsigned int)util_load_le32(&in[224 + i * 4]);
+        symbols->count = count;
+        offset = LMC_OBJECT_HEADER_SIZE;
+        for (size_t i = 0; i < count; i++)
+        {
+            struct lmc_symbol* symbol = &symbols->symbols[i];
+            symbol->address = in[offset];
+            memcpy(symbol->name, &in[offset + 2], in[offset + 1]);
+            symbol->name[in[offset + 1]] = '\0';
+            offset += 2 + in[offset + 1];
+        }
+    }
+    return true;
+}
+
+int lmc_object_save(const char* path, const struct mailboxes* mailboxes,
+                    const struct lmc_symbols* symbols, const struct lmc_object_source* source)
+{
+    unsigned char image[LMC_OBJECT_MAX_SIZE];
+    size_t length = lmc_object_write(image, mailboxes, symbols, source);
+
+    FILE* file;
+    errno_t err = fopen_s(&file, path, "wb");
+    if (err)
+        return err;
+    if (fwrite(image, 1, length, file) != length)
+        err = errno ? errno : EIO;
+    if (fclose(file) != 0 && !err)
+        err = errno ? errno : EIO;
+    return err;
+}
+
+bool lmc_object_load(const char* path, struct mailboxes* mailboxes, struct lmc_symbols* symbols,
+                     struct lmc_object_source* source)
+{
+    FILE* file;
+    errno_t err = fopen_s(&file, path, "rb");
+    if (err)
+    {
+        sprintf_s(mailboxes->error_msg, sizeof(mailboxes->error_msg),
+                  "Could not read file \"%s\": %s", path, strerror(err));
+        return false;
+    }
+
+    unsigned char image[LMC_OBJECT_MAX_SIZE];
+    size_t length = fread(image, 1, sizeof(image), file);
+    fclose(file);
+    return lmc_object_read(image, length, mailboxes, symbols, source);
+}
@@ -0,0 +1,57 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "lmc.h"
+
+// Assembled programs can be saved as binary object images (.lmo files), so that running the
+// same program again doesn't need to go through the assembler. An image holds:
+//
+//   offset  size  contents
+//   0       4     magic, "\x7FLMO"
+//   4       2     format version (LMC_OBJECT_VERSION)
+//   6       2     number of symbols
+//   8       8     hash of the source the image was assembled from (lmc_source_hash())
+//   16      8     length of that source
+//   24      200   the mailboxes, as 16-bit values
+//   224     400   the source line of each mailbox, as 32-bit values
+//   624     ...   each symbol, as its address, the length of its name, and the name itself
+//
+// All numbers are little-endian.
+#define LMC_OBJECT_VERSION      1
+#define LMC_OBJECT_HEADER_SIZE  624
+#define LMC_OBJECT_MAX_SIZE     (LMC_OBJECT_HEADER_SIZE + NUM_MAILBOXES * (LMC_SYMBOL_LENGTH + 1))
+
+// The identity of the source an image was assembled from.
+struct lmc_object_source
+{
+    unsigned long long hash;
+    unsigned long long length;
+};
+
+// Hash a program's source.
+unsigned long long lmc_source_hash(const char* buffer, size_t length);
+
+// Check whether a buffer looks like an object image rather than source code.
+bool lmc_object_is_image(const void* data, size_t length);
+
+// Write an image into a buffer of at least LMC_OBJECT_MAX_SIZE bytes, returning its size.
+size_t lmc_object_write(void* data, const struct mailboxes* mailboxes,
+                        const struct lmc_symbols* symbols, const struct lmc_object_source* source);
+
+// Read an image into the mailboxes, and optionally its symbols and source identity. On
+// failure, the reason is left in the mailboxes' error message.
+bool lmc_object_read(const void* data, size_t length, struct mailboxes* mailboxes,
+                     struct lmc_symbols* symbols, struct lmc_object_source* source);
+
+// Save an image to a file, returning 0 or the errno value that caused it to fail.
+int lmc_object_save(const char* path, const struct mailboxes* mailboxes,
+                    const struct lmc_symbols* symbols, const struct lmc_object_source* source);
+
+// Load an image from a file. On failure, the reason is left in the mailboxes' error message.
+bool lmc_object_load(const char* path, struct mailboxes* mailboxes, struct lmc_symbols* symbols,
+                     struct lmc_object_source* source);
@@ -0,0 +1,154 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "perf.h"
+
+static const char* const counter_names[] =
+{
+#define X(name, string) string,
+    LMC_PERF_COUNTER_LIST
+#undef X
+};
+
+#if defined(__linux__)
+// The hardware event behind each counter, in the order of LMC_PERF_COUNTER_LIST.
+static const unsigned long long counter_events[] =
+{
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_BRANCH_MISSES,
+    PERF_COUNT_HW_CACHE_MISSES,
+};
+
+_Static_assert(sizeof(counter_events) / sizeof(counter_events[0]) == LMC_PERF_COUNTER_COUNT,
+               "counter_events does not match LMC_PERF_COUNTER_LIST");
+#endif
+
+double lmc_perf_now(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+#endif
+}
+
+// Open the counters for the calling thread. Each counter is opened on its own rather than as
+// a group, so that one the PMU cannot provide does not take the others down with it, and the
+// kernel multiplexes them if there are more than it has registers for.
+void lmc_perf_open(struct lmc_perf* perf)
+{
+    for (int i = 0; i < LMC_PERF_COUNTER_COUNT; ++i)
+    {
+        perf->fds[i] = -1;
+#if defined(__linux__)
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = counter_events[i];
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        perf->fds[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+    }
+    perf->start = 0;
+}
+
+void lmc_perf_close(struct lmc_perf* perf)
+{
+#if defined(__linux__)
+    for (int i = 0; i < LMC_PERF_COUNTER_COUNT; ++i)
+    {
+        if (perf->fds[i] >= 0)
+            close(perf->fds[i]);
+    }
+#endif
+}
+
+// Count from zero until lmc_perf_stop().
+void lmc_perf_start(struct lmc_perf* perf)
+{
+#if defined(__linux__)
+    for (int i = 0; i < LMC_PERF_COUNTER_COUNT; ++i)
+    {
+        if (perf->fds[i] >= 0)
+        {
+            ioctl(perf->fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(perf->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#endif
+    perf->start = lmc_perf_now();
+}
+
+void lmc_perf_stop(struct lmc_perf* perf, struct lmc_perf_sample* sample)
+{
+    sample->seconds = lmc_perf_now() - perf->start;
+    for (int i = 0; i < LMC_PERF_COUNTER_COUNT; ++i)
+    {
+        sample->available[i] = false;
+        sample->counts[i] = 0;
+#if defined(__linux__)
+        if (perf->fds[i] < 0)
+            continue;
+        ioctl(perf->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+
+        // The value, and how long the counter was enabled and actually running for. A
+        // counter that had to share its register only ran for part of the time, so its
+        // value is scaled up to cover the rest.
+        unsigned long long values[3];
+        if (read(perf->fds[i], values, sizeof(values)) != (ssize_t)sizeof(values) || values[2] == 0)
+            continue;
+        sample->available[i] = true;
+        sample->counts[i] = (values[2] < values[1])
+                          ? (unsigned long long)((double)values[0] * values[1] / values[2])
+                          : values[0];
+#endif
+    }
+}
+
+// Get the name of a counter.
+const char* lmc_perf_counter_name(enum lmc_perf_counter counter)
+{
+    return (counter < LMC_PERF_COUNTER_COUNT) ? counter_names[counter] : "unknown";
+}
+
+// Write a sample out as a JSON object.
+void lmc_perf_write_json(FILE* file, const struct lmc_perf_sample* sample)
+{
+    fprintf(file, "{\"seconds\": %.9f", sample->seconds);
+    for (int i = 0; i < LMC_PERF_COUNTER_COUNT; ++i)
+    {
+        if (sample->available[i])
+            fprintf(file, ", \"%s\": %llu", counter_names[i], sample->counts[i]);
+        else
+            fprintf(file, ", \"%s\": null", counter_names[i]);
+    }
+    fputc('}', file);
+}
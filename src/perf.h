@@ -0,0 +1,58 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <stdio.h>
+#include <stdbool.h>
+
+// Host CPU counters, for measuring how the interpreter itself behaves rather than the program
+// it runs. On Linux they are counted in user space with perf_event_open(); anywhere else, or
+// where the kernel or the hardware does not allow a counter, that counter is simply left out
+// and only the wall time is measured.
+#define LMC_PERF_COUNTER_LIST                   \
+    X(CYCLES,           "cycles")               \
+    X(INSTRUCTIONS,     "host_instructions")    \
+    X(BRANCH_MISSES,    "branch_misses")        \
+    X(CACHE_MISSES,     "cache_misses")
+
+enum lmc_perf_counter
+{
+#define X(name, string) LMC_PERF_##name,
+    LMC_PERF_COUNTER_LIST
+#undef X
+    LMC_PERF_COUNTER_COUNT
+};
+
+// A set of counters, opened once and then started and stopped around each stretch of code
+// to be measured.
+struct lmc_perf
+{
+    int fds[LMC_PERF_COUNTER_COUNT];    // -1 for counters that are not available.
+    double start;
+};
+
+// What one stretch of code came to.
+struct lmc_perf_sample
+{
+    double seconds;
+    bool available[LMC_PERF_COUNTER_COUNT];
+    unsigned long long counts[LMC_PERF_COUNTER_COUNT];
+};
+
+// Monotonic wall time in seconds, from some arbitrary starting point.
+double lmc_perf_now(void);
+
+// Open the counters for the calling thread.
+void lmc_perf_open(struct lmc_perf* perf);
+void lmc_perf_close(struct lmc_perf* perf);
+
+// Count from zero until lmc_perf_stop().
+void lmc_perf_start(struct lmc_perf* perf);
+void lmc_perf_stop(struct lmc_perf* perf, struct lmc_perf_sample* sample);
+
+// Get the name of a counter, as used in JSON output.
+const char* lmc_perf_counter_name(enum lmc_perf_counter counter);
+
+// Write a sample out as a JSON object, with null for the counters that were not available.
+void lmc_perf_write_json(FILE* file, const struct lmc_perf_sample* sample);
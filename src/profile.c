@@ -0,0 +1,178 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lmc.h"
+#include "lmc_internal.h"
+#include "profile.h"
+#include "util.h"
+
+#define PROFILE_TOP_LOOPS       10
+#define PROFILE_TOP_MAILBOXES   20
+
+static const char* const profile_op_names[] =
+{
+#define X(name) #name,
+    OPCODE_LIST
+#undef X
+};
+
+// A backward branch that was taken, and the instructions it loops over.
+struct profile_loop
+{
+    unsigned char head;
+    unsigned char tail;
+    unsigned long long iterations;
+    unsigned long long instructions;
+};
+
+// Describe an address by its nearest label at or before it, i.e. "loop" or "loop+2".
+static void describe_address(char* out, size_t size, const struct lmc_symbols* symbols,
+                             unsigned char address)
+{
+    const struct lmc_symbol* nearest = NULL;
+    for (size_t i = 0; symbols && i < symbols->count; i++)
+    {
+        const struct lmc_symbol* symbol = &symbols->symbols[i];
+        if (symbol->address <= address && (!nearest || symbol->address > nearest->address))
+            nearest = symbol;
+    }
+
+    if (!nearest)
+        snprintf(out, size, "-");
+    else if (nearest->address == address)
+        snprintf(out, size, "%s", nearest->name);
+    else
+        snprintf(out, size, "%s+%d", nearest->name, address - nearest->address);
+}
+
+static unsigned int source_line(const struct lmc_symbols* symbols, unsigned char address)
+{
+    return symbols ? symbols->lines[address] : 0;
+}
+
+static int compare_loops(const void* lhs, const void* rhs)
+{
+    const struct profile_loop* a = (const struct profile_loop*)lhs;
+    const struct profile_loop* b = (const struct profile_loop*)rhs;
+    return (a->instructions < b->instructions) - (a->instructions > b->instructions);
+}
+
+// A mailbox that was used, along with how much, so that sorting them needs nothing else.
+struct profile_mailbox
+{
+    unsigned char address;
+    unsigned long long hits;
+    unsigned long long data;
+};
+
+static int compare_mailboxes(const void* lhs, const void* rhs)
+{
+    const struct profile_mailbox* a = (const struct profile_mailbox*)lhs;
+    const struct profile_mailbox* b = (const struct profile_mailbox*)rhs;
+    if (a->hits != b->hits)
+        return (a->hits < b->hits) - (a->hits > b->hits);
+    if (a->data != b->data)
+        return (a->data < b->data) - (a->data > b->data);
+    return a->address - b->address;
+}
+
+void lmc_profile_report(FILE* stream, const struct lmc_profile* profile,
+                        const struct lmc_symbols* symbols)
+{
+    unsigned long long total = 0;
+    for (int i = 0; i < NUM_MAILBOXES; i++)
+        total += profile->hits[i];
+    fprintf(stream, "Profile of %llu instructions\n", total);
+
+    // Every taken backward branch closes a loop over everything from its target up to it.
+    char head_name[LMC_SYMBOL_LENGTH + 8];
+    char tail_name[LMC_SYMBOL_LENGTH + 8];
+    struct profile_loop loops[NUM_MAILBOXES];
+    size_t loop_count = 0;
+    for (int i = 0; i < NUM_MAILBOXES; i++)
+    {
+        if (profile->taken[i] == 0 || profile->targets[i] > i)
+            continue;
+
+        struct profile_loop* loop = &loops[loop_count++];
+        loop->head = profile->targets[i];
+        loop->tail = (unsigned char)i;
+        loop->iterations = profile->taken[i];
+        loop->instructions = 0;
+        for (int address = loop->head; address <= i; address++)
+            loop->instructions += profile->hits[address];
+    }
+    qsort(loops, loop_count, sizeof(struct profile_loop), compare_loops);
+
+    fprintf(stream, "\nHottest loops:\n");
+    fprintf(stream, "  %-9s %-11s %14s %8s  %s\n", "addresses", "lines", "instructions", "%", 
+            "iterations");
+    for (size_t i = 0; i < min(loop_count, PROFILE_TOP_LOOPS); i++)
+    {
+        const struct profile_loop* loop = &loops[i];
+        char addresses[16], lines[32];
+        snprintf(addresses, sizeof(addresses), "%d-%d", loop->head, loop->tail);
+        snprintf(lines, sizeof(lines), "%u-%u", source_line(symbols, loop->head),
+                 source_line(symbols, loop->tail));
+        describe_address(head_name, sizeof(head_name), symbols, loop->head);
+        describe_address(tail_name, sizeof(tail_name), symbols, loop->tail);
+        fprintf(stream, "  %-9s %-11s %14llu %7.1f%%  %llu (%s .. %s)\n", addresses, lines,
+                loop->instructions, total ? 100.0 * loop->instructions / total : 0.0,
+                loop->iterations, head_name, tail_name);
+    }
+    if (loop_count == 0)
+        fprintf(stream, "  (none)\n");
+
+    // The mailboxes that were used the most, whether as code or as data.
+    struct profile_mailbox order[NUM_MAILBOXES];
+    size_t used = 0;
+    for (int i = 0; i < NUM_MAILBOXES; i++)
+    {
+        if (profile->hits[i] || profile->reads[i] || profile->writes[i])
+        {
+            struct profile_mailbox* mailbox = &order[used++];
+            mailbox->address = (unsigned char)i;
+            mailbox->hits = profile->hits[i];
+            mailbox->data = profile->reads[i] + profile->writes[i];
+        }
+    }
+    qsort(order, used, sizeof(struct profile_mailbox), compare_mailboxes);
+
+    fprintf(stream, "\nBusiest mailboxes:\n");
+    fprintf(stream, "  %-7s %-5s %-20s %14s %14s %14s\n", "address", "line", "label", "executed",
+            "reads", "writes");
+    for (size_t i = 0; i < min(used, PROFILE_TOP_MAILBOXES); i++)
+    {
+        unsigned char address = order[i].address;
+        describe_address(head_name, sizeof(head_name), symbols, address);
+        fprintf(stream, "  %-7d %-5u %-20s %14llu %14llu %14llu\n", address,
+                source_line(symbols, address), head_name, profile->hits[address],
+                profile->reads[address], profile->writes[address]);
+    }
+
+    fprintf(stream, "\nOpcodes:\n");
+    for (int op = HLT; op <= OUT; op++)
+    {
+        if (op == DAT || profile->opcodes[op] == 0)
+            continue;
+        fprintf(stream, "  %s %14llu %7.1f%%\n", profile_op_names[op], profile->opcodes[op],
+                total ? 100.0 * profile->opcodes[op] / total : 0.0);
+    }
+
+    fprintf(stream, "\nBranches:\n");
+    fprintf(stream, "  %-7s %-5s %-20s %14s %14s\n", "address", "line", "label", "taken",
+            "not taken");
+    for (int i = 0; i < NUM_MAILBOXES; i++)
+    {
+        if (profile->taken[i] == 0 && profile->not_taken[i] == 0)
+            continue;
+        describe_address(head_name, sizeof(head_name), symbols, (unsigned char)i);
+        fprintf(stream, "  %-7d %-5u %-20s %14llu %14llu\n", i, source_line(symbols, i),
+                head_name, profile->taken[i], profile->not_taken[i]);
+    }
+}
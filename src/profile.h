@@ -0,0 +1,14 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <stdio.h>
+
+#include "lmc.h"
+
+// Print a report of a profiled run: its hottest loops, the busiest mailboxes, how often
+// each opcode executed and how each branch went. Addresses are mapped back to source lines
+// and labels with the program's symbols, if there are any (symbols can be NULL).
+void lmc_profile_report(FILE* stream, const struct lmc_profile* profile,
+                        const struct lmc_symbols* symbols);
@@ -0,0 +1,398 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef SOCKET socket_t;
+#define INVALID_SOCKET_VALUE    INVALID_SOCKET
+#define close_socket            closesocket
+#else
+#include <signal.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+typedef int socket_t;
+#define INVALID_SOCKET_VALUE    (-1)
+#define close_socket            close
+#endif
+
+#include "lmc.h"
+#include "lmc_vm.h"
+#include "server.h"
+#include "thread.h"
+#include "util.h"
+
+// Readers stop taking requests off their connections once this many are waiting for a
+// worker, so that a flood of small requests can't pile up without end.
+#define SERVER_MAX_QUEUED   1024
+
+// The most that the programs and inputs of every job the server holds, from the moment a
+// reader has read a job's header until a worker has finished with it, add up to. A reader
+// waits for enough of this to be free before it takes in a job's payload, so that a flood of
+// large requests can't use up all of the server's memory. A job is always let in once nothing
+// else is held, however large it is.
+#define SERVER_MAX_PAYLOAD  ((size_t)256 << 20)
+
+static const unsigned char request_magic[4] = { 'L', 'M', 'C', 'Q' };
+static const unsigned char response_magic[4] = { 'L', 'M', 'C', 'A' };
+
+// A client connection. It is shared by the thread reading requests off it and by every
+// worker with one of its requests, and goes away once the last of them lets go of it.
+struct server_connection
+{
+    struct server* server;
+    socket_t socket;
+    mutex_t write_lock;
+    unsigned int references;
+};
+
+struct server_job
+{
+    struct server_connection* connection;
+    unsigned long id;
+    unsigned long long max_steps;
+    unsigned int engine;
+    const char* program;
+    size_t program_length;
+    const char* input;
+    size_t input_length;
+    struct server_job* next;
+};
+
+struct server
+{
+    enum lmc_engine engine;
+    unsigned long long max_steps;
+
+    mutex_t lock;
+    cond_t jobs_ready;
+    cond_t queue_space;
+    struct server_job* head;
+    struct server_job* tail;
+    size_t queued;
+    size_t payload;         // Bytes of program and input held, see SERVER_MAX_PAYLOAD.
+};
+
+static bool recv_all(socket_t socket, void* data, size_t length)
+{
+    char* at = (char*)data;
+    while (length > 0)
+    {
+        int count = recv(socket, at, (int)min(length, 1 << 30), 0);
+        if (count <= 0)
+            return false;
+        at += count;
+        length -= count;
+    }
+    return true;
+}
+
+static bool send_all(socket_t socket, const void* data, size_t length)
+{
+#ifdef MSG_NOSIGNAL
+    const int flags = MSG_NOSIGNAL;
+#else
+    const int flags = 0;
+#endif
+    const char* at = (const char*)data;
+    while (length > 0)
+    {
+        int count = send(socket, at, (int)min(length, 1 << 30), flags);
+        if (count <= 0)
+            return false;
+        at += count;
+        length -= count;
+    }
+    return true;
+}
+
+static void connection_release(struct server_connection* connection)
+{
+    struct server* server = connection->server;
+    mutex_lock(&server->lock);
+    bool last = (--connection->references == 0);
+    mutex_unlock(&server->lock);
+    if (!last)
+        return;
+
+    close_socket(connection->socket);
+    mutex_destroy(&connection->write_lock);
+    free(connection);
+}
+
+// Give back the payload of a job that the server no longer holds.
+static void server_release_payload(struct server* server, size_t length)
+{
+    mutex_lock(&server->lock);
+    server->payload -= length;
+    cond_broadcast(&server->queue_space);
+    mutex_unlock(&server->lock);
+}
+
+// Take requests off a connection and queue them up for the workers, until the client hangs
+// up or sends something malformed.
+static void server_reader_main(void* arg)
+{
+    struct server_connection* connection = (struct server_connection*)arg;
+    struct server* server = connection->server;
+    unsigned char header[LMC_SERVER_HEADER_SIZE];
+    while (recv_all(connection->socket, header, sizeof(header)))
+    {
+        static const unsigned char reserved[7] = { 0 };
+        size_t program_length = util_load_le32(&header[16]);
+        size_t input_length = util_load_le32(&header[20]);
+        if (memcmp(header, request_magic, sizeof(request_magic)) != 0 ||
+            (header[24] >= LMC_ENGINE_COUNT && header[24] != LMC_SERVER_DEFAULT_ENGINE) ||
+            memcmp(&header[25], reserved, sizeof(reserved)) != 0 ||
+            program_length > LMC_SERVER_MAX_PROGRAM || input_length > LMC_SERVER_MAX_INPUT)
+            break;
+
+        size_t payload_length = program_length + input_length;
+        mutex_lock(&server->lock);
+        while (server->payload > 0 && server->payload + payload_length > SERVER_MAX_PAYLOAD)
+            cond_wait(&server->queue_space, &server->lock);
+        server->payload += payload_length;
+        mutex_unlock(&server->lock);
+
+        // The job and everything it was sent all go in one block.
+        struct server_job* job = (struct server_job*)quick_malloc(sizeof(struct server_job) +
+                                                                  payload_length);
+        char* payload = (char*)(job + 1);
+        job->connection = connection;
+        job->id = util_load_le32(&header[4]);
+        job->max_steps = util_load_le64(&header[8]);
+        job->engine = header[24];
+        job->program = payload;
+        job->program_length = program_length;
+        job->input = payload + program_length;
+        job->input_length = input_length;
+        if (!recv_all(connection->socket, payload, payload_length))
+        {
+            free(job);
+            server_release_payload(server, payload_length);
+            break;
+        }
+
+        mutex_lock(&server->lock);
+        while (server->queued >= SERVER_MAX_QUEUED)
+            cond_wait(&server->queue_space, &server->lock);
+        connection->references++;
+        if (server->tail)
+            server->tail->next = job;
+        else
+            server->head = job;
+        server->tail = job;
+        server->queued++;
+        cond_signal(&server->jobs_ready);
+        mutex_unlock(&server->lock);
+    }
+    connection_release(connection);
+}
+
+static void server_respond(struct lmc_vm* vm, const struct server_job* job)
+{
+    size_t output_total;
+    const char* output = lmc_vm_output(vm, &output_total);
+    size_t output_length = min(output_total, LMC_VM_OUTPUT_SIZE);
+    const char* error = lmc_vm_error(vm);
+    size_t error_length = strlen(error);
+
+    unsigned char header[LMC_SERVER_HEADER_SIZE] = { 0 };
+    memcpy(header, response_magic, sizeof(response_magic));
+    util_store_le32(&header[4], job->id);
+    util_store_le64(&header[8], lmc_vm_steps(vm));
+    util_store_le32(&header[16], lmc_vm_status(vm));
+    util_store_le32(&header[20], (unsigned long)output_length);
+    util_store_le32(&header[24], (unsigned long)error_length);
+    util_store_le32(&header[28], (unsigned long)min(output_total, 0xFFFFFFFF));
+
+    // A client that has gone away just loses its response; its reader will notice soon
+    // enough.
+    struct server_connection* connection = job->connection;
+    mutex_lock(&connection->write_lock);
+    if (send_all(connection->socket, header, sizeof(header)) &&
+        send_all(connection->socket, output, output_length))
+        send_all(connection->socket, error, error_length);
+    mutex_unlock(&connection->write_lock);
+}
+
+static void server_worker_main(void* arg)
+{
+    struct server* server = (struct server*)arg;
+    struct lmc_vm* vm = lmc_vm_create(server->engine);
+    for (;;)
+    {
+        mutex_lock(&server->lock);
+        while (!server->head)
+            cond_wait(&server->jobs_ready, &server->lock);
+        struct server_job* job = server->head;
+        server->head = job->next;
+        if (!server->head)
+            server->tail = NULL;
+        server->queued--;
+        cond_broadcast(&server->queue_space);
+        mutex_unlock(&server->lock);
+
+        unsigned long long max_steps = job->max_steps;
+        if (!max_steps || max_steps > server->max_steps)
+            max_steps = server->max_steps;
+        bool default_engine = (job->engine == LMC_SERVER_DEFAULT_ENGINE);
+        lmc_vm_set_engine(vm, (default_engine) ? server->engine : (enum lmc_engine)job->engine);
+        lmc_vm_set_max_steps(vm, max_steps);
+        lmc_vm_set_input(vm, job->input, job->input_length);
+        if (lmc_vm_load(vm, job->program, job->program_length))
+            lmc_vm_run(vm);
+
+        server_respond(vm, job);
+        connection_release(job->connection);
+        size_t payload_length = job->program_length + job->input_length;
+        free(job);
+        server_release_payload(server, payload_length);
+    }
+}
+
+// Open the listening socket for an address.
+static socket_t server_listen(const char* address)
+{
+    socket_t listener = INVALID_SOCKET_VALUE;
+#ifndef _WIN32
+    if (strncmp(address, "unix:", 5) == 0)
+    {
+        struct sockaddr_un local = { 0 };
+        local.sun_family = AF_UNIX;
+        if (strlen(address + 5) >= sizeof(local.sun_path))
+        {
+            fprintf(stderr, "Socket path \"%s\" is too long\n", address + 5);
+            return INVALID_SOCKET_VALUE;
+        }
+        strcpy(local.sun_path, address + 5);
+        unlink(local.sun_path);
+
+        listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listener == INVALID_SOCKET_VALUE ||
+            bind(listener, (struct sockaddr*)&local, sizeof(local)) != 0 || listen(listener, 128) != 0)
+        {
+            perror("Could not listen on the socket");
+            if (listener != INVALID_SOCKET_VALUE)
+                close_socket(listener);
+            return INVALID_SOCKET_VALUE;
+        }
+        return listener;
+    }
+#endif
+
+    // Anything else is a TCP port, optionally preceded by a host to bind to.
+    char host[256] = "";
+    const char* port = address;
+    const char* colon = strrchr(address, ':');
+    if (colon)
+    {
+        snprintf(host, sizeof(host), "%.*s", (int)(colon - address), address);
+        port = colon + 1;
+    }
+
+    struct addrinfo hints = { 0 };
+    struct addrinfo* addresses;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    int err = getaddrinfo(host[0] ? host : NULL, port, &hints, &addresses);
+    if (err != 0)
+    {
+        fprintf(stderr, "Could not resolve \"%s\": %s\n", address, gai_strerror(err));
+        return INVALID_SOCKET_VALUE;
+    }
+    for (struct addrinfo* at = addresses; at; at = at->ai_next)
+    {
+        listener = socket(at->ai_family, at->ai_socktype, at->ai_protocol);
+        if (listener == INVALID_SOCKET_VALUE)
+            continue;
+        int reuse = 1;
+        setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+        if (bind(listener, at->ai_addr, (int)at->ai_addrlen) == 0 && listen(listener, 128) == 0)
+            break;
+        close_socket(listener);
+        listener = INVALID_SOCKET_VALUE;
+    }
+    freeaddrinfo(addresses);
+    if (listener == INVALID_SOCKET_VALUE)
+        fprintf(stderr, "Could not listen on \"%s\"\n", address);
+    return listener;
+}
+
+bool lmc_server_run(const char* address, enum lmc_engine engine, unsigned long long max_steps,
+                    unsigned int workers)
+{
+#ifdef _WIN32
+    WSADATA wsa;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0)
+    {
+        fputs("Could not start Winsock\n", stderr);
+        return false;
+    }
+#else
+    // Writing to a client that has hung up must not take the whole server down.
+    signal(SIGPIPE, SIG_IGN);
+#endif
+
+    socket_t listener = server_listen(address);
+    if (listener == INVALID_SOCKET_VALUE)
+        return false;
+
+    struct server* server = (struct server*)quick_calloc(1, sizeof(struct server));
+    server->engine = engine;
+    server->max_steps = (max_steps) ? max_steps : LMC_SERVER_DEFAULT_STEPS;
+    mutex_init(&server->lock);
+    cond_init(&server->jobs_ready);
+    cond_init(&server->queue_space);
+
+    if (workers == 0)
+        workers = thread_hardware_concurrency();
+    for (unsigned int i = 0; i < workers; ++i)
+    {
+        thread_t thread;
+        if (!thread_create(&thread, server_worker_main, server))
+        {
+            fputs("Could not start the worker threads\n", stderr);
+            return false;
+        }
+        thread_detach(thread);
+    }
+    fprintf(stderr, "Serving on %s with %u workers\n", address, workers);
+
+    for (;;)
+    {
+        socket_t client = accept(listener, NULL, NULL);
+        if (client == INVALID_SOCKET_VALUE)
+            continue;
+
+        // Requests and responses are small, so don't let Nagle hold them back.
+        int no_delay = 1;
+        setsockopt(client, IPPROTO_TCP, TCP_NODELAY, (const char*)&no_delay, sizeof(no_delay));
+
+        struct server_connection* connection =
+            (struct server_connection*)quick_calloc(1, sizeof(struct server_connection));
+        connection->server = server;
+        connection->socket = client;
+        connection->references = 1;
+        mutex_init(&connection->write_lock);
+
+        thread_t reader;
+        if (!thread_create(&reader, server_reader_main, connection))
+        {
+            connection_release(connection);
+            continue;
+        }
+        thread_detach(reader);
+    }
+}
@@ -0,0 +1,56 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "lmc.h"
+
+// A long-lived job server. Clients connect over TCP (an address of "port" or "host:port")
+// or, outside of Windows, a Unix socket ("unix:path"), and send any number of framed
+// requests down a connection without waiting for the responses. Requests are run on a pool
+// of workers, each of which keeps one VM context for its lifetime, and every response
+// carries the id of its request because responses come back in the order they finish.
+//
+// A request is a 32-byte header followed by the program and its input:
+//
+//   offset  size  contents
+//   0       4     magic, "LMCQ"
+//   4       4     request id, echoed in the response
+//   8       8     step budget, or 0 for the server's default
+//   16      4     length of the program (source code or an object image)
+//   20      4     length of the input, which is read the same way as a stream
+//   24      1     engine (an enum lmc_engine), or 255 for the server's default
+//   25      7     reserved, must be zero
+//
+// and a response is a 32-byte header followed by the program's output and error message:
+//
+//   offset  size  contents
+//   0       4     magic, "LMCA"
+//   4       4     request id
+//   8       8     instructions executed
+//   16      4     status (an enum lmc_status)
+//   20      4     length of the output sent
+//   24      4     length of the error message (0 if the program halted)
+//   28      4     length of all of the output the program wrote
+//
+// Only the first LMC_VM_OUTPUT_SIZE characters of the output are sent, so a response whose
+// output was cut short has a larger length at offset 28 than at offset 20. All numbers are
+// little-endian. A malformed request, including one with an engine that is neither a known
+// one nor 255, closes the connection.
+#define LMC_SERVER_HEADER_SIZE      32
+#define LMC_SERVER_MAX_PROGRAM      (1 << 20)
+#define LMC_SERVER_MAX_INPUT        (1 << 24)
+#define LMC_SERVER_DEFAULT_ENGINE   255
+
+// The step budget used when the server is not given one, so that a job which never halts
+// can't tie up a worker for good.
+#define LMC_SERVER_DEFAULT_STEPS    100000000ULL
+
+// Serve requests until the process is killed, returning only if the server could not be
+// started. Requests without a step budget of their own use max_steps, and ones that ask for
+// more are capped to it. A max_steps of 0 means LMC_SERVER_DEFAULT_STEPS; every job has a
+// budget.
+bool lmc_server_run(const char* address, enum lmc_engine engine, unsigned long long max_steps,
+                    unsigned int workers);
@@ -0,0 +1,148 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "source.h"
+#include "util.h"
+
+#define SOURCE_READ_CHUNK   65536
+
+bool source_open(struct source* source, const char* path)
+{
+    memset(source, 0, sizeof(*source));
+    source->buffer = "";
+    if (strcmp(path, "-") == 0)
+        return source_read(source, stdin);
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, NULL);
+    LARGE_INTEGER size;
+    if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &size))
+    {
+        fprintf(stderr, "Could not read file \"%s\": error %lu\n", path, GetLastError());
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+        return false;
+    }
+
+    // Empty files cannot be mapped, but they don't need to be anyway.
+    if (size.QuadPart > 0)
+    {
+        HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        source->mapping = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+        if (mapping)
+            CloseHandle(mapping);
+        if (!source->mapping)
+        {
+            fprintf(stderr, "Could not map file \"%s\": error %lu\n", path, GetLastError());
+            CloseHandle(file);
+            return false;
+        }
+        source->buffer = (const char*)source->mapping;
+        source->length = (size_t)size.QuadPart;
+    }
+    CloseHandle(file);
+#else
+    int fd = open(path, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0)
+    {
+        fprintf(stderr, "Could not read file \"%s\": %s\n", path, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return false;
+    }
+
+    // Pipes and other special files have no size to map, so read those instead.
+    if (!S_ISREG(info.st_mode))
+    {
+        FILE* stream = fdopen(fd, "r");
+        bool result = stream && source_read(source, stream);
+        if (stream)
+            fclose(stream);
+        else
+            close(fd);
+        return result;
+    }
+
+    // Empty files cannot be mapped, but they don't need to be anyway.
+    if (info.st_size > 0)
+    {
+        void* mapping = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED)
+        {
+            fprintf(stderr, "Could not map file \"%s\": %s\n", path, strerror(errno));
+            close(fd);
+            return false;
+        }
+        source->mapping = mapping;
+        source->buffer = (const char*)mapping;
+        source->length = (size_t)info.st_size;
+    }
+    close(fd);
+#endif
+    return true;
+}
+
+bool source_read(struct source* source, FILE* stream)
+{
+    memset(source, 0, sizeof(*source));
+    size_t capacity = SOURCE_READ_CHUNK;
+    size_t length = 0;
+    char* heap = (char*)quick_malloc(capacity + 1);
+    for (;;)
+    {
+        size_t count = fread(heap + length, 1, capacity - length, stream);
+        length += count;
+        if (length < capacity)
+            break;
+
+        capacity *= 2;
+        heap = (char*)quick_realloc(heap, capacity + 1);
+    }
+
+    if (ferror(stream))
+    {
+        fprintf(stderr, "Could not read stream: %s\n", strerror(errno));
+        free(heap);
+        source->buffer = "";
+        return false;
+    }
+
+    heap[length] = '\0';
+    source->heap = heap;
+    source->buffer = heap;
+    source->length = length;
+    return true;
+}
+
+void source_close(struct source* source)
+{
+    if (source->mapping)
+    {
+#ifdef _WIN32
+        UnmapViewOfFile(source->mapping);
+#else
+        munmap(source->mapping, source->length);
+#endif
+    }
+    free(source->heap);
+    memset(source, 0, sizeof(*source));
+    source->buffer = "";
+}
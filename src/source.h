@@ -0,0 +1,29 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// The text of a source (or any other input) file. Files are memory-mapped so that their
+// contents can be handed straight to lmc_assemble() without being copied, while streams
+// such as pipes are read into a heap buffer as they arrive.
+struct source
+{
+    const char* buffer;
+    size_t length;
+
+    void* mapping;          // The mapped view of the file, if it was mapped.
+    char* heap;             // The buffer the stream was read into, if it was read.
+};
+
+// Map a file into memory. A path of "-" reads stdin instead.
+bool source_open(struct source* source, const char* path);
+
+// Read a stream until its end. Unlike mapped files, the buffer is always NUL-terminated.
+bool source_read(struct source* source, FILE* stream);
+
+// Release whatever holds the source's text.
+void source_close(struct source* source);
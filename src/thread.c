@@ -0,0 +1,247 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "thread.h"
+#include "util.h"
+
+struct thread_start
+{
+    void (*entry)(void* arg);
+    void* arg;
+};
+
+#ifdef _WIN32
+
+static DWORD WINAPI thread_trampoline(LPVOID param)
+{
+    struct thread_start start = *(struct thread_start*)param;
+    free(param);
+    start.entry(start.arg);
+    return 0;
+}
+
+bool thread_create(thread_t* thread, void (*entry)(void* arg), void* arg)
+{
+    struct thread_start* start = (struct thread_start*)quick_malloc(sizeof(struct thread_start));
+    start->entry = entry;
+    start->arg = arg;
+    *thread = CreateThread(NULL, 0, thread_trampoline, start, 0, NULL);
+    if (*thread == NULL)
+    {
+        free(start);
+        return false;
+    }
+    return true;
+}
+
+void thread_join(thread_t thread)
+{
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+
+void thread_detach(thread_t thread)
+{
+    CloseHandle(thread);
+}
+
+unsigned int thread_hardware_concurrency(void)
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return max(1, info.dwNumberOfProcessors);
+}
+
+void mutex_init(mutex_t* mutex)     { InitializeCriticalSection(mutex); }
+void mutex_destroy(mutex_t* mutex)  { DeleteCriticalSection(mutex); }
+void mutex_lock(mutex_t* mutex)     { EnterCriticalSection(mutex); }
+void mutex_unlock(mutex_t* mutex)   { LeaveCriticalSection(mutex); }
+
+void cond_init(cond_t* cond)                    { InitializeConditionVariable(cond); }
+void cond_destroy(cond_t* cond)                 { (void)cond; }
+void cond_wait(cond_t* cond, mutex_t* mutex)    { SleepConditionVariableCS(cond, mutex, INFINITE); }
+void cond_signal(cond_t* cond)                  { WakeConditionVariable(cond); }
+void cond_broadcast(cond_t* cond)               { WakeAllConditionVariable(cond); }
+
+#else
+
+static void* thread_trampoline(void* param)
+{
+    struct thread_start start = *(struct thread_start*)param;
+    free(param);
+    start.entry(start.arg);
+    return NULL;
+}
+
+bool thread_create(thread_t* thread, void (*entry)(void* arg), void* arg)
+{
+    struct thread_start* start = (struct thread_start*)quick_malloc(sizeof(struct thread_start));
+    start->entry = entry;
+    start->arg = arg;
+    if (pthread_create(thread, NULL, thread_trampoline, start) != 0)
+    {
+        free(start);
+        return false;
+    }
+    return true;
+}
+
+void thread_join(thread_t thread)
+{
+    pthread_join(thread, NULL);
+}
+
+void thread_detach(thread_t thread)
+{
+    pthread_detach(thread);
+}
+
+unsigned int thread_hardware_concurrency(void)
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return (count > 0) ? (unsigned int)count : 1;
+}
+
+void mutex_init(mutex_t* mutex)     { pthread_mutex_init(mutex, NULL); }
+void mutex_destroy(mutex_t* mutex)  { pthread_mutex_destroy(mutex); }
+void mutex_lock(mutex_t* mutex)     { pthread_mutex_lock(mutex); }
+void mutex_unlock(mutex_t* mutex)   { pthread_mutex_unlock(mutex); }
+
+void cond_init(cond_t* cond)                    { pthread_cond_init(cond, NULL); }
+void cond_destroy(cond_t* cond)                 { pthread_cond_destroy(cond); }
+void cond_wait(cond_t* cond, mutex_t* mutex)    { pthread_cond_wait(cond, mutex); }
+void cond_signal(cond_t* cond)                  { pthread_cond_signal(cond); }
+void cond_broadcast(cond_t* cond)               { pthread_cond_broadcast(cond); }
+
+#endif
+
+// A worker's share of the task indices, [begin, end). The owner takes from the front and
+// thieves take from the back.
+struct pool_queue
+{
+    mutex_t lock;
+    size_t begin;
+    size_t end;
+};
+
+struct pool_worker
+{
+    struct pool_queue* queues;
+    unsigned int index;
+    unsigned int count;
+    void (*task)(void* context, size_t index, unsigned int worker);
+    void* context;
+};
+
+static bool pool_take(struct pool_queue* queue, bool steal, size_t* index)
+{
+    bool found = false;
+    mutex_lock(&queue->lock);
+    if (queue->begin < queue->end)
+    {
+        *index = (steal) ? --queue->end : queue->begin++;
+        found = true;
+    }
+    mutex_unlock(&queue->lock);
+    return found;
+}
+
+static void pool_worker_main(void* arg)
+{
+    struct pool_worker* worker = (struct pool_worker*)arg;
+    size_t index;
+    for (;;)
+    {
+        if (pool_take(&worker->queues[worker->index], false, &index))
+        {
+            worker->task(worker->context, index, worker->index);
+            continue;
+        }
+
+        // Out of work, so try to steal some from the other workers. Nothing is ever
+        // added to the queues, so once every one of them is empty this worker is done.
+        bool stolen = false;
+        for (unsigned int i = 1; i < worker->count && !stolen; ++i)
+            stolen = pool_take(&worker->queues[(worker->index + i) % worker->count], true, &index);
+        if (!stolen)
+            return;
+        worker->task(worker->context, index, worker->index);
+    }
+}
+
+unsigned int thread_pool_size(size_t count, unsigned int workers)
+{
+    if (workers == 0)
+        workers = thread_hardware_concurrency();
+    if (workers > count)
+        workers = (count > 0) ? (unsigned int)count : 1;
+    return workers;
+}
+
+// Tasks that do not care which worker runs them.
+struct pool_plain
+{
+    void (*task)(void* context, size_t index);
+    void* context;
+};
+
+static void pool_plain_task(void* context, size_t index, unsigned int worker)
+{
+    (void)worker;
+    struct pool_plain* plain = (struct pool_plain*)context;
+    plain->task(plain->context, index);
+}
+
+void thread_pool_run(size_t count, unsigned int workers,
+                     void (*task)(void* context, size_t index), void* context)
+{
+    struct pool_plain plain = { task, context };
+    thread_pool_run_indexed(count, workers, pool_plain_task, &plain);
+}
+
+void thread_pool_run_indexed(size_t count, unsigned int workers,
+                             void (*task)(void* context, size_t index, unsigned int worker),
+                             void* context)
+{
+    workers = thread_pool_size(count, workers);
+
+    struct pool_queue* queues = (struct pool_queue*)quick_calloc(workers, sizeof(struct pool_queue));
+    struct pool_worker* state = (struct pool_worker*)quick_calloc(workers, sizeof(struct pool_worker));
+    thread_t* threads = (thread_t*)quick_calloc(workers, sizeof(thread_t));
+    for (unsigned int i = 0; i < workers; ++i)
+    {
+        mutex_init(&queues[i].lock);
+        queues[i].begin = count * i / workers;
+        queues[i].end = count * (i + 1) / workers;
+        state[i].queues = queues;
+        state[i].index = i;
+        state[i].count = workers;
+        state[i].task = task;
+        state[i].context = context;
+    }
+
+    // The calling thread doubles as the first worker.
+    unsigned int spawned = 1;
+    for (; spawned < workers; ++spawned)
+    {
+        if (!thread_create(&threads[spawned], pool_worker_main, &state[spawned]))
+            break;
+    }
+    pool_worker_main(&state[0]);
+    for (unsigned int i = 1; i < spawned; ++i)
+        thread_join(threads[i]);
+
+    for (unsigned int i = 0; i < workers; ++i)
+        mutex_destroy(&queues[i].lock);
+    free(threads);
+    free(state);
+    free(queues);
+}
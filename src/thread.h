@@ -0,0 +1,53 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+typedef HANDLE thread_t;
+typedef CRITICAL_SECTION mutex_t;
+typedef CONDITION_VARIABLE cond_t;
+#else
+#include <pthread.h>
+typedef pthread_t thread_t;
+typedef pthread_mutex_t mutex_t;
+typedef pthread_cond_t cond_t;
+#endif
+
+// Thin wrappers around the native threading primitives.
+bool thread_create(thread_t* thread, void (*entry)(void* arg), void* arg);
+void thread_join(thread_t thread);
+void thread_detach(thread_t thread);
+unsigned int thread_hardware_concurrency(void);
+
+void mutex_init(mutex_t* mutex);
+void mutex_destroy(mutex_t* mutex);
+void mutex_lock(mutex_t* mutex);
+void mutex_unlock(mutex_t* mutex);
+
+void cond_init(cond_t* cond);
+void cond_destroy(cond_t* cond);
+void cond_wait(cond_t* cond, mutex_t* mutex);
+void cond_signal(cond_t* cond);
+void cond_broadcast(cond_t* cond);
+
+// Run task(context, index) for every index in [0, count) on a pool of worker threads
+// (or one per hardware thread if workers is 0), and return once every task has finished.
+// Each worker starts off with an even share of the indices, and steals from the back of
+// the other workers' shares once its own share runs out, so uneven tasks still balance.
+void thread_pool_run(size_t count, unsigned int workers,
+                     void (*task)(void* context, size_t index), void* context);
+
+// How many workers thread_pool_run() would use for count tasks.
+unsigned int thread_pool_size(size_t count, unsigned int workers);
+
+// The same as thread_pool_run(), but also telling each task which worker is running it, from
+// 0 up to thread_pool_size(), so that each worker can keep scratch memory of its own.
+void thread_pool_run_indexed(size_t count, unsigned int workers,
+                             void (*task)(void* context, size_t index, unsigned int worker),
+                             void* context);
@@ -0,0 +1,60 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "io.h"
+#include "lmc.h"
+#include "lmc_internal.h"
+#include "util.h"
+
+#if defined(__GNUC__)
+
+// A directly threaded mailbox: the address of the code implementing the opcode, plus
+// its operand.
+struct threaded_insn
+{
+    const void* handler;
+    unsigned char ar;
+};
+
+#define THREADED_NAME execute_threaded_guarded_unlimited
+#define THREADED_LIMITED false
+#define THREADED_IMMUTABLE false
+#include "threaded_loop.h"
+
+#define THREADED_NAME execute_threaded_guarded_limited
+#define THREADED_LIMITED true
+#define THREADED_IMMUTABLE false
+#include "threaded_loop.h"
+
+#define THREADED_NAME execute_threaded_immutable_unlimited
+#define THREADED_LIMITED false
+#define THREADED_IMMUTABLE true
+#include "threaded_loop.h"
+
+#define THREADED_NAME execute_threaded_immutable_limited
+#define THREADED_LIMITED true
+#define THREADED_IMMUTABLE true
+#include "threaded_loop.h"
+
+
+bool lmc_execute_threaded(struct mailboxes* mailboxes, struct lmc_exec* exec,
+                          const struct lmc_regs* start)
+{
+    return LMC_ENGINE_GUARDED_RUN(execute_threaded, mailboxes, exec, start);
+}
+
+#else
+
+// Labels-as-values are a GCC/Clang extension, so fall back to the portable switch loop of
+// the decoded engine everywhere else (i.e. MSVC).
+bool lmc_execute_threaded(struct mailboxes* mailboxes, struct lmc_exec* exec,
+                          const struct lmc_regs* start)
+{
+    return lmc_execute_decoded(mailboxes, exec, start);
+}
+
+#endif
@@ -0,0 +1,126 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+// The threaded engine's loop. This file is included by threaded.c once per variant, with
+// THREADED_NAME naming the function to define, THREADED_LIMITED saying whether it enforces
+// the step limit, and THREADED_IMMUTABLE saying whether it can leave out the checks for
+// self-modifying code.
+
+// Execute an assembled LMC program with direct threading. This is the same as the
+// decoded engine, except every record holds the address of its handler (using the GCC
+// labels-as-values extension) and every handler ends with its own indirect jump. This
+// gives the branch predictor one jump per opcode to learn from, rather than the single
+// shared jump that a switch compiles down to.
+//
+// GCC will not inline a function containing a computed goto, so rather than being a
+// force-inlined loop like the other engines, the loop lives in threaded_loop.h and is
+// included once per variant.
+static bool THREADED_NAME(struct mailboxes* mailboxes, struct lmc_exec* exec,
+                          const struct lmc_regs* start)
+{
+    const bool limited = THREADED_LIMITED;
+    const bool immutable = THREADED_IMMUTABLE;
+    static const void* const handlers[] =
+    {
+        [HLT] = &&op_hlt,
+        [ADD] = &&op_add,
+        [SUB] = &&op_sub,
+        [STA] = &&op_sta,
+        [DAT] = &&op_bad,
+        [LDA] = &&op_lda,
+        [BRA] = &&op_bra,
+        [BRZ] = &&op_brz,
+        [BRP] = &&op_brp,
+        [INP] = &&op_inp,
+        [OUT] = &&op_out,
+        [OP_COUNT] = &&op_bad,
+        [OP_NULL] = &&op_stale,
+    };
+
+    struct threaded_insn code[NUM_MAILBOXES];
+    for (int i = 0; i < NUM_MAILBOXES; ++i)
+    {
+        struct lmc_insn insn = lmc_decode(mailboxes->pool[i]);
+        code[i].handler = handlers[insn.op];
+        code[i].ar = insn.ar;
+    }
+
+    // LMC registers. See lmc_execute() for why there is a negative flag.
+    unsigned char pc = start->pc;
+    unsigned char at = 0;
+    short acc = start->acc;
+    bool negative = start->negative;
+    unsigned long long steps = start->steps;
+
+    // Fetch the threaded opcode from the current mailbox and jump straight to it.
+#define DISPATCH()                                                  \
+    do                                                              \
+    {                                                               \
+        if (limited && steps == exec->max_steps)                    \
+            return lmc_fail_step_limit(mailboxes, exec);            \
+        steps++;                                                    \
+        at = pc;                                                    \
+        pc = (at == NUM_MAILBOXES - 1) ? 0 : at + 1;                \
+        goto *code[at].handler;                                     \
+    } while (0)
+
+    DISPATCH();
+
+op_hlt:
+    return lmc_halt(exec, steps);
+op_add:
+    negative = false;
+    acc = (acc + mailboxes->pool[code[at].ar]) % 1000;
+    DISPATCH();
+op_sub:
+    negative = (acc < mailboxes->pool[code[at].ar]);
+    acc = (acc - mailboxes->pool[code[at].ar]) % 1000;
+    DISPATCH();
+op_sta:
+    mailboxes->pool[code[at].ar] = acc;
+    if (!immutable)
+        code[code[at].ar].handler = &&op_stale;
+    DISPATCH();
+op_lda:
+    negative = false;
+    acc = mailboxes->pool[code[at].ar];
+    DISPATCH();
+op_bra:
+    pc = code[at].ar;
+    DISPATCH();
+op_brz:
+    if (acc == 0)
+        pc = code[at].ar;
+    DISPATCH();
+op_brp:
+    if (!negative)
+        pc = code[at].ar;
+    DISPATCH();
+op_inp:
+    if (lmc_input_blocked(exec))
+        return lmc_suspend(exec, at, acc, negative, steps - 1);
+    lmc_io_read(exec->io, &acc, &negative);
+    DISPATCH();
+op_out:
+    if (!lmc_io_write(exec->io, acc))
+        return lmc_mismatch(mailboxes, exec, steps);
+    DISPATCH();
+op_stale:
+    {
+        // The mailbox has been overwritten since it was threaded, so decode it again
+        // and retry.
+        struct lmc_insn insn = lmc_decode(mailboxes->pool[at]);
+        code[at].handler = handlers[insn.op];
+        code[at].ar = insn.ar;
+    }
+    goto *code[at].handler;
+op_bad:
+    return lmc_fail_opcode(mailboxes, exec, steps, lmc_decode_ir(mailboxes->pool[at]));
+
+#undef DISPATCH
+}
+
+#undef THREADED_NAME
+#undef THREADED_LIMITED
+#undef THREADED_IMMUTABLE
+
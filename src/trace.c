@@ -0,0 +1,355 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lmc.h"
+#include "lmc_internal.h"
+#include "thread.h"
+#include "trace.h"
+#include "util.h"
+
+static const unsigned char trace_magic[4] = { 0x7F, 'L', 'M', 'T' };
+
+// Write each segment out as it fills up, until the trace is closed and every segment has
+// been written.
+static void trace_writer_main(void* arg)
+{
+    struct lmc_trace* trace = (struct lmc_trace*)arg;
+    size_t next = 0;
+    mutex_lock(&trace->lock);
+    for (;;)
+    {
+        struct lmc_trace_segment* segment = &trace->segments[next];
+        while (!segment->full && !trace->closing)
+            cond_wait(&trace->filled, &trace->lock);
+        if (!segment->full)
+            break;
+
+        mutex_unlock(&trace->lock);
+        bool written = (fwrite(segment->data, 1, segment->length, trace->file) == segment->length);
+        mutex_lock(&trace->lock);
+        trace->failed |= !written;
+        segment->full = false;
+        next = (next + 1) % LMC_TRACE_SEGMENTS;
+        cond_signal(&trace->drained);
+    }
+    mutex_unlock(&trace->lock);
+}
+
+static void trace_start_segment(struct lmc_trace* trace)
+{
+    trace->cursor = trace->segments[trace->current].data;
+    trace->limit = trace->cursor + LMC_TRACE_SEGMENT_SIZE - LMC_TRACE_MAX_STEP;
+}
+
+// Start tracing runs to a file, which must stay open until the trace is closed.
+struct lmc_trace* lmc_trace_open(FILE* file)
+{
+    unsigned char header[LMC_TRACE_HEADER_SIZE];
+    memcpy(header, trace_magic, sizeof(trace_magic));
+    util_store_le16(&header[4], LMC_TRACE_VERSION);
+    if (fwrite(header, 1, sizeof(header), file) != sizeof(header))
+        return NULL;
+
+    struct lmc_trace* trace = (struct lmc_trace*)quick_malloc(sizeof(struct lmc_trace));
+    trace->file = file;
+    mutex_init(&trace->lock);
+    cond_init(&trace->filled);
+    cond_init(&trace->drained);
+    trace_start_segment(trace);
+    if (!thread_create(&trace->writer, trace_writer_main, trace))
+    {
+        cond_destroy(&trace->drained);
+        cond_destroy(&trace->filled);
+        mutex_destroy(&trace->lock);
+        free(trace);
+        return NULL;
+    }
+    return trace;
+}
+
+// Write out everything recorded so far and stop tracing.
+bool lmc_trace_close(struct lmc_trace* trace)
+{
+    if (trace->cursor != trace->segments[trace->current].data)
+        lmc_trace_rotate(trace);
+
+    mutex_lock(&trace->lock);
+    trace->closing = true;
+    cond_signal(&trace->filled);
+    mutex_unlock(&trace->lock);
+    thread_join(trace->writer);
+
+    bool result = !trace->failed && fflush(trace->file) == 0;
+    cond_destroy(&trace->drained);
+    cond_destroy(&trace->filled);
+    mutex_destroy(&trace->lock);
+    free(trace);
+    return result;
+}
+
+// Hand the current segment to the writer and move on to the next one, waiting for the writer
+// to finish with it if the ring has gone all the way round.
+void lmc_trace_rotate(struct lmc_trace* trace)
+{
+    struct lmc_trace_segment* segment = &trace->segments[trace->current];
+    segment->length = trace->cursor - segment->data;
+
+    mutex_lock(&trace->lock);
+    segment->full = true;
+    cond_signal(&trace->filled);
+    trace->current = (trace->current + 1) % LMC_TRACE_SEGMENTS;
+    while (trace->segments[trace->current].full)
+        cond_wait(&trace->drained, &trace->lock);
+    mutex_unlock(&trace->lock);
+    trace_start_segment(trace);
+}
+
+// Make room for a record of up to length bytes.
+static unsigned char* trace_reserve(struct lmc_trace* trace, size_t length)
+{
+    if (trace->cursor + length > trace->segments[trace->current].data + LMC_TRACE_SEGMENT_SIZE)
+        lmc_trace_rotate(trace);
+    return trace->cursor;
+}
+
+// Record the start of a traced run.
+void lmc_trace_begin(struct lmc_trace* trace, const struct mailboxes* mailboxes,
+                     const struct lmc_regs* start, enum lmc_arith arith)
+{
+    unsigned char* out = trace_reserve(trace, 1 + NUM_MAILBOXES * 2 + 13);
+    *out++ = LMC_TRACE_BEGIN;
+    for (int i = 0; i < NUM_MAILBOXES; ++i, out += 2)
+        util_store_le16(out, (unsigned short)mailboxes->pool[i]);
+    *out++ = start->pc;
+    util_store_le16(out, (unsigned short)start->acc);
+    out += 2;
+    *out++ = start->negative;
+    util_store_le64(out, start->steps);
+    out += 8;
+    *out++ = (unsigned char)arith;
+    trace->cursor = out;
+    trace->next_pc = start->pc;
+}
+
+// Record the end of a traced run.
+void lmc_trace_end(struct lmc_trace* trace, const struct lmc_exec* exec)
+{
+    unsigned char* out = trace_reserve(trace, 2 + 10);
+    *out++ = LMC_TRACE_END;
+    *out++ = (unsigned char)exec->status;
+    unsigned long long value = exec->steps;
+    while (value >= 0x80)
+    {
+        *out++ = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (unsigned char)value;
+    trace->cursor = out;
+}
+
+// Read a variable-length integer from a trace, returning false at the end of the file.
+static bool replay_varint(FILE* file, unsigned long long* value)
+{
+    *value = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        int c = fgetc(file);
+        if (c == EOF)
+            return false;
+        *value |= (unsigned long long)(c & 0x7F) << shift;
+        if (!(c & 0x80))
+            return true;
+    }
+    return false;
+}
+
+static bool replay_read(FILE* file, void* data, size_t length)
+{
+    return fread(data, 1, length, file) == length;
+}
+
+// Re-execute every run in a trace, checking each instruction against what was recorded.
+bool lmc_trace_replay(FILE* file, FILE* report)
+{
+    unsigned char header[LMC_TRACE_HEADER_SIZE];
+    if (!replay_read(file, header, sizeof(header)) ||
+        memcmp(header, trace_magic, sizeof(trace_magic)) != 0)
+    {
+        fputs("Not a trace file\n", report);
+        return false;
+    }
+    if (util_load_le16(&header[4]) != LMC_TRACE_VERSION)
+    {
+        fprintf(report, "Unsupported trace version %u\n", util_load_le16(&header[4]));
+        return false;
+    }
+
+    unsigned long long runs = 0;
+    unsigned long long instructions = 0;
+    int c;
+    while ((c = fgetc(file)) != EOF)
+    {
+        unsigned char begin[NUM_MAILBOXES * 2 + 13];
+        if (c != LMC_TRACE_BEGIN || !replay_read(file, begin, sizeof(begin)))
+        {
+            fprintf(report, "Trace is corrupt after run %llu\n", runs);
+            return false;
+        }
+        runs++;
+
+        short pool[NUM_MAILBOXES];
+        for (int i = 0; i < NUM_MAILBOXES; ++i)
+            pool[i] = (short)util_load_le16(&begin[i * 2]);
+        unsigned char* regs = &begin[NUM_MAILBOXES * 2];
+        unsigned char pc = regs[0];
+        short acc = (short)util_load_le16(&regs[1]);
+        bool negative = regs[3] != 0;
+        unsigned long long steps = util_load_le64(&regs[4]);
+        enum lmc_arith arith = (enum lmc_arith)regs[12];
+        if (arith >= LMC_ARITH_COUNT)
+        {
+            fprintf(report, "Run %llu uses unknown accumulator convention %d\n", runs, arith);
+            return false;
+        }
+        int last_op = OP_NULL;
+
+        // Step through the run until its end record.
+        const char* problem = NULL;
+        unsigned char at = pc;
+        for (;;)
+        {
+            at = pc;
+            c = fgetc(file);
+            if (c == EOF)
+            {
+                fprintf(report, "Trace ends part way through run %llu, after %llu instructions\n",
+                        runs, steps);
+                return false;
+            }
+            if (c == LMC_TRACE_END)
+                break;
+            if (last_op == HLT || last_op == LMC_TRACE_BAD_OPCODE)
+            {
+                problem = "the run carries on after it ended";
+                goto diverged;
+            }
+
+            // Pull in the rest of the record.
+            int c_pc = (c & LMC_TRACE_JUMP) ? fgetc(file) : pc;
+            unsigned long long zigzag = 0;
+            if (c_pc == EOF || ((c & LMC_TRACE_DELTA) && !replay_varint(file, &zigzag)))
+            {
+                fprintf(report, "Trace ends part way through run %llu, after %llu instructions\n",
+                        runs, steps);
+                return false;
+            }
+            unsigned char recorded_pc = (unsigned char)c_pc;
+            int delta = (int)(zigzag >> 1) ^ -(int)(zigzag & 1);
+            int op = c & LMC_TRACE_OP_MASK;
+            bool recorded_negative = (c & LMC_TRACE_NEGATIVE) != 0;
+            bool recorded_taken = (c & LMC_TRACE_TAKEN) != 0;
+
+            if (recorded_pc != pc)
+            {
+                problem = "it executed a different mailbox";
+                goto diverged;
+            }
+            struct lmc_insn insn = lmc_decode(pool[pc]);
+            if (insn.op == DAT)
+                insn.op = LMC_TRACE_BAD_OPCODE;
+            if (op != insn.op)
+            {
+                problem = "it executed a different opcode";
+                goto diverged;
+            }
+
+            // Execute the instruction the same way as the reference interpreter.
+            last_op = op;
+            short before = acc;
+            bool taken = false;
+            pc = (pc + 1) % NUM_MAILBOXES;
+            switch (insn.op)
+            {
+                case ADD:
+                    lmc_arith_add(arith, &acc, &negative, pool[insn.ar]);
+                    break;
+                case SUB:
+                    lmc_arith_sub(arith, &acc, &negative, pool[insn.ar]);
+                    break;
+                case STA:
+                    pool[insn.ar] = acc;
+                    break;
+                case LDA:
+                    negative = false;
+                    acc = pool[insn.ar];
+                    break;
+                case BRA:
+                    taken = true;
+                    break;
+                case BRZ:
+                    taken = (acc == 0);
+                    break;
+                case BRP:
+                    taken = lmc_arith_positive(arith, acc, negative);
+                    break;
+                case INP:
+                    // The input is whatever the trace says was read.
+                    acc = (short)(acc + delta);
+                    negative = recorded_negative;
+                    break;
+                default:
+                    break;
+            }
+            if (taken)
+                pc = insn.ar;
+
+            if ((short)(before + delta) != acc)
+                problem = "the accumulator differs";
+            else if (recorded_negative != negative)
+                problem = "the negative flag differs";
+            else if (recorded_taken != taken)
+                problem = "a branch went the other way";
+            if (problem)
+                goto diverged;
+            steps++;
+            instructions++;
+        }
+
+        // Check that the run ended the way it should have.
+        unsigned long long recorded_steps;
+        int status = fgetc(file);
+        if (status == EOF || !replay_varint(file, &recorded_steps))
+        {
+            fprintf(report, "Trace ends part way through run %llu, after %llu instructions\n",
+                    runs, steps);
+            return false;
+        }
+        bool ended = (status == LMC_STATUS_HALTED && last_op == HLT) ||
+                     (status == LMC_STATUS_ERROR && last_op == LMC_TRACE_BAD_OPCODE) ||
+                     (status == LMC_STATUS_INPUT && lmc_decode(pool[pc]).op == INP) ||
+                     (status == LMC_STATUS_MISMATCH && last_op == OUT) ||
+                     (status == LMC_STATUS_STEP_LIMIT && last_op != HLT &&
+                      last_op != LMC_TRACE_BAD_OPCODE);
+        if (!ended || recorded_steps != steps)
+        {
+            fprintf(report, "Run %llu ended with status %d after %llu instructions, which does not "
+                    "match the %llu instructions replayed\n", runs, status, recorded_steps, steps);
+            return false;
+        }
+        continue;
+
+    diverged:
+        fprintf(report, "Run %llu diverges at instruction %llu (mailbox %d): %s\n", runs,
+                steps + 1, at, problem);
+        return false;
+    }
+
+    fprintf(report, "%llu runs and %llu instructions replayed, all of which match the trace\n",
+            runs, instructions);
+    return true;
+}
@@ -0,0 +1,118 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "lmc.h"
+#include "lmc_internal.h"
+#include "thread.h"
+
+// A trace file starts with the magic "\x7FLMT" and a 16-bit format version
+// (LMC_TRACE_VERSION), followed by any number of runs. Each run is:
+//
+//   - A begin record: the byte LMC_TRACE_BEGIN, the mailboxes as 16-bit values, and the pc
+//     (1 byte), accumulator (2), negative flag (1) and step count (8) the run started from,
+//     and the run's accumulator convention (1, an enum lmc_arith).
+//   - A step record for every instruction executed. The first byte holds the opcode in its
+//     low four bits (LMC_TRACE_BAD_OPCODE for a mailbox that does not hold one, which ends the
+//     run) along with the flags below. If LMC_TRACE_JUMP is set, the pc of the instruction
+//     follows as one byte; otherwise it is where the previous instruction went on to (the
+//     target of a branch that was taken, or else the next mailbox), or the start of the run. If
+//     LMC_TRACE_DELTA is set, the change the instruction made to the accumulator follows as
+//     a zigzag-encoded variable-length integer. The value read by INP is the accumulator and
+//     negative flag it leaves behind, and the value written by OUT is the accumulator.
+//   - An end record: the byte LMC_TRACE_END, the run's status (1 byte), and the number of
+//     instructions it had executed as a variable-length integer.
+//
+// Most instructions therefore take up a single byte. All numbers are little-endian, and
+// variable-length integers hold 7 bits per byte, with the top bit set on all but the last.
+#define LMC_TRACE_VERSION       2
+#define LMC_TRACE_HEADER_SIZE   6
+
+#define LMC_TRACE_OP_MASK       0x0F
+#define LMC_TRACE_JUMP          0x10    // The pc follows.
+#define LMC_TRACE_DELTA         0x20    // The change to the accumulator follows.
+#define LMC_TRACE_NEGATIVE      0x40    // The negative flag was set afterwards.
+#define LMC_TRACE_TAKEN         0x80    // The instruction was a branch that was taken.
+
+#define LMC_TRACE_BAD_OPCODE    OP_COUNT
+#define LMC_TRACE_BEGIN         0x0C
+#define LMC_TRACE_END           0x0D
+
+// The most a step record can take up.
+#define LMC_TRACE_MAX_STEP      8
+
+// Records go into a ring of segments. The run fills one segment at a time without taking
+// any locks, and each full segment is handed to the trace's writer thread, so the run only
+// ever waits on the file if it gets a whole ring ahead of it.
+#define LMC_TRACE_SEGMENT_SIZE  65536
+#define LMC_TRACE_SEGMENTS      8
+
+struct lmc_trace_segment
+{
+    size_t length;
+    bool full;
+    unsigned char data[LMC_TRACE_SEGMENT_SIZE];
+};
+
+struct lmc_trace
+{
+    // Only touched by the thread being traced.
+    unsigned char* cursor;
+    unsigned char* limit;       // Where the current segment runs out of room for a step.
+    size_t current;
+    unsigned char next_pc;      // The pc that a step record can leave out.
+
+    // Shared with the writer thread, under the lock.
+    FILE* file;
+    thread_t writer;
+    mutex_t lock;
+    cond_t filled;
+    cond_t drained;
+    bool closing;
+    bool failed;
+
+    struct lmc_trace_segment segments[LMC_TRACE_SEGMENTS];
+};
+
+// Hand the current segment to the writer and move on to the next one.
+void lmc_trace_rotate(struct lmc_trace* trace);
+
+// Record the start and end of a traced run.
+void lmc_trace_begin(struct lmc_trace* trace, const struct mailboxes* mailboxes,
+                     const struct lmc_regs* start, enum lmc_arith arith);
+void lmc_trace_end(struct lmc_trace* trace, const struct lmc_exec* exec);
+
+// Record an instruction executed at pc, which changed the accumulator by delta and went on to
+// the instruction at next.
+static inline void lmc_trace_step(struct lmc_trace* trace, unsigned char pc, unsigned char next,
+                                  int op, int delta, bool negative, bool taken)
+{
+    if (trace->cursor >= trace->limit)
+        lmc_trace_rotate(trace);
+
+    unsigned char* out = trace->cursor;
+    unsigned char* head = out++;
+    *head = (unsigned char)(op | (negative ? LMC_TRACE_NEGATIVE : 0) | (taken ? LMC_TRACE_TAKEN : 0));
+    if (pc != trace->next_pc)
+    {
+        *head |= LMC_TRACE_JUMP;
+        *out++ = pc;
+    }
+    if (delta)
+    {
+        *head |= LMC_TRACE_DELTA;
+        unsigned int value = ((unsigned int)delta << 1) ^ (unsigned int)(delta >> 31);
+        while (value >= 0x80)
+        {
+            *out++ = (unsigned char)(value | 0x80);
+            value >>= 7;
+        }
+        *out++ = (unsigned char)value;
+    }
+    trace->next_pc = next;
+    trace->cursor = out;
+}
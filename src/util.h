@@ -3,10 +3,53 @@
 
 #pragma once
 
+#include <stdio.h>
+#include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
 #include <ctype.h>
 
-inline void* quick_calloc(size_t count, size_t size)
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// The code base is written against the MSVC CRT. Provide the bits of it that are used here
+// when building with anything else.
+#ifndef _MSC_VER
+typedef int errno_t;
+
+#ifndef min
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+#endif
+#ifndef max
+#define max(a, b) (((a) > (b)) ? (a) : (b))
+#endif
+
+#define sprintf_s snprintf
+
+static inline errno_t fopen_s(FILE** file, const char* path, const char* mode)
+{
+    *file = fopen(path, mode);
+    return (*file) ? 0 : errno;
+}
+
+static inline errno_t strcpy_s(char* dest, size_t size, const char* src)
+{
+    snprintf(dest, size, "%s", src);
+    return 0;
+}
+
+static inline errno_t strncat_s(char* dest, size_t size, const char* src, size_t count)
+{
+    size_t length = strlen(dest);
+    if (length < size)
+        snprintf(dest + length, size - length, "%.*s", (int)count, src);
+    return 0;
+}
+#endif
+
+static inline void* quick_calloc(size_t count, size_t size)
 {
     void* ptr = calloc(count, size);
     if (!ptr)
@@ -14,12 +57,178 @@ inline void* quick_calloc(size_t count, size_t size)
     return ptr;
 }
 
-inline void* quick_malloc(size_t size)
+static inline void* quick_malloc(size_t size)
 {
     return quick_calloc(1, size);
 }
 
-inline int util_strncasecmp(const char* lhs, const char* rhs, size_t length)
+static inline void* quick_realloc(void* ptr, size_t size)
+{
+    ptr = realloc(ptr, size);
+    if (!ptr)
+        abort();
+    return ptr;
+}
+
+// Allocate zeroed memory with a stricter alignment than malloc() gives, which must be freed
+// with util_aligned_free().
+static inline void* util_aligned_alloc(size_t size, size_t alignment)
+{
+    size = (size + alignment - 1) & ~(alignment - 1);
+#ifdef _MSC_VER
+    void* ptr = _aligned_malloc(size, alignment);
+#else
+    void* ptr = aligned_alloc(alignment, size);
+#endif
+    if (!ptr)
+        abort();
+    memset(ptr, 0, size);
+    return ptr;
+}
+
+static inline void util_aligned_free(void* ptr)
+{
+#ifdef _MSC_VER
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+// A bump allocator over a block of memory owned by the caller. Allocations are zeroed like
+// quick_calloc() ones, are never freed individually, and all go away at once when the arena
+// is initialised again, so its memory can be reused any number of times without touching the
+// heap.
+struct util_arena
+{
+    unsigned char* base;
+    size_t capacity;
+    size_t used;
+};
+
+static inline void util_arena_init(struct util_arena* arena, void* storage, size_t capacity)
+{
+    arena->base = (unsigned char*)storage;
+    arena->capacity = capacity;
+    arena->used = 0;
+}
+
+// Returns NULL if the arena does not have enough room left.
+static inline void* util_arena_alloc(struct util_arena* arena, size_t size)
+{
+    size_t offset = (arena->used + sizeof(max_align_t) - 1) & ~(sizeof(max_align_t) - 1);
+    if (offset > arena->capacity || size > arena->capacity - offset)
+        return NULL;
+    arena->used = offset + size;
+    return memset(arena->base + offset, 0, size);
+}
+
+// A pool of fixed-size blocks. Blocks are carved out of chunks that are allocated as the pool
+// grows, and freed blocks go onto a free list to be handed out again, so a pool that has
+// stopped growing never goes to the heap. The chunks are only freed when the whole pool is.
+struct util_pool
+{
+    size_t block_size;
+    size_t chunk_blocks;
+    void* free_list;
+    void* chunks;
+};
+
+static inline void util_pool_init(struct util_pool* pool, size_t block_size, size_t chunk_blocks)
+{
+    // Every block must be able to hold the free list's link, and stay aligned.
+    block_size = max(block_size, sizeof(void*));
+    pool->block_size = (block_size + sizeof(max_align_t) - 1) & ~(sizeof(max_align_t) - 1);
+    pool->chunk_blocks = chunk_blocks;
+    pool->free_list = NULL;
+    pool->chunks = NULL;
+}
+
+// Blocks are not zeroed.
+static inline void* util_pool_alloc(struct util_pool* pool)
+{
+    if (!pool->free_list)
+    {
+        // Each chunk starts with a link to the previous one, padded out to a whole block.
+        unsigned char* chunk = (unsigned char*)quick_malloc(pool->block_size * (pool->chunk_blocks + 1));
+        *(void**)chunk = pool->chunks;
+        pool->chunks = chunk;
+        for (size_t i = pool->chunk_blocks; i > 0; --i)
+        {
+            void* block = chunk + i * pool->block_size;
+            *(void**)block = pool->free_list;
+            pool->free_list = block;
+        }
+    }
+    void* block = pool->free_list;
+    pool->free_list = *(void**)block;
+    return block;
+}
+
+static inline void util_pool_free(struct util_pool* pool, void* block)
+{
+    *(void**)block = pool->free_list;
+    pool->free_list = block;
+}
+
+static inline void util_pool_destroy(struct util_pool* pool)
+{
+    while (pool->chunks)
+    {
+        void* next = *(void**)pool->chunks;
+        free(pool->chunks);
+        pool->chunks = next;
+    }
+    pool->free_list = NULL;
+}
+
+// Little-endian encoding, for file formats and wire protocols.
+static inline void util_store_le16(unsigned char* at, unsigned int value)
+{
+    at[0] = value & 0xFF;
+    at[1] = (value >> 8) & 0xFF;
+}
+
+static inline void util_store_le32(unsigned char* at, unsigned long value)
+{
+    util_store_le16(at, value & 0xFFFF);
+    util_store_le16(at + 2, (value >> 16) & 0xFFFF);
+}
+
+static inline void util_store_le64(unsigned char* at, unsigned long long value)
+{
+    util_store_le32(at, value & 0xFFFFFFFF);
+    util_store_le32(at + 4, (value >> 32) & 0xFFFFFFFF);
+}
+
+static inline unsigned int util_load_le16(const unsigned char* at)
+{
+    return at[0] | (at[1] << 8);
+}
+
+static inline unsigned long util_load_le32(const unsigned char* at)
+{
+    return util_load_le16(at) | ((unsigned long)util_load_le16(at + 2) << 16);
+}
+
+static inline unsigned long long util_load_le64(const unsigned char* at)
+{
+    return util_load_le32(at) | ((unsigned long long)util_load_le32(at + 4) << 32);
+}
+
+// The index of the lowest set bit of a value, which must not be zero.
+static inline unsigned int util_ctz(unsigned int value)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, value);
+    return (unsigned int)index;
+#else
+    return (unsigned int)__builtin_ctz(value);
+#endif
+}
+
+static inline int util_strncasecmp(const char* lhs, const char* rhs, size_t length)
 {
     int lhs_c, rhs_c;
     int count = 0;
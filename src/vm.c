@@ -0,0 +1,388 @@
+// floason (C) 2025
+// Licensed under the MIT License.
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "io.h"
+#include "lmc.h"
+#include "lmc_internal.h"
+#include "lmc_vm.h"
+#include "object.h"
+#include "thread.h"
+#include "util.h"
+
+// Everything a run works on and that a reset puts back: the mailboxes and the registers.
+struct vm_state
+{
+    struct mailboxes mailboxes;
+    struct lmc_regs regs;
+};
+
+// Contexts are laid out so that the state a run works on starts a cache line of its own, with
+// the pristine copy of it that resets come from on the lines after it.
+#define VM_CACHE_LINE       64
+
+struct lmc_vm
+{
+    _Alignas(VM_CACHE_LINE) struct vm_state state;  // The program as it runs.
+    _Alignas(VM_CACHE_LINE) struct vm_state image;  // The program as loaded, with its
+                                                    // registers always zeroed.
+    struct lmc_exec exec;
+    struct lmc_fused fused;         // The fused engine's code, kept between runs.
+    struct lmc_accel accel;         // Scratch space for accelerated runs.
+    bool loaded;                    // Whether the image holds a program.
+    bool ready;                     // Whether the state does, too.
+    bool immutable;                 // What lmc_code_immutable() made of the image.
+    char error[NUM_MAILBOXES * 2];
+
+    // Either memory I/O over the caller's input, or the caller's streams.
+    bool use_streams;
+    const char* input;
+    size_t input_length;
+    FILE* instream;
+    FILE* outstream;
+    struct lmc_io io;
+    char output[LMC_VM_OUTPUT_SIZE];
+
+    // Snapshots are handed out from here, so taking one is as cheap as copying it.
+    struct util_pool snapshots;
+
+    // The next free context in the pool that this one belongs to, if any.
+    struct lmc_vm* next_free;
+
+    // This comes last, so that forking a context can leave it out.
+    struct lmc_assembler assembler;
+};
+
+struct lmc_vm_snapshot
+{
+    short pool[NUM_MAILBOXES];
+    struct lmc_regs regs;
+    bool ready;
+    enum lmc_status status;
+    size_t input_offset;
+};
+
+// Snapshots are allocated this many at a time.
+#define VM_SNAPSHOT_CHUNK   64
+
+// A fixed number of contexts, allocated all at once and handed out from a free list.
+struct lmc_vm_pool
+{
+    struct lmc_vm* contexts;
+    size_t capacity;
+    mutex_t lock;
+    struct lmc_vm* free_list;
+};
+
+static void vm_init(struct lmc_vm* vm, enum lmc_engine engine)
+{
+    memset(vm, 0, sizeof(struct lmc_vm));
+    vm->exec.engine = engine;
+    vm->exec.io = &vm->io;
+    vm->exec.fused = &vm->fused;
+    vm->exec.accel = &vm->accel;
+    vm->input = "";
+    util_pool_init(&vm->snapshots, sizeof(struct lmc_vm_snapshot), VM_SNAPSHOT_CHUNK);
+    lmc_vm_reset(vm);
+}
+
+struct lmc_vm* lmc_vm_create(enum lmc_engine engine)
+{
+    struct lmc_vm* vm = (struct lmc_vm*)util_aligned_alloc(sizeof(struct lmc_vm), _Alignof(struct lmc_vm));
+    vm_init(vm, engine);
+    return vm;
+}
+
+void lmc_vm_destroy(struct lmc_vm* vm)
+{
+    util_pool_destroy(&vm->snapshots);
+    util_aligned_free(vm);
+}
+
+struct lmc_vm_pool* lmc_vm_pool_create(size_t capacity, enum lmc_engine engine)
+{
+    struct lmc_vm_pool* pool = (struct lmc_vm_pool*)quick_malloc(sizeof(struct lmc_vm_pool));
+    pool->contexts = (struct lmc_vm*)util_aligned_alloc(max(capacity, 1) * sizeof(struct lmc_vm),
+                                                        _Alignof(struct lmc_vm));
+    pool->capacity = capacity;
+    mutex_init(&pool->lock);
+    for (size_t i = capacity; i > 0; --i)
+    {
+        struct lmc_vm* vm = &pool->contexts[i - 1];
+        vm_init(vm, engine);
+        vm->next_free = pool->free_list;
+        pool->free_list = vm;
+    }
+    return pool;
+}
+
+void lmc_vm_pool_destroy(struct lmc_vm_pool* pool)
+{
+    for (size_t i = 0; i < pool->capacity; ++i)
+        util_pool_destroy(&pool->contexts[i].snapshots);
+    mutex_destroy(&pool->lock);
+    util_aligned_free(pool->contexts);
+    free(pool);
+}
+
+struct lmc_vm* lmc_vm_pool_acquire(struct lmc_vm_pool* pool)
+{
+    mutex_lock(&pool->lock);
+    struct lmc_vm* vm = pool->free_list;
+    if (vm)
+        pool->free_list = vm->next_free;
+    mutex_unlock(&pool->lock);
+    return vm;
+}
+
+void lmc_vm_pool_release(struct lmc_vm_pool* pool, struct lmc_vm* vm)
+{
+    mutex_lock(&pool->lock);
+    vm->next_free = pool->free_list;
+    pool->free_list = vm;
+    mutex_unlock(&pool->lock);
+}
+
+struct lmc_vm* lmc_vm_fork(const struct lmc_vm* vm)
+{
+    struct lmc_vm* fork = (struct lmc_vm*)util_aligned_alloc(sizeof(struct lmc_vm), _Alignof(struct lmc_vm));
+    memcpy(fork, vm, offsetof(struct lmc_vm, assembler));
+    fork->next_free = NULL;
+    util_pool_init(&fork->snapshots, sizeof(struct lmc_vm_snapshot), VM_SNAPSHOT_CHUNK);
+
+    // The I/O state and suspended registers point into the context they belong to.
+    fork->exec.io = &fork->io;
+    fork->exec.fused = &fork->fused;
+    fork->exec.accel = &fork->accel;
+    if (vm->exec.suspend)
+        fork->exec.suspend = &fork->state.regs;
+    if (vm->use_streams)
+    {
+        fork->io.in_cursor = fork->io.in_storage + (vm->io.in_cursor - vm->io.in_storage);
+        fork->io.in_end = fork->io.in_storage + (vm->io.in_end - vm->io.in_storage);
+        fork->io.out_buffer = fork->io.out_storage;
+    }
+    else
+        fork->io.out_buffer = fork->output;
+    return fork;
+}
+
+bool lmc_vm_load(struct lmc_vm* vm, const char* buffer, size_t length)
+{
+    bool result = lmc_object_is_image(buffer, length)
+                ? lmc_object_read(buffer, length, &vm->image.mailboxes, NULL, NULL)
+                : lmc_assemble_ex(&vm->assembler, buffer, length, &vm->image.mailboxes);
+    vm->loaded = result;
+    vm->immutable = result && lmc_code_immutable(&vm->image.mailboxes);
+    if (!result)
+    {
+        // Without a program, the image is left empty for resets to copy.
+        strcpy_s(vm->error, sizeof(vm->error), vm->image.mailboxes.error_msg);
+        memset(vm->image.mailboxes.pool, 0, sizeof(vm->image.mailboxes.pool));
+    }
+    lmc_vm_reset(vm);
+    if (!result)
+        vm->exec.status = LMC_STATUS_ERROR;
+    return result;
+}
+
+void lmc_vm_load_mailboxes(struct lmc_vm* vm, const short pool[NUM_MAILBOXES])
+{
+    memcpy(vm->image.mailboxes.pool, pool, sizeof(vm->image.mailboxes.pool));
+    vm->loaded = true;
+    vm->immutable = lmc_code_immutable(&vm->image.mailboxes);
+    lmc_vm_reset(vm);
+}
+
+void lmc_vm_patch(struct lmc_vm* vm, const short pool[NUM_MAILBOXES],
+                  const unsigned char* addresses, size_t count)
+{
+    // The mailboxes of a failed run are under its error message until the next reset, which
+    // will pick up the patched image anyway.
+    for (size_t i = 0; i < count; ++i)
+    {
+        unsigned char address = addresses[i];
+        if (address >= NUM_MAILBOXES)
+            continue;
+        vm->image.mailboxes.pool[address] = pool[address];
+        if (vm->ready)
+            vm->state.mailboxes.pool[address] = pool[address];
+    }
+
+    // The analysis only holds for runs that start from the image, so the running program
+    // falls back on the engines' checks until the next reset.
+    vm->immutable = vm->loaded && lmc_code_immutable(&vm->image.mailboxes);
+    vm->exec.code_immutable = false;
+}
+
+void lmc_vm_set_engine(struct lmc_vm* vm, enum lmc_engine engine)
+{
+    vm->exec.engine = engine;
+}
+
+void lmc_vm_set_arith(struct lmc_vm* vm, enum lmc_arith arith)
+{
+    vm->exec.arith = arith;
+}
+
+void lmc_vm_set_accelerate(struct lmc_vm* vm, bool accelerate)
+{
+    vm->exec.accelerate = accelerate;
+}
+
+void lmc_vm_set_suspend_on_input(struct lmc_vm* vm, bool suspend)
+{
+    vm->exec.suspend = (suspend) ? &vm->state.regs : NULL;
+}
+
+void lmc_vm_set_max_steps(struct lmc_vm* vm, unsigned long long max_steps)
+{
+    vm->exec.max_steps = max_steps;
+}
+
+void lmc_vm_set_input(struct lmc_vm* vm, const char* input, size_t length)
+{
+    vm->use_streams = false;
+    vm->input = input;
+    vm->input_length = length;
+    lmc_io_init_memory(&vm->io, vm->input, vm->input_length, vm->output, sizeof(vm->output));
+}
+
+void lmc_vm_set_streams(struct lmc_vm* vm, FILE* instream, FILE* outstream)
+{
+    vm->use_streams = true;
+    vm->instream = instream;
+    vm->outstream = outstream;
+    lmc_io_init_streams(&vm->io, instream, outstream);
+}
+
+bool lmc_vm_run(struct lmc_vm* vm)
+{
+    if (!vm->ready)
+    {
+        vm->exec.status = LMC_STATUS_ERROR;
+        if (vm->loaded)
+        {
+            strcpy_s(vm->error, sizeof(vm->error), 
+                     "The program must be reset after a failed run");
+        }
+        else if (vm->error[0] == '\0')
+            strcpy_s(vm->error, sizeof(vm->error), "No program is loaded");
+        return false;
+    }
+
+    // Output from an earlier run only sticks around until the next one.
+    if (!vm->use_streams)
+        vm->io.out_length = vm->io.out_total = 0;
+
+    vm->error[0] = '\0';
+    bool result = lmc_execute_at(&vm->state.mailboxes, &vm->exec, &vm->state.regs);
+
+    // A program that halted starts over from the top on the next run, with its mailboxes as
+    // it left them. One waiting for input has left its registers behind for the next run to
+    // carry on from.
+    if (vm->exec.status != LMC_STATUS_INPUT)
+        memset(&vm->state.regs, 0, sizeof(vm->state.regs));
+    if (!result)
+    {
+        // The engines leave their error message over the pool, which is only restored from
+        // the image on the next reset.
+        strcpy_s(vm->error, sizeof(vm->error), vm->state.mailboxes.error_msg);
+        vm->ready = false;
+    }
+    return result;
+}
+
+bool lmc_vm_resume(struct lmc_vm* vm, short value)
+{
+    if (!vm->ready || vm->exec.status != LMC_STATUS_INPUT)
+    {
+        strcpy_s(vm->error, sizeof(vm->error), "The program is not waiting for input");
+        return false;
+    }
+
+    // Carry out the INP the program stopped at, the same way as reading the value from a line
+    // of input would: a minus sign sets the negative flag rather than negating the value, the
+    // value is clamped to what four characters can hold (-999 to 9999), and then it is put
+    // into the run's accumulator convention.
+    int magnitude = (value < 0) ? min(-(int)value, 999) : min((int)value, 9999);
+    vm->state.regs.negative = (value < 0);
+    vm->state.regs.acc = (short)magnitude;
+    lmc_arith_input(vm->exec.arith, &vm->state.regs.acc, &vm->state.regs.negative);
+    vm->state.regs.pc = (vm->state.regs.pc + 1) % NUM_MAILBOXES;
+    vm->state.regs.steps++;
+    return lmc_vm_run(vm);
+}
+
+void lmc_vm_reset(struct lmc_vm* vm)
+{
+    // A failed load's error sticks around until there is a program to run.
+    if (vm->loaded)
+        vm->error[0] = '\0';
+    vm->ready = vm->loaded;
+    memcpy(&vm->state, &vm->image, sizeof(vm->state));
+    vm->exec.code_immutable = vm->immutable;
+    vm->exec.steps = 0;
+    vm->exec.status = LMC_STATUS_HALTED;
+    if (vm->use_streams)
+        lmc_io_init_streams(&vm->io, vm->instream, vm->outstream);
+    else
+        lmc_io_init_memory(&vm->io, vm->input, vm->input_length, vm->output, sizeof(vm->output));
+}
+
+struct lmc_vm_snapshot* lmc_vm_snapshot(struct lmc_vm* vm)
+{
+    struct lmc_vm_snapshot* snapshot = (struct lmc_vm_snapshot*)util_pool_alloc(&vm->snapshots);
+    memcpy(snapshot->pool, vm->state.mailboxes.pool, sizeof(snapshot->pool));
+    snapshot->regs = vm->state.regs;
+    snapshot->ready = vm->ready;
+    snapshot->status = vm->exec.status;
+    snapshot->input_offset = vm->use_streams ? 0 : (size_t)(vm->io.in_cursor - vm->input);
+    return snapshot;
+}
+
+void lmc_vm_restore(struct lmc_vm* vm, const struct lmc_vm_snapshot* snapshot)
+{
+    memcpy(vm->state.mailboxes.pool, snapshot->pool, sizeof(vm->state.mailboxes.pool));
+    vm->state.regs = snapshot->regs;
+    vm->ready = snapshot->ready;
+    vm->exec.steps = snapshot->regs.steps;
+    vm->exec.status = snapshot->status;
+    if (!vm->use_streams)
+        vm->io.in_cursor = vm->input + min(snapshot->input_offset, vm->input_length);
+}
+
+void lmc_vm_release(struct lmc_vm* vm, struct lmc_vm_snapshot* snapshot)
+{
+    util_pool_free(&vm->snapshots, snapshot);
+}
+
+enum lmc_status lmc_vm_status(const struct lmc_vm* vm)
+{
+    return vm->exec.status;
+}
+
+unsigned long long lmc_vm_steps(const struct lmc_vm* vm)
+{
+    return vm->exec.steps;
+}
+
+const char* lmc_vm_error(const struct lmc_vm* vm)
+{
+    return vm->error;
+}
+
+const char* lmc_vm_output(const struct lmc_vm* vm, size_t* length)
+{
+    if (length)
+        *length = vm->use_streams ? 0 : vm->io.out_total;
+    return vm->output;
+}
+
+const short* lmc_vm_pool(const struct lmc_vm* vm)
+{
+    return vm->state.mailboxes.pool;
+}